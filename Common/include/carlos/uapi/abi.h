@@ -1,2 +1,2 @@
 #pragma once
-#define CARLOS_ABI_VERSION 2
\ No newline at end of file
+#define CARLOS_ABI_VERSION 3
\ No newline at end of file
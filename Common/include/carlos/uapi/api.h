@@ -20,4 +20,13 @@ typedef struct CarlosApi {
   // NEW (ABI bump): list directory entries into user buffer
   // returns: >=0 number of entries, <0 error
   s32 (*fs_listdir)(const char *path, CarlosDirEnt *ents, u32 max_ents);
+
+  // NEW (ABI 3): map [off, off + len) of a file (off page aligned, inside the
+  // file) with CARLOS_MAP_* flags; bytes past EOF read as zero.
+  // returns: address, or 0 on error
+  void* (*mmap)(const char *path, u64 off, u64 len, u32 flags);
+  // unmap a whole mapping (addr/len as given to / returned by mmap), or a
+  // page-aligned head or tail of one
+  // returns: 0, <0 error
+  s32   (*munmap)(void *addr, u64 len);
 } CarlosApi;
\ No newline at end of file
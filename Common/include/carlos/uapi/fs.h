@@ -8,4 +8,8 @@ typedef struct CarlosDirEnt {
   u32  size;                  // bytes (0 for dirs)
   u8   type;                  // 1=file, 2=dir
   u8   _pad[3];
-} CarlosDirEnt;
\ No newline at end of file
+} CarlosDirEnt;
+
+// mmap flags (exactly one)
+#define CARLOS_MAP_READ    1u   // read-only view of the file's cached pages
+#define CARLOS_MAP_PRIVATE 2u   // writable; stores go to a private copy
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include <carlos/dma.h>
 
 int ahci_probe(void);                 // auto-find first AHCI controller
 int ahci_probe_bdf(uint8_t b, uint8_t d, uint8_t f); // explicit
@@ -8,4 +9,61 @@ int ahci_probe_bdf(uint8_t b, uint8_t d, uint8_t f); // explicit
 int ahci_read(uint32_t port, uint64_t lba, uint32_t count, void *buf);
 
 // Write `count` sectors (512B each) from `buf` to `lba` using port `port`.
-int ahci_write(uint32_t port, uint64_t lba, uint32_t count, const void *buf);
\ No newline at end of file
+int ahci_write(uint32_t port, uint64_t lba, uint32_t count, const void *buf);
+
+// ---- Asynchronous commands ----
+// Ports whose drive supports NCQ take up to min(HBA slots, drive queue
+// depth) commands at once (READ/WRITE FPDMA QUEUED); others take one.
+// Queued commands may complete in any order, so requests in flight together
+// must not overlap if one of them writes.
+//
+// One command moves at most 65536 sectors, and as many separate physical
+// runs as its PRDT has entries; ahci_submit issues what fits, leaves the
+// number of sectors taken in rq->count, and the caller submits the rest.
+// ahci_read/ahci_write do that themselves and take any count.
+//
+// Completions arrive by MSI (or INTx), and ahci_wait halts the CPU until
+// they do; without an interrupt it polls.
+//
+// Errors: -6 no free slot, -10 device error, -11 timeout, -12 aborted
+// because another queued command failed (resubmitting is safe).
+
+#define AHCI_REQ_PENDING 1
+
+typedef struct AhciReq AhciReq;
+struct AhciReq {
+  uint64_t lba;
+  uint32_t count;           // sectors
+  void    *buf;
+  uint8_t  write;
+  volatile int status;      // AHCI_REQ_PENDING in flight, then 0 or < 0
+  void   (*done)(AhciReq *rq);   // optional, called by ahci_poll
+  void    *ctx;
+
+  // driver private
+  uint32_t slot;
+  DmaBuf   bounce;
+  int      result;          // status once the slot is given back
+  AhciReq *next;            // queue of requests waiting to be finished
+};
+
+int      ahci_submit(uint32_t port, AhciReq *rq);   // 0 = issued
+uint32_t ahci_poll(uint32_t port);                  // finish completed commands, returns how many
+int      ahci_wait(uint32_t port, AhciReq *rq);     // poll until rq is done, returns its status
+
+typedef struct {
+  uint8_t  ncq;          // queued commands in use
+  uint32_t depth;        // commands the port takes at once
+  uint64_t sectors;      // drive capacity, 0 if IDENTIFY failed
+  uint64_t commands;     // completed, including failed ones
+  uint64_t errors;
+  uint32_t max_inflight; // highest number of commands seen in flight
+
+  const char *irq;       // completion delivery: "msi", "intx" or "polled"
+  uint64_t irqs;         // interrupts that reported this port
+  uint64_t halts;        // times a wait slept until the next interrupt
+  uint64_t lat_avg_ns;   // issue to completion, successful commands
+  uint64_t lat_max_ns;
+} AhciPortInfo;
+
+int ahci_port_info(uint32_t port, AhciPortInfo *out);   // brings the port up if needed
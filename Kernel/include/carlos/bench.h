@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Microbenchmarks for the memory and string primitives (shell: bench mem).
+// src/bench_mem.c has no kernel dependencies, so `make bench-host` also
+// builds it into a Linux program that runs the same tables against glibc;
+// hence the functions under test and the clock come in as pointers.
+
+#define BENCH_MEM_MAX       (8ull << 20)                  // largest size run
+#define BENCH_MEM_BUF_SIZE  (2 * BENCH_MEM_MAX + 4096)    // env buffer
+
+typedef struct {
+  const char *name;
+  void  *(*cpy)(void *dst, const void *src, size_t n);
+  void  *(*set)(void *dst, int c, size_t n);
+  void  *(*move)(void *dst, const void *src, size_t n);
+  int    (*cmp)(const void *a, const void *b, size_t n);
+  size_t (*slen)(const char *s);
+  int    (*seq)(const char *a, const char *b);            // non-zero if equal
+  void   (*norm_abs)(char *p, size_t cap);                // 0 = skip
+  void   (*norm83)(const char *in, char *out, size_t cap); // 0 = skip
+} BenchMemOps;
+
+typedef struct {
+  uint64_t (*now_ns)(void);
+  void     (*out)(const char *s);
+  uint8_t  *buf;       // BENCH_MEM_BUF_SIZE bytes, 64-byte aligned
+  uint64_t  min_ns;    // shortest timed run per result, 0 = default
+} BenchEnv;
+
+void bench_mem_run(const BenchEnv *env, const BenchMemOps *ops);
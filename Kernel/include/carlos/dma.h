@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+// Device-reachable addresses (inclusive upper bound for dma_alloc's max_phys).
+#define DMA_ADDR_32BIT 0x00000000FFFFFFFFull
+#define DMA_ADDR_ANY   0xFFFFFFFFFFFFFFFFull
+
+typedef struct DmaBuf {
+  void    *virt;
+  uint64_t phys;
+  uint64_t size;    // bytes (page-rounded)
+} DmaBuf;
+
+// Physically contiguous, `align`-aligned buffer that lies entirely at or
+// below `max_phys`. Freed buffers are kept in a small pool and handed out
+// again to compatible requests. Returns 0 or a negative error.
+int  dma_alloc(uint64_t size, uint64_t align, uint64_t max_phys, DmaBuf *out);
+void dma_free(DmaBuf *b);
+
+typedef struct {
+  uint32_t pooled;        // buffers parked in the pool
+  uint64_t pooled_pages;
+  uint64_t hits;          // requests served from the pool
+  uint64_t misses;        // requests that went to the PMM
+} DmaStats;
+
+void dma_get_stats(DmaStats *st);
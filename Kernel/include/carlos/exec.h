@@ -3,13 +3,55 @@
 #include <stddef.h>
 
 typedef struct Fs Fs;
+typedef struct MmSpace MmSpace;
+typedef struct KArena KArena;
+typedef struct FsFile FsFile;
+typedef struct PCacheFile ExecText;   // a slot of the exec text PCache
 
 typedef struct ExecImage {
-  void    *raw;    // kmalloc() return (might differ from base due to align-up)
-  void    *base;   // aligned base where image lives
+  void    *base;   // image start inside the app's address space
   uint64_t size;
   void    *entry;  // _start
 } ExecImage;
 
-int exec_elf_load_pie(const void *file, size_t file_sz, ExecImage *out);
-int exec_run_path(Fs *fs, const char *path, int argc, char **argv, const char *cwd);
\ No newline at end of file
+// Where the ELF bytes come from. read() must return exactly len bytes.
+typedef int (*ExecReadFn)(void *ctx, uint64_t off, void *buf, uint32_t len);
+
+typedef struct ExecSource {
+  ExecReadFn read;
+  void      *ctx;
+  uint64_t   size;
+} ExecSource;
+
+// Set up a PIE image in `as` for demand paging: only the headers and the
+// relocation table are read here; segment pages are read (and relocated) on
+// first touch. Loader state goes in `arena`, and `src` must stay readable,
+// for as long as the space exists. With `text`, built pages are kept there
+// and mapped into later runs instead (NULL: every page is private).
+int exec_elf_load_pie(const ExecSource *src, KArena *arena, MmSpace *as,
+                      ExecText *text, ExecImage *out);
+int exec_run_path(Fs *fs, const char *path, int argc, char **argv, const char *cwd);
+
+// Text cache: the built (relocated) pages of recently run images, keyed by
+// the file's cluster, size and mtime. Later runs map them
+// directly, read-only ones shared and writable ones copy-on-write. An entry
+// is pinned between get and put; idle ones go to the shrinker.
+ExecText *exec_text_get(const FsFile *f);   // NULL: run uncached
+void      exec_text_put(ExecText *t);
+
+// Loader side: size the entry for an image of `pages` pages (<0 when the
+// entry can't hold it), then look up (0 = not built) / hand over the frame
+// of page idx (<0: not taken, caller keeps it).
+int       exec_text_bind(ExecText *t, uint64_t pages);
+uint64_t  exec_text_page(ExecText *t, uint64_t idx);
+int       exec_text_set_page(ExecText *t, uint64_t idx, uint64_t phys);
+
+typedef struct {
+  uint32_t entries;       // images cached
+  uint64_t pages;         // frames held
+  uint64_t hits;          // pages mapped from the cache
+  uint64_t fills;         // pages built and added
+  uint64_t evictions;     // entries dropped (stale, slot reuse, shrinker)
+} ExecTextStats;
+
+void exec_text_stats(ExecTextStats *st);
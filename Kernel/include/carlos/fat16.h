@@ -2,6 +2,7 @@
 #pragma once
 #include <stdint.h>
 #include <carlos/disk.h>
+#include <carlos/karena.h>
 
 typedef struct Fat16 {
   Disk    *disk;
@@ -18,6 +19,8 @@ typedef struct Fat16 {
   uint64_t root_lba;
   uint32_t root_secs;
   uint64_t data_lba;
+
+  KArena  *scratch;    // per-call temporaries, owned by the fs layer (0 = iterator cache)
 } Fat16;
 
 // Directory iterator
@@ -37,11 +40,16 @@ typedef struct FatDirIter {
   // sector buffer
   uint64_t cur_lba;
   uint16_t ent_idx;         // 0..(bps/32-1) within current sector
+  uint32_t mtime;           // last entry returned: WrtDate << 16 | WrtTime
   uint8_t  secbuf[512];
 } FatDirIter;
 
 int fat16_mount(Fat16 *fs, Disk *disk, uint64_t base_lba);
 
+// Iterators are ~560 bytes; allocate them from the iterator cache.
+FatDirIter* fat16_dir_iter_alloc(void);
+void        fat16_dir_iter_free(FatDirIter *it);
+
 int fat16_root_iter_begin(Fat16 *fs, FatDirIter *it);
 int fat16_dir_iter_begin(Fat16 *fs, FatDirIter *it, uint16_t first_clus);
 int fat16_dir_iter_next(FatDirIter *it, /*out*/ char name83[13],
@@ -56,4 +64,11 @@ int fat16_stat_path83(Fat16 *fs, const char *path,
                       /*out*/ uint16_t *clus,
                       /*out*/ uint8_t  *attr,
                       /*out*/ uint32_t *size);
+
+// Same, plus the entry's last-write stamp (WrtDate << 16 | WrtTime).
+int fat16_stat_path83_mtime(Fat16 *fs, const char *path,
+                            /*out*/ uint16_t *clus,
+                            /*out*/ uint8_t  *attr,
+                            /*out*/ uint32_t *size,
+                            /*out*/ uint32_t *mtime);
                       
\ No newline at end of file
@@ -5,7 +5,11 @@
 void fbcon_init(uint64_t fb_base_phys, uint64_t fb_size,
                 uint32_t w, uint32_t h, uint32_t ppsl, uint32_t fmt);
 
+// Switch the framebuffer mapping's caching (IOMAP_* from iomap.h)
+int  fbcon_remap(uint32_t iomap_flags);
+
 void fbcon_clear(void);
+void fbcon_scroll(void);
 void fbcon_putc(char c);
 void fbcon_puts(const char *s);
 
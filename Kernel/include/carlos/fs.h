@@ -3,6 +3,7 @@
 #include <carlos/disk.h>
 #include <carlos/part.h>
 #include <carlos/fat16.h>
+#include <carlos/karena.h>
 #include <carlos/boot/bootinfo.h>
 
 typedef struct Fs {
@@ -10,6 +11,7 @@ typedef struct Fs {
   Partition root_part;
   Fat16     fat;
   uint32_t  port;    // AHCI port index we mounted from
+  KArena   *scratch; // per-call temporaries (paths, dir iterators)
 } Fs;
 
 enum {
@@ -31,8 +33,21 @@ int fs_read_file_at(Fs *fs, const char *path,
                     uint32_t offset, void *buf, uint32_t len,
                     uint32_t *out_read);
 
+// Resolved file for repeated random-access reads (no path walk per read)
+typedef struct FsFile {
+  Fs      *fs;
+  uint16_t clus;   // first cluster
+  uint32_t size;
+  uint32_t mtime;  // FAT last-write stamp (date << 16 | time)
+} FsFile;
+
+int fs_open(Fs *fs, const char *path, FsFile *out);
+int fs_read_at(const FsFile *f, uint32_t offset, void *buf, uint32_t len,
+               uint32_t *out_read);
+
 int fs_list_dir(Fs *fs, const char *path);
 // new: generic listdir that hides FAT16
+// cb must not call back into fs_* (the listing lives in the per-call scratch)
 typedef int (*fs_listdir_cb)(void *ud, const char name83[13], uint8_t attr, uint32_t size);
 int fs_listdir(Fs *fs, const char *path, fs_listdir_cb cb, void *ud);
 
@@ -5,12 +5,26 @@
 
 typedef void (*irq_handler_t)(int irq, void *ctx);
 
-void intr_init(void);              // installs IRQ gates (0x20..0x2F)
+#define IRQ_LEGACY_COUNT 16        // PIC IRQs, vectors 0x20..0x2F
+#define IRQ_MSI_COUNT    8         // MSI vectors 0x30..0x37, EOI at the LAPIC
+
+void intr_init(void);              // installs IRQ gates (0x20..0x37)
 
 void intr_enable(void);
 void intr_disable(void);
 
+// Trap handlers (IRQs, #PF being resolved) currently running. The vector
+// registers belong to whatever they interrupted and are not saved, so the
+// asm that uses them (mem_s.S) checks this first; compiled C never does
+// (-mgeneral-regs-only).
+extern volatile uint32_t g_intr_nesting;
+static inline int intr_in_trap(void){ return g_intr_nesting != 0; }
+
 uint64_t intr_save(void);          // returns rflags
 void     intr_restore(uint64_t f); // restores rflags (incl IF)
 
-int irq_register(int irq, irq_handler_t fn, void *ctx);
\ No newline at end of file
+int irq_register(int irq, irq_handler_t fn, void *ctx);
+
+// Claim an MSI vector; returns it (0x30..0x37), < 0 when all are taken.
+// The handler gets irq = vector - 0x20.
+int intr_alloc_msi(irq_handler_t fn, void *ctx);
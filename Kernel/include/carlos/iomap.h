@@ -3,9 +3,22 @@
 #include <stddef.h>
 #include <carlos/phys.h>
 
-// For now, kernel is effectively identity-mapped for these regions in QEMU.
-// Later this will create a proper virtual mapping (UC/WC attributes).
-static inline void* iomap(uint64_t phys, size_t size, uint32_t flags){
-  (void)size; (void)flags;
-  return phys_to_ptr(phys);
-}
\ No newline at end of file
+// Caching for iomap(). UC is the default and the right choice for registers.
+#define IOMAP_UC       0u
+#define IOMAP_UC_MINUS 1u   // UC, but an MTRR may upgrade it to WC
+#define IOMAP_WC       2u   // write-combining: framebuffers
+#define IOMAP_WB       3u
+
+// Map [phys, phys + size) into the kernel's I/O window with the requested
+// caching. Mapping a range inside an existing window returns that window;
+// with other flags the whole window (and the direct map) is retyped in
+// place first. A range straddling the edge of a window is refused.
+// Before mm_init() this falls back to phys_to_ptr().
+void*    iomap(uint64_t phys, size_t size, uint32_t flags);
+
+typedef struct {
+  uint32_t maps;         // live windows
+  uint64_t bytes;        // VA handed out
+} IomapStats;
+
+void     iomap_stats(IomapStats *st);
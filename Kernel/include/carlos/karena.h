@@ -0,0 +1,15 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Request-scoped bump allocator over PMM page chunks.
+// Nothing is freed individually: karena_reset() drops every allocation
+// (keeping the first chunk for reuse), karena_destroy() returns all pages.
+typedef struct KArena KArena;
+
+KArena* karena_create(size_t chunk_bytes);          // 0 = one page per chunk
+void*   karena_alloc(KArena *a, size_t size, size_t align);
+void    karena_reset(KArena *a);
+void    karena_destroy(KArena *a);
+
+uint64_t karena_bytes_used(const KArena *a);
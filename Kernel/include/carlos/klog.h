@@ -40,6 +40,7 @@ enum {
   KLOG_MOD_AHCI = 1u<<9,
   KLOG_MOD_INTR = 1u<<10,
   KLOG_MOD_PIC  = 1u<<11,
+  KLOG_MOD_MM   = 1u<<12,
   KLOG_MOD_ALL  = 0xFFFFFFFFu
 };
 
@@ -4,4 +4,19 @@
 
 void  kmem_init(void);
 void* kmalloc(size_t size);
-void  kfree(void *p); 
\ No newline at end of file
+void* kmalloc_tagged(size_t size, const char *tag);   // accounted under `tag`
+void  kfree(void *p);
+
+// Page-backed allocations first try to grow in place (claiming the free
+// pages right behind them); otherwise allocate + copy.
+void* krealloc(void *p, size_t size);
+
+// Object caches (single-page slabs, LIFO free lists).
+// kmalloc() itself is backed by power-of-two caches from 16B to 2KiB.
+typedef struct KmemCache KmemCache;
+
+KmemCache* kmem_cache_create(const char *name, size_t obj_size, size_t align);
+void*      kmem_cache_alloc(KmemCache *c);
+void       kmem_cache_free(KmemCache *c, void *obj);
+uint64_t   kmem_cache_shrink(KmemCache *c);   // release empty slabs, returns pages freed
+void       kmem_dump_caches(void);
@@ -0,0 +1,10 @@
+// include/carlos/lapic.h
+#pragma once
+#include <stdint.h>
+
+// Local APIC of the boot CPU: only what MSI delivery needs. Legacy IRQs
+// keep going through the PIC (LINT0 virtual wire).
+int      lapic_init(void);    // map + software-enable; < 0 if there is none
+int      lapic_ready(void);
+uint32_t lapic_id(void);
+void     lapic_eoi(void);
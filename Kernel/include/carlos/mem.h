@@ -0,0 +1,24 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// The compiler lowers __builtin_mem* and struct copies to these as well.
+// Until mem_init() has looked at CPUID they run the SSE2 baseline.
+void *memcpy(void *dst, const void *src, size_t n);
+void *memmove(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
+int   memcmp(const void *a, const void *b, size_t n);
+
+// Streaming versions: stores bypass the caches (MOVNTDQ, MOVNTI in trap
+// context) and are fenced before returning. For data the CPU won't read
+// back soon: the framebuffer, pages zeroed ahead of use. memcpy/memset
+// switch to them on their own from mem_nt_threshold() bytes up.
+void *memcpy_nt(void *dst, const void *src, size_t n);
+void *memset_nt(void *dst, int c, size_t n);
+void *memset32_nt(void *dst, uint32_t v, size_t count);   // dst 4-byte aligned
+
+// Pick ERMS / AVX2 variants (enables the AVX register state if needed)
+// and the non-temporal threshold from the cache size.
+void        mem_init(void);
+const char *mem_impl_name(void);   // e.g. "avx2+erms"
+uint64_t    mem_nt_threshold(void);
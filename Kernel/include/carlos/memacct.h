@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+
+// Per-call-site memory accounting for kmalloc and the PMM.
+// Build with KMEM_ACCT=0 (make MEM_ACCT=0) to compile it out.
+#ifndef KMEM_ACCT
+#define KMEM_ACCT 1
+#endif
+
+enum {
+  MEMACCT_KMALLOC = 0,
+  MEMACCT_PMM     = 1,
+  MEMACCT_NR_KINDS
+};
+
+// Sites 0 and 1 are the overflow buckets for KMALLOC and PMM.
+#define MEMACCT_MAX_SITES 256
+
+#define MEMACCT_CALLER() ((uintptr_t)__builtin_return_address(0))
+
+#if KMEM_ACCT
+
+uint16_t memacct_site(unsigned kind, uintptr_t caller, const char *tag);
+void     memacct_alloc(uint16_t site, uint64_t bytes);
+void     memacct_free(uint16_t site, uint64_t bytes);
+void     memacct_resize(uint16_t site, uint64_t old_bytes, uint64_t new_bytes);
+
+#else
+
+static inline uint16_t memacct_site(unsigned kind, uintptr_t caller, const char *tag) {
+  (void)caller; (void)tag; return (uint16_t)kind;
+}
+static inline void memacct_alloc(uint16_t site, uint64_t bytes) { (void)site; (void)bytes; }
+static inline void memacct_free(uint16_t site, uint64_t bytes)  { (void)site; (void)bytes; }
+static inline void memacct_resize(uint16_t site, uint64_t old_bytes, uint64_t new_bytes) {
+  (void)site; (void)old_bytes; (void)new_bytes;
+}
+
+#endif
+
+// Print totals and the `top` sites with the most live bytes.
+void memacct_dump(unsigned top);
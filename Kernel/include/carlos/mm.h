@@ -1,5 +1,150 @@
 #pragma once
 #include <stdint.h>
+#include <carlos/phys.h>
+#include <carlos/boot/bootinfo.h>
 
-// Later: paging / mapping functions live here.
-// For now, keep this header for the “memory manager” module boundary.
\ No newline at end of file
+// x86-64 page table entry bits
+#define PTE_P     (1ull << 0)
+#define PTE_W     (1ull << 1)
+#define PTE_U     (1ull << 2)
+#define PTE_PWT   (1ull << 3)
+#define PTE_PCD   (1ull << 4)
+#define PTE_A     (1ull << 5)
+#define PTE_D     (1ull << 6)
+#define PTE_PS    (1ull << 7)   // 2 MiB / 1 GiB leaf in PD / PDPT
+#define PTE_G     (1ull << 8)
+#define PTE_OWNED (1ull << 9)    // software: frame is freed with its address space
+#define PTE_COW   (1ull << 10)   // software: shared read-only, copied on first store
+#define PTE_NX    (1ull << 63)
+#define PTE_ADDR  0x000FFFFFFFFFF000ull
+
+#define MM_PAGE_1G (1ull << 30)
+#define MM_PAGE_2M (1ull << 21)
+
+// Kernel I/O window for iomap(); its PDPT is created by mm_init() so every
+// address space shares it.
+#define MM_IOMAP_BASE 0xFFFFC00000000000ull
+
+// Cache type selectors for leaf entries (PAT is programmed by mm_init()).
+// Without PAT support, WC degrades to WT.
+#define PTE_CACHE_WB     0ull
+#define PTE_CACHE_WC     PTE_PWT
+#define PTE_CACHE_UC_MIN PTE_PCD
+#define PTE_CACHE_UC     (PTE_PCD | PTE_PWT)
+
+// Build the kernel's own PML4: all RAM (and at least the low 4 GiB, which
+// holds the MMIO hole) mapped at PHYS_MAP_BASE with the largest page size the
+// CPU supports, plus an identity window for the low-linked kernel image.
+// Switches CR3 and phys_to_ptr() over to it. Call right after pmm_init().
+int      mm_init(const BootInfo *bi);
+
+uint64_t mm_kernel_cr3(void);   // 0 until mm_init() succeeded
+
+// Map [phys, phys + size) at va in the tables rooted at pml4_phys, using
+// 2 MiB leaves where both sides are aligned. flags are PTE_* leaf bits
+// (PTE_P is implied). The range must not be mapped yet. Returns 0 or <0.
+int      mm_map(uint64_t pml4_phys, uint64_t va, uint64_t phys, uint64_t size, uint64_t flags);
+
+// Give [phys, phys + size) the cache type `cache` (PTE_CACHE_*) in the
+// direct map, splitting large leaves at the edges. iomap() does this so a
+// range is never mapped with two different types (undefined, SDM 11.12.4).
+// Parts above the direct map are ignored. Returns 0 or <0.
+int      mm_direct_set_cache(uint64_t phys, uint64_t size, uint64_t cache);
+
+// Same for the already mapped kernel range [va, va + size): iomap() retypes
+// a window in place rather than mapping the range a second time.
+int      mm_set_cache(uint64_t va, uint64_t size, uint64_t cache);
+
+// Application address space: a PML4 whose APP_SPACE_BASE slot is private
+// and whose other entries are the kernel's. Tagged with a PCID when the CPU
+// has them, so switching in and out does not flush the TLB.
+typedef struct MmVma MmVma;
+
+typedef struct MmSpace {
+  uint64_t pml4_phys;
+  uint16_t pcid;
+  uint8_t  stale;    // PCID may still tag old entries: flush on first load
+  MmVma   *vmas;     // demand-paged regions, sorted by start
+} MmSpace;
+
+// Fill a freshly allocated, zeroed page for `va` on first touch. May change
+// *pte_flags (e.g. drop PTE_W for read-only segments). Returns 0 or <0.
+// The handler first calls it with page == NULL to ask whether `va` has any
+// content; MM_FILL_ZERO means no, and a read maps the shared zero page.
+// MM_FILL_SHARED hands over a ready frame the callback keeps owning, its
+// address in the PTE_ADDR bits of *pte_flags; writable ones are mapped
+// copy-on-write. 0 asks for a private page to be filled.
+#define MM_FILL_ZERO   1
+#define MM_FILL_SHARED 2
+typedef int (*MmFillFn)(void *ctx, uint64_t va, void *page, uint64_t *pte_flags);
+
+// Side-effect-free question: does `va` have content? MM_FILL_ZERO if not,
+// with *pte_flags as the fill would set them; anything else if it has.
+// Never reads the backing file or allocates.
+typedef int (*MmProbeFn)(void *ctx, uint64_t va, uint64_t *pte_flags);
+
+// Called once the VMA is gone (unmapped or its space destroyed).
+typedef void (*MmDropFn)(void *ctx);
+
+struct MmVma {
+  uint64_t start, end;   // page aligned
+  uint64_t flags;        // PTE_* for pages faulted in
+  MmFillFn fill;         // NULL: zero-filled
+  MmProbeFn probe;       // optional, lets empty blocks of a filled VMA go 2 MiB
+  MmDropFn drop;         // optional
+  void    *ctx;
+  MmVma   *next;
+};
+
+int      mm_space_create(MmSpace *as);
+void     mm_space_destroy(MmSpace *as);   // frees PTE_OWNED frames and tables
+void     mm_space_switch(MmSpace *as);    // NULL = kernel tables
+
+MmSpace *mm_space_current(void);         // NULL while on kernel tables
+
+// Register [start, end) of `as` for demand paging; pages are allocated and
+// filled by the #PF handler. Ranges must not overlap. A 2 MiB block that lies
+// wholly inside one VMA is mapped with a single 2 MiB page when it is first
+// written and no page in it has content (no fill, or probe says so for all
+// of them) and all would get the same flags. Blocks with content stay 4 KiB
+// pages, read on demand.
+int      mm_space_add_vma(MmSpace *as, uint64_t start, uint64_t end,
+                          uint64_t pte_flags, MmFillFn fill, MmProbeFn probe,
+                          MmDropFn drop, void *ctx);
+
+// Remove [start, end) from the VMA holding it: the whole VMA, or its head or
+// tail. Pages in the range are unmapped (owned frames freed; 2 MiB pages
+// straddling an edge are split first). The drop callback runs once the VMA
+// is gone entirely. Returns 0 or <0.
+int      mm_space_remove_vma(MmSpace *as, uint64_t start, uint64_t end);
+
+// Lowest start >= from, aligned to `align` (a power of two, at least a
+// page), where `size` bytes fit between the VMAs of `as`, or 0 if the app
+// range has no such hole.
+uint64_t mm_space_find_gap(MmSpace *as, uint64_t from, uint64_t size, uint64_t align);
+
+// #PF entry point: resolve a fault at `va` in the active space.
+// Returns 0 when the faulting access can be retried.
+int      mm_handle_fault(uint64_t va, uint64_t err);
+
+// Look up va in the tables rooted at pml4_phys. Returns 0 or <0 (unmapped).
+int      mm_translate(uint64_t pml4_phys, uint64_t va, uint64_t *out_phys);
+
+typedef struct {
+  uint64_t mapped_bytes;   // size of the direct map
+  uint64_t page_size;      // leaf size used (1 GiB or 2 MiB)
+  uint32_t table_pages;    // pages spent on paging structures
+  uint8_t  pat;            // PAT programmed (WC available)
+  uint8_t  pcid;           // CR4.PCIDE set
+  uint8_t  invpcid;
+  uint64_t spaces;         // address spaces created
+  uint64_t faults;         // pages demand-filled
+  uint64_t zero_maps;      // faults served by the shared zero page
+  uint64_t shared_maps;    // faults served by a frame the VMA keeps
+  uint64_t cow_faults;     // PTE_COW pages copied on first store
+  uint64_t huge_maps;      // faults served by a whole 2 MiB page
+  uint64_t huge_splits;    // 2 MiB pages broken back into 4 KiB ones
+  uint64_t bad_faults;     // faults that could not be resolved
+} MmStats;
+
+void     mm_stats(MmStats *st);
@@ -30,4 +30,19 @@ static inline uint64_t mmio_read64_phys(uint64_t phys){
 }
 static inline void mmio_write64_phys(uint64_t phys, uint64_t v){
   *(volatile uint64_t*)phys_to_ptr(phys) = v;
-}
\ No newline at end of file
+}
+// Mapped-pointer helpers (for registers mapped with iomap())
+
+static inline uint32_t mmio_read32(const volatile void *p){
+  return *(const volatile uint32_t*)p;
+}
+static inline void mmio_write32(volatile void *p, uint32_t v){
+  *(volatile uint32_t*)p = v;
+}
+
+static inline uint64_t mmio_read64(const volatile void *p){
+  return *(const volatile uint64_t*)p;
+}
+static inline void mmio_write64(volatile void *p, uint64_t v){
+  *(volatile uint64_t*)p = v;
+}
@@ -2,4 +2,7 @@
 
 static inline int path_is_sep(char c){ return c=='/' || c=='\\'; }
 
-void path_normalize_abs(char *p, size_t cap);
\ No newline at end of file
+void path_normalize_abs(char *p, size_t cap);
+
+// "/efi/carlos" -> "EFI/CARLOS", the form the FAT 8.3 lookups take
+void path_norm83(const char *in, char *out, size_t cap);
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+#include <carlos/fs.h>
+#include <carlos/shrinker.h>
+
+// Page-slot cache: a fixed table of files, each keyed by the file's identity
+// (fs, first cluster, size, mtime) and holding one frame per page. Frames
+// are handed out to be mapped, never to be written. A file is pinned
+// between get and put; the pages of idle files go to the shrinker, least
+// recently used first. The file page cache below and the exec text cache
+// are both instances of it.
+typedef struct PCacheFile {
+  FsFile    file;       // file.fs == 0: slot unused
+  uint32_t  users;      // pinned while > 0
+  uint64_t  last_use;   // LRU stamp
+  uint64_t  npages;
+  uint64_t *pages;      // frame per page, 0 = not filled yet
+  uint64_t  held;       // non-zero entries in pages[]
+} PCacheFile;
+
+typedef struct PCache {
+  const char *name;     // shrinker name, kmalloc tag
+  PCacheFile *slots;
+  unsigned    nslots;
+
+  uint64_t    clock;
+  uint64_t    hits;
+  uint64_t    fills;
+  uint64_t    evictions;  // files dropped (stale, slot reuse, shrinker)
+  Shrinker    shrinker;   // registered on the first slot claim
+} PCache;
+
+typedef struct {
+  uint32_t files;         // files cached
+  uint64_t pages;         // frames held
+  uint64_t hits;
+  uint64_t misses;        // pages filled (read from disk)
+  uint64_t evictions;     // files dropped (stale, slot reuse, shrinker)
+} PCacheStats;
+
+#define PCACHE_INIT(name_, slots_) \
+  { .name = (name_), .slots = (slots_), .nslots = sizeof(slots_) / sizeof((slots_)[0]) }
+
+PCacheFile *pcache_get(PCache *c, const FsFile *f);   // NULL: every slot pinned
+void        pcache_put(PCache *c, PCacheFile *pf);
+
+// Size the page table (<0 when already sized differently or out of
+// memory), then look up (0 = not filled) / hand over the frame of page idx
+// (<0: not taken, caller keeps it).
+int         pcache_bind(PCache *c, PCacheFile *pf, uint64_t npages);
+uint64_t    pcache_lookup(PCache *c, PCacheFile *pf, uint64_t idx);
+int         pcache_insert(PCache *c, PCacheFile *pf, uint64_t idx, uint64_t phys);
+
+void        pcache_stats_of(const PCache *c, PCacheStats *st);
+
+// File page cache: whole 4 KiB pages of file data.
+PCacheFile *pcache_open(const FsFile *f);   // NULL: no free slot / no memory
+void        pcache_close(PCacheFile *pf);
+
+// Frame holding file bytes [idx * 4096, +4096), zero past EOF; read in on a
+// miss. Returns 0 if idx is past the end or the read failed.
+uint64_t    pcache_page(PCacheFile *pf, uint64_t idx);
+void        pcache_stats(PCacheStats *st);
@@ -10,4 +10,17 @@ uint32_t pci_read32(uint8_t bus, uint8_t dev, uint8_t fun, uint16_t off);
 uint16_t pci_read16(uint8_t bus, uint8_t dev, uint8_t fun, uint16_t off);
 uint8_t  pci_read8 (uint8_t bus, uint8_t dev, uint8_t fun, uint16_t off);
 
-int pci_get_bus_range(uint8_t *start, uint8_t *end);
\ No newline at end of file
+int pci_get_bus_range(uint8_t *start, uint8_t *end);
+
+void pci_write32(uint8_t bus, uint8_t dev, uint8_t fun, uint16_t off, uint32_t v);
+void pci_write16(uint8_t bus, uint8_t dev, uint8_t fun, uint16_t off, uint16_t v);
+
+#define PCI_CAP_MSI           0x05
+#define PCI_CMD_BUS_MASTER    (1u<<2)
+#define PCI_CMD_INTX_DISABLE  (1u<<10)
+
+uint8_t pci_find_cap(uint8_t bus, uint8_t dev, uint8_t fun, uint8_t id);   // 0 = absent
+
+// Single-vector MSI to `vector` on the CPU with local APIC id `apic_id`;
+// also masks the function's INTx. < 0 if it has no MSI capability.
+int pci_msi_enable(uint8_t bus, uint8_t dev, uint8_t fun, uint8_t vector, uint8_t apic_id);
\ No newline at end of file
@@ -4,19 +4,35 @@
 
 #define PAGE_SIZE 4096ULL
 
+// All physical memory is mapped at PHYS_MAP_BASE once mm_init() has run.
+// Before that (and for the kernel image, which is linked low) addresses are
+// identity-mapped, so g_phys_map_base starts out as 0.
+#define PHYS_MAP_BASE 0xFFFF800000000000ULL
+
+extern uint64_t g_phys_map_base;
+
+// Per-application mappings (one PML4 slot, see mm_space_create()). Pointers
+// in here are only valid while that address space is active.
+#define APP_SPACE_BASE 0x0000700000000000ULL
+#define APP_SPACE_END  0x0000708000000000ULL
+
+uint64_t mm_virt_to_phys(uint64_t va);   // walk the active page tables
+
 static inline void* phys_to_ptr(uint64_t phys){
-  // identity-map for now
-  return (void*)(uintptr_t)phys;
+  return (void*)(uintptr_t)(phys + g_phys_map_base);
 }
 
 static inline const void* phys_to_cptr(uint64_t phys){
-  // identity-map for now
-  return (const void*)(uintptr_t)phys;
+  return (const void*)(uintptr_t)(phys + g_phys_map_base);
 }
 
+// Accepts direct-map pointers, identity ones (kernel image, anything handed
+// out before the switch) and app pointers (translated per page).
 static inline uint64_t ptr_to_phys(const void *p){
-  // identity-map for now
-  return (uint64_t)(uintptr_t)p;
+  uint64_t v = (uint64_t)(uintptr_t)p;
+  if (v >= PHYS_MAP_BASE) return v - PHYS_MAP_BASE;
+  if (v >= APP_SPACE_BASE && v < APP_SPACE_END) return mm_virt_to_phys(v);
+  return v;
 }
 
 static inline uint64_t page_align_down(uint64_t x){
@@ -25,4 +41,4 @@ static inline uint64_t page_align_down(uint64_t x){
 
 static inline uint64_t page_align_up(uint64_t x){
   return (x + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
-}
\ No newline at end of file
+}
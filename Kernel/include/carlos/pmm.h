@@ -3,6 +3,13 @@
 #include <carlos/phys.h>
 #include <carlos/boot/bootinfo.h>
 
+// Buddy orders: block of order N is 2^N pages, naturally aligned.
+#define PMM_NR_ORDERS 16
+
+// 2 MiB frames (order 9), naturally aligned.
+#define PMM_HUGE_ORDER     9
+#define PMM_HUGE_PAGE_SIZE (4096ull << PMM_HUGE_ORDER)
+
 void     pmm_init(const BootInfo *bi);
 
 uint64_t pmm_alloc_page_phys(void);
@@ -11,6 +18,14 @@ void     pmm_free_page_phys(uint64_t phys);
 uint64_t pmm_alloc_contig_pages_phys(uint64_t pages);
 void     pmm_free_contig_pages_phys(uint64_t base_phys, uint64_t pages);
 
+// Contiguous run aligned to `align` bytes (power of two) whose last byte is
+// at or below `max_phys`. Meant for DMA; see dma.h.
+uint64_t pmm_alloc_contig_pages_below_phys(uint64_t pages, uint64_t align, uint64_t max_phys);
+
+// Allocate exactly [phys, phys + pages) if every page in it is free (used to
+// grow an allocation in place). Returns 0 on success.
+int      pmm_claim_pages_phys(uint64_t phys, uint64_t pages);
+
 static inline void* pmm_alloc_page(void) {
   uint64_t phys = pmm_alloc_page_phys();
   return phys ? phys_to_ptr(phys) : 0;
@@ -21,4 +36,79 @@ static inline void pmm_free_page(void *ptr) {
   pmm_free_page_phys(ptr_to_phys(ptr));
 }
 
-uint64_t pmm_free_count(void);
\ No newline at end of file
+uint64_t pmm_free_count(void);
+uint64_t pmm_free_count_order(unsigned order);   // free blocks of 2^order pages
+
+// Pre-zeroed pages. The pool is refilled in idle time via pmm_zero_pool_refill();
+// on a pool miss the page is zeroed synchronously.
+typedef struct {
+  uint32_t avail;
+  uint32_t cap;
+  uint64_t hits;
+  uint64_t misses;
+} PmmZeroPoolStats;
+
+uint64_t pmm_alloc_zeroed_page_phys(void);
+uint64_t pmm_alloc_zeroed_pages_phys(uint64_t pages);   // contiguous
+uint32_t pmm_zero_pool_refill(uint32_t budget);         // returns pages zeroed
+void     pmm_zero_pool_stats(PmmZeroPoolStats *st);
+
+static inline void* pmm_alloc_zeroed_page(void) {
+  uint64_t phys = pmm_alloc_zeroed_page_phys();
+  return phys ? phys_to_ptr(phys) : 0;
+}
+
+static inline void* pmm_alloc_zeroed_pages(uint64_t pages) {
+  uint64_t phys = pmm_alloc_zeroed_pages_phys(pages);
+  return phys ? phys_to_ptr(phys) : 0;
+}
+
+// Memory pressure: shrinkers run when free pages drop below wmark_low
+// (until wmark_high) and when an allocation fails.
+typedef struct {
+  uint64_t wmark_low;
+  uint64_t wmark_high;
+  uint64_t wmark_runs;
+  uint64_t fail_runs;
+} PmmPressureStats;
+
+void     pmm_pressure_stats(PmmPressureStats *st);
+
+// 2 MiB frames: served from a small boot-time reserve, then from the buddy
+// allocator. Free with pmm_free_huge_page_phys (refills the reserve).
+typedef struct {
+  uint32_t reserved;
+  uint32_t cap;
+  uint64_t hits;        // served from the reserve
+  uint64_t fallbacks;   // served by the buddy allocator
+  uint64_t fails;
+} PmmHugeStats;
+
+uint64_t pmm_alloc_huge_page_phys(void);
+void     pmm_free_huge_page_phys(uint64_t phys);
+void     pmm_huge_stats(PmmHugeStats *st);
+
+// Movable pages: `word` is the only place holding the page's address (a PTE
+// or a cache slot, address in bits 12..51). Compaction may move the page and
+// rewrite that word. NULL makes the page pinned again; freeing clears it.
+void     pmm_set_owner(uint64_t phys, uint64_t *word);
+
+// A pointer the allocator of a pinned page keeps with it (kmem: the slab
+// descriptor). Freeing the page clears it; pages without one read 0.
+void     pmm_set_page_priv(uint64_t phys, void *priv);
+void    *pmm_page_priv(uint64_t phys);
+
+// Called after compaction moved pages, as owner words may be live PTEs.
+void     pmm_set_tlb_flush_hook(void (*fn)(void));
+
+// Contiguous allocations that find no free block compact before failing.
+// pmm_compact() builds a free block of `order` on demand; 0 if one exists.
+typedef struct {
+  uint64_t runs;
+  uint64_t ok;          // runs that produced a block
+  uint64_t migrated;    // pages moved
+  uint64_t ns;          // time spent
+} PmmCompactStats;
+
+int      pmm_compact(unsigned order);
+void     pmm_compact_stats(PmmCompactStats *st);
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+
+// Memory-pressure callbacks. A shrinker gives cached pages back to the
+// PMM on request and returns how many it actually freed.
+typedef uint64_t (*shrinker_scan_fn)(void *ctx, uint64_t nr_pages);
+
+// Priorities: lower runs first (cheapest to rebuild).
+enum {
+  SHRINK_PRIO_POOL    = 0,   // pre-zeroed / pinned pools
+  SHRINK_PRIO_SLAB    = 10,  // empty slabs
+  SHRINK_PRIO_CACHE   = 20,  // content caches (must re-read from disk)
+  SHRINK_PRIO_RESERVE = 30,  // boot-time reserves (last resort)
+};
+
+typedef struct Shrinker {
+  const char      *name;
+  shrinker_scan_fn scan;
+  void            *ctx;
+  int              priority;
+
+  // stats (owned by the registry)
+  uint64_t calls;
+  uint64_t reclaimed;        // pages
+  struct Shrinker *next;
+} Shrinker;
+
+// `s` must stay valid forever (static storage); registering twice is a no-op.
+void     shrinker_register(Shrinker *s);
+
+// Ask shrinkers, in priority order, for `nr_pages`. Returns pages freed.
+// Re-entrant calls (from within a shrinker) return 0.
+uint64_t shrinker_run(uint64_t nr_pages);
+
+void     shrinker_dump(void);
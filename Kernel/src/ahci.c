@@ -1,10 +1,16 @@
 #include <stdint.h>
+#include <stddef.h>
 #include <carlos/ahci.h>
 #include <carlos/pci.h>
-#include <carlos/iomap.h>
 #include <carlos/mmio.h>
+#include <carlos/iomap.h>
 #include <carlos/klog.h>
 #include <carlos/pmm.h>
+#include <carlos/dma.h>
+#include <carlos/intr.h>
+#include <carlos/pic.h>
+#include <carlos/lapic.h>
+#include <carlos/time.h>
 
 // AHCI HBA regs offsets
 enum {
@@ -17,6 +23,7 @@ enum {
 
   AHCI_PORTS = 0x100,
   AHCI_PORT_SZ = 0x80,
+  AHCI_ABAR_SIZE = 0x1100,   // generic regs + 32 ports
 
   // per-port offsets
   P_IS   = 0x10,
@@ -31,6 +38,34 @@ enum {
   P_CI   = 0x38,
 };
 
+// ATA commands
+enum {
+  ATA_READ_DMA_EXT   = 0x25,
+  ATA_READ_LOG_EXT   = 0x2F,
+  ATA_WRITE_DMA_EXT  = 0x35,
+  ATA_READ_FPDMA     = 0x60,   // NCQ
+  ATA_WRITE_FPDMA    = 0x61,
+  ATA_IDENTIFY       = 0xEC,
+};
+
+#define AHCI_SLOTS    32
+#define AHCI_PRDT_MAX 248        // PRDT entries per command: table = 4 KiB
+#define AHCI_CT_SIZE  4096       // command table stride per slot (128-aligned)
+#define AHCI_PRD_MAX  (4u << 20) // bytes per PRDT entry (22-bit dbc)
+#define AHCI_MAX_SECTORS 65536   // per command; a 16-bit count of 0 means 65536
+#define AHCI_BOUNCE_MAX  (1u << 20)  // largest bounce buffer per command
+#define AHCI_RW_BATCH 8          // commands ahci_read/ahci_write keep in flight
+#define AHCI_SPIN     5000000    // polls before a command counts as timed out (no timer)
+#define AHCI_TIMEOUT_NS  5000000000ull
+
+// GHC.IE; PxIE: D2H register, PIO setup, DMA setup, set device bits,
+// descriptor processed, and the fatal errors
+#define GHC_IE        (1u<<1)
+#define P_IE_MASK     ((1u<<0) | (1u<<1) | (1u<<2) | (1u<<3) | (1u<<5) | P_IS_FATAL)
+
+// PxIS: the port stopped processing commands (TFES, HBFS, HBDS, IFS)
+#define P_IS_FATAL    ((1u<<30) | (1u<<29) | (1u<<28) | (1u<<27))
+
 typedef struct __attribute__((packed)) {
   // DW0
   uint8_t  cfl:5;
@@ -64,19 +99,68 @@ typedef struct __attribute__((packed)) {
   uint8_t  cfis[64];
   uint8_t  acmd[16];
   uint8_t  rsv[48];
-  HbaPrdt  prdt[1]; // we use 1 entry for now
+  HbaPrdt  prdt[AHCI_PRDT_MAX];
 } HbaCmdTbl;
 
+_Static_assert(sizeof(HbaCmdTbl) <= AHCI_CT_SIZE, "command table exceeds its slot");
+
 typedef struct {
-  void    *clb;    // command list (1 page)
+  void    *clb;    // command list (32 headers)
   void    *fb;     // FIS receive (1 page)
-  void    *ctba;   // command table (1 page)
+  uint8_t *ctba;   // command tables, AHCI_CT_SIZE per slot
+  DmaBuf   clb_dma, fb_dma, ctba_dma;
   int      inited;
+
+  uint8_t  ncq;        // READ/WRITE FPDMA QUEUED
+  uint32_t depth;      // slots in use: min(HBA slots, drive queue depth)
+  uint32_t busy;       // slots owned by a request
+  uint32_t issued;     // ... of which the HBA has been given (PxCI set)
+  uint32_t completed;  // ... of which a scan found done, not finished yet
+  uint8_t  fatal;      // a scan saw a fatal PxIS bit
+  AhciReq *req[AHCI_SLOTS];
+  AhciReq *fin_head, *fin_tail;   // slots released, not finished yet
+  uint64_t issue_ns[AHCI_SLOTS];
+  uint64_t done_ns[AHCI_SLOTS];
+  uint64_t sectors;
+
+  uint64_t commands, errors;
+  uint32_t max_inflight;
+  uint64_t irqs, halts;
+  uint64_t lat_sum_ns, lat_max_ns, lat_n;
 } AhciPortState;
 
 static AhciPortState g_ports[32];
 
 static uint64_t abar = 0;
+static volatile uint8_t *g_hba = 0;   // ABAR mapped UC
+
+// Highest physical address the HBA can reach (CAP.S64A clear => 32-bit only)
+static uint64_t g_dma_limit = DMA_ADDR_32BIT;
+
+static uint32_t g_hba_slots = 1;   // CAP.NCS + 1
+static int      g_hba_ncq   = 0;   // CAP.SNCQ
+
+// Completion interrupts: MSI if the controller and a local APIC allow it,
+// else the PCI interrupt line through the PIC, else none (polling only)
+enum { AHCI_IRQ_NONE, AHCI_IRQ_MSI, AHCI_IRQ_INTX };
+static int      g_irq_mode = AHCI_IRQ_NONE;
+static int      g_irq_num  = -1;   // MSI vector or PIC IRQ
+
+// The interrupt handler touches the port state too
+static inline uint64_t irq_lock(void){
+  uint64_t f = intr_save();
+  intr_disable();
+  return f;
+}
+
+static inline void irq_unlock(uint64_t f){
+  intr_restore(f);
+}
+
+static void ahci_irq_setup(uint8_t b, uint8_t d, uint8_t f);
+
+static inline void memclr(void *p, size_t n){ __builtin_memset(p, 0, n); }
+static inline void memcp(void *d, const void *s, size_t n){ __builtin_memcpy(d, s, n); }
 
 static uint64_t read_bar_mmio32(uint8_t b, uint8_t d, uint8_t f, int bar_index){
   uint16_t off = (uint16_t)(0x10 + bar_index * 4);
@@ -96,18 +180,18 @@ static const char* ahci_sig_name(uint32_t sig){
   }
 }
 
-static void ahci_dump_ports(uint64_t hba){
-  uint32_t pi = mmio_read32_phys(hba + AHCI_PI);
+static void ahci_dump_ports(volatile uint8_t *hba){
+  uint32_t pi = mmio_read32(hba + AHCI_PI);
 
   for (uint32_t p = 0; p < 32; p++){
     if (((pi >> p) & 1u) == 0) continue;
 
-    uint64_t pr = hba + AHCI_PORTS + (uint64_t)p * AHCI_PORT_SZ;
+    volatile uint8_t *pr = hba + AHCI_PORTS + (uint64_t)p * AHCI_PORT_SZ;
 
-    uint32_t ssts = mmio_read32_phys(pr + P_SSTS);
-    uint32_t sig  = mmio_read32_phys(pr + P_SIG);
-    uint32_t tfd  = mmio_read32_phys(pr + P_TFD);
-    uint32_t serr = mmio_read32_phys(pr + P_SERR);
+    uint32_t ssts = mmio_read32(pr + P_SSTS);
+    uint32_t sig  = mmio_read32(pr + P_SIG);
+    uint32_t tfd  = mmio_read32(pr + P_TFD);
+    uint32_t serr = mmio_read32(pr + P_SERR);
 
     uint32_t det = (ssts >> 0) & 0xF;
     uint32_t ipm = (ssts >> 8) & 0xF;
@@ -128,37 +212,210 @@ static void ahci_dump_ports(uint64_t hba){
   }
 }
 
-static void ahci_port_stop(uint64_t pr){
-  uint32_t cmd =  mmio_read32_phys(pr + P_CMD);
+static void ahci_port_stop(volatile uint8_t *pr){
+  uint32_t cmd =  mmio_read32(pr + P_CMD);
 
   // Clear ST (start) and FRE (FIS receive enable)
   cmd &= ~(1u<<0);   // ST
   cmd &= ~(1u<<4);   // FRE
-  mmio_write32_phys(pr + P_CMD, cmd);
+  mmio_write32(pr + P_CMD, cmd);
 
   // Wait until FR and CR clear
   for (int i=0; i<1000000; i++){
-    uint32_t c = mmio_read32_phys(pr + P_CMD);
+    uint32_t c = mmio_read32(pr + P_CMD);
     if (((c >> 14) & 1u) == 0 && ((c >> 15) & 1u) == 0) break; // FR, CR
   }
 }
 
-static void ahci_port_start(uint64_t pr){
-  uint32_t cmd =  mmio_read32_phys(pr + P_CMD);
+static void ahci_port_start(volatile uint8_t *pr){
+  uint32_t cmd =  mmio_read32(pr + P_CMD);
   cmd |= (1u<<4);  // FRE
   cmd |= (1u<<0);  // ST
-  mmio_write32_phys(pr + P_CMD, cmd);
+  mmio_write32(pr + P_CMD, cmd);
+}
+
+static uint32_t bit_count(uint32_t v){
+  uint32_t n = 0;
+  for (; v; v &= v - 1) n++;
+  return n;
+}
+
+static inline volatile uint8_t *port_regs(uint32_t port){
+  return g_hba + AHCI_PORTS + (uint64_t)port * AHCI_PORT_SZ;
+}
+
+static HbaCmdTbl *slot_table(AhciPortState *ps, uint32_t slot){
+  return (HbaCmdTbl*)(ps->ctba + (uint64_t)slot * AHCI_CT_SIZE);
+}
+
+// Host-to-device register FIS. Queued commands (tag >= 0) carry the sector
+// count in FEATURES and the tag in COUNT[7:3].
+static void build_fis(uint8_t *cfis, uint8_t cmd, uint64_t lba, uint32_t count, int tag){
+  cfis[0] = 0x27;  // FIS type: Reg H2D
+  cfis[1] = 1<<7;  // C=1 (command)
+  cfis[2] = cmd;
+
+  // LBA (48-bit)
+  cfis[4] = (uint8_t)(lba & 0xFF);
+  cfis[5] = (uint8_t)((lba >> 8) & 0xFF);
+  cfis[6] = (uint8_t)((lba >> 16) & 0xFF);
+  cfis[7] = 1<<6;  // device: LBA mode
+  cfis[8] = (uint8_t)((lba >> 24) & 0xFF);
+  cfis[9] = (uint8_t)((lba >> 32) & 0xFF);
+  cfis[10]= (uint8_t)((lba >> 40) & 0xFF);
+
+  if (tag >= 0) {
+    cfis[3]  = (uint8_t)(count & 0xFF);          // features low
+    cfis[11] = (uint8_t)((count >> 8) & 0xFF);   // features high
+    cfis[12] = (uint8_t)(tag << 3);
+    cfis[13] = 0;
+  } else {
+    cfis[3]  = 0;
+    cfis[11] = 0;
+    cfis[12] = (uint8_t)(count & 0xFF);
+    cfis[13] = (uint8_t)((count >> 8) & 0xFF);
+  }
+  cfis[14]= 0;
+  cfis[15]= 0;
+}
+
+static void prd_set(HbaPrdt *e, uint64_t phys, uint32_t bytes){
+  e->dba  = (uint32_t)(phys & 0xFFFFFFFF);
+  e->dbau = (uint32_t)(phys >> 32);
+  e->rsv0 = 0;
+  e->dbc  = bytes - 1;   // byte count minus 1
+  e->rsv1 = 0;
+  e->i    = 0;
+}
+
+static uint32_t prd_len(const HbaPrdt *e){ return (uint32_t)e->dbc + 1; }
+
+static uint64_t prd_end(const HbaPrdt *e){
+  return (((uint64_t)e->dbau << 32) | e->dba) + prd_len(e);
+}
+
+// Contiguous DMA memory: one entry per AHCI_PRD_MAX bytes
+static uint32_t prdt_contig(HbaCmdTbl *tbl, uint64_t phys, uint32_t bytes){
+  uint32_t n = 0;
+  for (uint32_t off = 0; off < bytes; off += AHCI_PRD_MAX)
+    prd_set(&tbl->prdt[n++], phys + off, (bytes - off < AHCI_PRD_MAX) ? bytes - off : AHCI_PRD_MAX);
+  return n;
+}
+
+// PRDT for up to `bytes` of rq->buf; returns the bytes covered (whole
+// sectors, 0 on failure) and the entry count in *nprd. Kernel buffers are
+// gathered page by page, physically adjacent pages sharing an entry, and a
+// buffer that needs more entries than a table has is cut short. App
+// buffers (demand paged, and their pages movable while the command runs),
+// odd addresses and pages beyond the HBA's reach bounce through DMA memory.
+static uint32_t prdt_build(HbaCmdTbl *tbl, AhciReq *rq, uint32_t bytes, uint32_t *nprd){
+  uint64_t va = (uint64_t)(uintptr_t)rq->buf;
+  int app = (va >= APP_SPACE_BASE && va < APP_SPACE_END);
+  uint32_t n = 0, done = 0;
+  rq->bounce = (DmaBuf){0};
+
+  if (!app && (va & 1u) == 0) {
+    while (done < bytes) {
+      uint32_t chunk = (uint32_t)(PAGE_SIZE - ((va + done) & (PAGE_SIZE - 1)));
+      if (chunk > bytes - done) chunk = bytes - done;
+      uint64_t phys = ptr_to_phys((const void*)(uintptr_t)(va + done));
+      if (phys + chunk - 1 > g_dma_limit) { done = 0; break; }
+
+      HbaPrdt *last = n ? &tbl->prdt[n - 1] : 0;
+      if (last && prd_end(last) == phys && prd_len(last) + chunk <= AHCI_PRD_MAX) {
+        last->dbc += chunk;
+      } else {
+        if (n == AHCI_PRDT_MAX) break;
+        prd_set(&tbl->prdt[n++], phys, chunk);
+      }
+      done += chunk;
+    }
+
+    // cut back to a whole sector
+    for (uint32_t cut = done % 512; cut; ) {
+      HbaPrdt *last = &tbl->prdt[n - 1];
+      uint32_t len = prd_len(last);
+      if (len > cut) { last->dbc -= cut; cut = 0; }
+      else { n--; cut -= len; }
+    }
+    done -= done % 512;
+    if (done) { *nprd = n; return done; }
+  }
+
+  if (bytes > AHCI_BOUNCE_MAX) bytes = AHCI_BOUNCE_MAX;
+  if (dma_alloc(bytes, 2, g_dma_limit, &rq->bounce) != 0) return 0;
+  if (rq->write) memcp(rq->bounce.virt, rq->buf, bytes);
+  *nprd = prdt_contig(tbl, rq->bounce.phys, bytes);
+  return bytes;
+}
+
+// Command header for `slot`, whose table already holds `nprd` PRDT entries
+static void slot_hdr(AhciPortState *ps, uint32_t slot, int write, uint32_t nprd){
+  HbaCmdHdr *cl = (HbaCmdHdr*)ps->clb;
+  cl[slot].cfl   = 5;       // 5 dwords = 20 bytes CFIS
+  cl[slot].w     = write ? 1 : 0;
+  cl[slot].prdtl = (uint16_t)nprd;
+  cl[slot].prdbc = 0;
+}
+
+// One non-queued command in slot 0, polled to completion. Only used while
+// nothing else is in flight on the port (bring-up, error recovery).
+static int port_exec_sync(uint32_t port, uint8_t cmd, uint64_t lba, uint32_t count,
+                          uint64_t phys, uint32_t bytes){
+  AhciPortState *ps = &g_ports[port];
+  volatile uint8_t *pr = port_regs(port);
+
+  HbaCmdTbl *tbl = slot_table(ps, 0);
+  memclr(tbl->cfis, sizeof(tbl->cfis));
+  build_fis(tbl->cfis, cmd, lba, count, -1);
+  slot_hdr(ps, 0, 0, prdt_contig(tbl, phys, bytes));
+
+  mmio_write32(pr + P_IS, 0xFFFFFFFF);
+  mmio_write32(pr + P_CI, 1u);
+
+  for (int i=0; i<AHCI_SPIN; i++){
+    if ((mmio_read32(pr + P_CI) & 1u) == 0) break;
+  }
+
+  uint32_t is = mmio_read32(pr + P_IS);
+  mmio_write32(pr + P_IS, is);
+  if (is & P_IS_FATAL) return -10;
+  if (mmio_read32(pr + P_CI) & 1u) return -11;
+  return 0;
+}
+
+// IDENTIFY DEVICE: capacity, and whether the drive queues commands
+static void port_identify(uint32_t port, uint32_t *qd){
+  AhciPortState *ps = &g_ports[port];
+  DmaBuf id;
+  *qd = 1;
+  if (dma_alloc(512, 2, g_dma_limit, &id) != 0) return;
+  memclr(id.virt, 512);
+
+  if (port_exec_sync(port, ATA_IDENTIFY, 0, 0, id.phys, 512) == 0) {
+    const uint16_t *w = (const uint16_t*)id.virt;
+    if (w[83] & (1u<<10))   // 48-bit LBA
+      ps->sectors = (uint64_t)w[100] | ((uint64_t)w[101] << 16) |
+                    ((uint64_t)w[102] << 32) | ((uint64_t)w[103] << 48);
+    else
+      ps->sectors = (uint64_t)w[60] | ((uint64_t)w[61] << 16);
+
+    if (g_hba_ncq && (w[76] & (1u<<8))) {   // SATA capabilities: NCQ
+      ps->ncq = 1;
+      *qd = (uint32_t)(w[75] & 0x1F) + 1;
+    }
+  }
+  dma_free(&id);
 }
 
 static int ahci_port_init(uint32_t port){
   if (!abar) return -1;
   if (port >= 32) return -2;
 
-  uint64_t hba = (uint64_t)(uintptr_t)iomap(abar, 0x2000, 0);
-  uint64_t pr  = hba + AHCI_PORTS + (uint64_t)port * AHCI_PORT_SZ;
+  volatile uint8_t *pr  = port_regs(port);
 
   // Only init if device present
-  uint32_t ssts = mmio_read32_phys(pr + P_SSTS);
+  uint32_t ssts = mmio_read32(pr + P_SSTS);
   uint32_t det = (ssts >> 0) & 0xF;
   uint32_t ipm = (ssts >> 8) & 0xF;
   if (!(det == 3 && ipm == 1)) return -3;
@@ -169,43 +426,56 @@ static int ahci_port_init(uint32_t port){
   // Stop port before programming
   ahci_port_stop(pr);
 
-  // Allocate pages for command list and FIS and command table
-  ps->clb  = pmm_alloc_page();
-  ps->fb   = pmm_alloc_page();
-  ps->ctba = pmm_alloc_page();
-  if (!ps->clb || !ps->fb || !ps->ctba) return -4;
-
-  // Zero them
-  for (int i=0;i<4096;i++) ((uint8_t*)ps->clb)[i]=0;
-  for (int i=0;i<4096;i++) ((uint8_t*)ps->fb)[i]=0;
-  for (int i=0;i<4096;i++) ((uint8_t*)ps->ctba)[i]=0;
-
-  // Program CLB/FB (physical = virtual for now)
-  uint64_t clb_phys = (uint64_t)(uintptr_t)ps->clb;
-  uint64_t fb_phys  = (uint64_t)(uintptr_t)ps->fb;
-
-  mmio_write32_phys(pr + 0x00, (uint32_t)(clb_phys & 0xFFFFFFFF)); // PxCLB
-  mmio_write32_phys(pr + 0x04, (uint32_t)(clb_phys >> 32));        // PxCLBU
-  mmio_write32_phys(pr + 0x08, (uint32_t)(fb_phys & 0xFFFFFFFF));  // PxFB
-  mmio_write32_phys(pr + 0x0C, (uint32_t)(fb_phys >> 32));         // PxFBU
-
-  // Setup command header slot 0 to point to our command table
+  // Command list (1K aligned), FIS receive area (256B) and a command table
+  // per slot (128B aligned), all below the HBA's address limit
+  if (dma_alloc(4096, 1024, g_dma_limit, &ps->clb_dma)  != 0 ||
+      dma_alloc(4096, 256,  g_dma_limit, &ps->fb_dma)   != 0 ||
+      dma_alloc(AHCI_SLOTS * AHCI_CT_SIZE, 128, g_dma_limit, &ps->ctba_dma) != 0) {
+    dma_free(&ps->clb_dma);
+    dma_free(&ps->fb_dma);
+    dma_free(&ps->ctba_dma);
+    return -4;
+  }
+  ps->clb  = ps->clb_dma.virt;
+  ps->fb   = ps->fb_dma.virt;
+  ps->ctba = (uint8_t*)ps->ctba_dma.virt;
+  memclr(ps->clb, 4096);
+  memclr(ps->fb, 4096);
+  memclr(ps->ctba, AHCI_SLOTS * AHCI_CT_SIZE);
+
+  uint64_t clb_phys = ps->clb_dma.phys;
+  uint64_t fb_phys  = ps->fb_dma.phys;
+
+  mmio_write32(pr + 0x00, (uint32_t)(clb_phys & 0xFFFFFFFF)); // PxCLB
+  mmio_write32(pr + 0x04, (uint32_t)(clb_phys >> 32));        // PxCLBU
+  mmio_write32(pr + 0x08, (uint32_t)(fb_phys & 0xFFFFFFFF));  // PxFB
+  mmio_write32(pr + 0x0C, (uint32_t)(fb_phys >> 32));         // PxFBU
+
+  // Every command header points at its slot's table for good
   HbaCmdHdr *cl = (HbaCmdHdr*)ps->clb;
-  uint64_t ct_phys = (uint64_t)(uintptr_t)ps->ctba;
-
-  cl[0].cfl   = 5;       // 5 dwords = 20 bytes CFIS
-  cl[0].w     = 0;       // read
-  cl[0].prdtl = 1;       // 1 PRDT entry
-  cl[0].ctba  = (uint32_t)(ct_phys & 0xFFFFFFFF);
-  cl[0].ctbau = (uint32_t)(ct_phys >> 32);
+  for (uint32_t s = 0; s < AHCI_SLOTS; s++){
+    uint64_t ct_phys = ps->ctba_dma.phys + (uint64_t)s * AHCI_CT_SIZE;
+    cl[s].ctba  = (uint32_t)(ct_phys & 0xFFFFFFFF);
+    cl[s].ctbau = (uint32_t)(ct_phys >> 32);
+  }
 
   // Clear errors
-  mmio_write32_phys(pr + P_SERR, 0xFFFFFFFF);
-  mmio_write32_phys(pr + P_IS,   0xFFFFFFFF);
+  mmio_write32(pr + P_SERR, 0xFFFFFFFF);
+  mmio_write32(pr + P_IS,   0xFFFFFFFF);
 
   // Start port
   ahci_port_start(pr);
 
+  uint32_t qd;
+  port_identify(port, &qd);
+  ps->depth = ps->ncq ? (qd < g_hba_slots ? qd : g_hba_slots) : 1;
+
+  kprintf("AHCI: port %u: %llu sectors, %s, queue depth %u\n", port,
+          (unsigned long long)ps->sectors, ps->ncq ? "NCQ" : "no NCQ", ps->depth);
+
+  mmio_write32(pr + P_IS, 0xFFFFFFFF);
+  if (g_irq_mode != AHCI_IRQ_NONE) mmio_write32(pr + P_IE, P_IE_MASK);
+
   ps->inited = 1;
   return 0;
 }
@@ -230,23 +500,44 @@ int ahci_probe_bdf(uint8_t b, uint8_t d, uint8_t f){
     return -2;
   }
 
-  abar = bar5;
-  uint64_t hba = (uint64_t)(uintptr_t)iomap(abar, 0x2000, 0);
+  volatile uint8_t *hba = (volatile uint8_t*)iomap(bar5, AHCI_ABAR_SIZE, IOMAP_UC);
+  if (!hba) return -3;
+  abar  = bar5;
+  g_hba = hba;
 
-  uint32_t cap  = mmio_read32_phys(hba + AHCI_CAP);
-  uint32_t ghc  = mmio_read32_phys(hba + AHCI_GHC);
-  uint32_t vs   = mmio_read32_phys(hba + AHCI_VS);
-  uint32_t cap2 = mmio_read32_phys(hba + AHCI_CAP2);
-  uint32_t pi   = mmio_read32_phys(hba + AHCI_PI);
+  uint32_t cap  = mmio_read32(hba + AHCI_CAP);
+  uint32_t ghc  = mmio_read32(hba + AHCI_GHC);
+  uint32_t vs   = mmio_read32(hba + AHCI_VS);
+  uint32_t cap2 = mmio_read32(hba + AHCI_CAP2);
+  uint32_t pi   = mmio_read32(hba + AHCI_PI);
+
+  // S64A (CAP bit31): HBA can address 64-bit memory
+  g_dma_limit = (cap & (1u<<31)) ? DMA_ADDR_ANY : DMA_ADDR_32BIT;
+
+  // NCS (CAP bits 12:8): command slots - 1; SNCQ (bit30): NCQ support
+  g_hba_slots = ((cap >> 8) & 0x1F) + 1;
+  g_hba_ncq   = (cap & (1u<<30)) != 0;
 
   // Enable AHCI mode if not enabled (AE = bit31)
   if ((ghc & (1u<<31)) == 0){
-    mmio_write32_phys(hba + AHCI_GHC, ghc | (1u<<31));
-    ghc = mmio_read32_phys(hba + AHCI_GHC);
+    mmio_write32(hba + AHCI_GHC, ghc | (1u<<31));
+    ghc = mmio_read32(hba + AHCI_GHC);
+  }
+
+  uint16_t pcmd = pci_read16(b,d,f,0x04);
+  if (!(pcmd & PCI_CMD_BUS_MASTER)) pci_write16(b,d,f,0x04, (uint16_t)(pcmd | PCI_CMD_BUS_MASTER));
+
+  ahci_irq_setup(b,d,f);
+  if (g_irq_mode != AHCI_IRQ_NONE){
+    mmio_write32(hba + AHCI_IS, 0xFFFFFFFF);
+    mmio_write32(hba + AHCI_GHC, ghc | GHC_IE);
+    ghc = mmio_read32(hba + AHCI_GHC);
   }
 
   kprintf("AHCI: bdf=%u:%u.%u ABAR=%p\n", b,d,f, phys_to_cptr(abar));
   kprintf("AHCI: CAP=0x%x CAP2=0x%x GHC=0x%x VS=0x%x PI=0x%x\n", cap, cap2, ghc, vs, pi);
+  kprintf("AHCI: %s DMA addressing, %u command slots%s\n",
+          (cap & (1u<<31)) ? "64-bit" : "32-bit", g_hba_slots, g_hba_ncq ? ", NCQ" : "");
 
   ahci_dump_ports(hba);
   return 0;
@@ -287,164 +578,389 @@ int ahci_probe(void){
   return -2;
 }
 
-int ahci_read(uint32_t port, uint64_t lba, uint32_t count, void *buf){
-  if (!buf || count == 0) return -1;
-  
+
+// ---- Command queue ----
+// A slot is `busy` from ahci_submit until its request is finished, and
+// `issued` once its PxCI bit has been set. A command is complete when its
+// bits in PxCI and (for NCQ) PxSACT have both cleared; only issued slots
+// are looked at, so a slot still being set up can't look finished.
+
+static int port_ready(uint32_t port){
+  if (port >= 32) return -2;
+
   // Auto-probe controller on first use
   if (!abar) {
     int prc = ahci_probe();
     if (prc != 0 || !abar) return -2;
   }
+  return ahci_port_init(port);
+}
 
-  int rc = ahci_port_init(port);
-  if (rc != 0) return rc;
+// Give the slot back and queue its request for port_drain. Interrupts are
+// off: the slot masks are shared with the interrupt handler.
+static void slot_release(AhciPortState *ps, uint32_t slot, int status){
+  AhciReq *rq = ps->req[slot];
+  ps->req[slot] = 0;
+  ps->busy      &= ~(1u << slot);
+  ps->issued    &= ~(1u << slot);
+  ps->completed &= ~(1u << slot);
+  if (!rq) return;
+
+  if (status == 0 && ps->done_ns[slot] > ps->issue_ns[slot] && ps->issue_ns[slot]) {
+    uint64_t lat = ps->done_ns[slot] - ps->issue_ns[slot];
+    ps->lat_sum_ns += lat;
+    ps->lat_n++;
+    if (lat > ps->lat_max_ns) ps->lat_max_ns = lat;
+  }
+  ps->commands++;
+  if (status != 0) ps->errors++;
+
+  rq->result = status;
+  rq->next   = 0;
+  if (ps->fin_tail) ps->fin_tail->next = rq;
+  else              ps->fin_head = rq;
+  ps->fin_tail = rq;
+}
 
-  uint64_t hba = (uint64_t)(uintptr_t)iomap(abar, 0x2000, 0);
-  uint64_t pr  = hba + AHCI_PORTS + (uint64_t)port * AHCI_PORT_SZ;
+// Finish the released requests: bounce copy-back, dma_free, status and the
+// callback, none of which may run with interrupts off. A callback may
+// submit or poll again; each request is taken off the queue under the lock
+// before it is touched, so a nested drain never sees it twice.
+static uint32_t port_drain(AhciPortState *ps){
+  uint32_t n = 0;
+  for (;;){
+    uint64_t f = irq_lock();
+    AhciReq *rq = ps->fin_head;
+    if (rq) {
+      ps->fin_head = rq->next;
+      if (!ps->fin_head) ps->fin_tail = 0;
+    }
+    irq_unlock(f);
+    if (!rq) return n;
 
+    if (rq->bounce.virt) {
+      if (rq->result == 0 && !rq->write) memcp(rq->buf, rq->bounce.virt, (size_t)rq->count * 512);
+      dma_free(&rq->bounce);
+    }
+    rq->status = rq->result;
+    if (rq->done) rq->done(rq);
+    n++;
+  }
+}
+
+// The port stopped on an error (or a command timed out). Restart it, which
+// drops every outstanding command. Interrupts are off; the caller drains. After an NCQ error the drive also
+// wants its NCQ error log read before it takes queued commands again; the
+// log names the tag that failed, the rest were only caught up in it.
+static void port_recover(uint32_t port, int status){
   AhciPortState *ps = &g_ports[port];
-  HbaCmdHdr *cl = (HbaCmdHdr*)ps->clb;
-  HbaCmdTbl *tbl = (HbaCmdTbl*)ps->ctba;
+  volatile uint8_t *pr = port_regs(port);
+  int bad_tag = -1;
 
-  // Wait while busy
-  for (int i=0; i<1000000; i++){
-    uint32_t tfd = mmio_read32_phys(pr + P_TFD);
-    if ((tfd & (1u<<7)) == 0 && (tfd & (1u<<3)) == 0) break; // BSY=7, DRQ=3
+  kprintf("AHCI: port %u: recovering, IS=0x%x TFD=0x%x SERR=0x%x CI=0x%x SACT=0x%x\n",
+          port, mmio_read32(pr + P_IS), mmio_read32(pr + P_TFD), mmio_read32(pr + P_SERR),
+          mmio_read32(pr + P_CI), mmio_read32(pr + P_SACT));
+
+  ahci_port_stop(pr);
+  mmio_write32(pr + P_SERR, 0xFFFFFFFF);
+  mmio_write32(pr + P_IS,   0xFFFFFFFF);
+  ahci_port_start(pr);
+
+  if (ps->ncq && status == -10) {
+    DmaBuf log;
+    if (dma_alloc(512, 2, g_dma_limit, &log) == 0) {
+      // log 10h, page 0: byte 0 = NQ<<7 | tag
+      if (port_exec_sync(port, ATA_READ_LOG_EXT, 0x10, 1, log.phys, 512) == 0) {
+        uint8_t b0 = ((const uint8_t*)log.virt)[0];
+        if (!(b0 & 0x80)) bad_tag = b0 & 0x1F;
+      }
+      dma_free(&log);
+    }
   }
 
-  // Clear command table
-  for (size_t i = 0; i < sizeof(HbaCmdTbl); i++) {
-    ((uint8_t*)tbl)[i] = 0;
+  ps->fatal = 0;
+  uint32_t busy = ps->issued;
+  for (uint32_t s = 0; s < AHCI_SLOTS; s++){
+    if (!(busy & (1u << s))) continue;
+    int st = status;
+    if (bad_tag >= 0 && (int)s != bad_tag) st = -12;
+    slot_release(ps, s, st);
   }
+}
 
-  // Setup PRDT: one buffer chunk
-  uint64_t buf_phys = (uint64_t)(uintptr_t)buf;
-  tbl->prdt[0].dba  = (uint32_t)(buf_phys & 0xFFFFFFFF);
-  tbl->prdt[0].dbau = (uint32_t)(buf_phys >> 32);
-  tbl->prdt[0].dbc  = (count * 512) - 1;   // byte count minus 1
-  tbl->prdt[0].i    = 0;
+int ahci_submit(uint32_t port, AhciReq *rq){
+  if (!rq || !rq->buf || rq->count == 0) return -1;
 
-  // Build CFIS (Host to Device Register FIS)
-  uint8_t *cfis = tbl->cfis;
-  cfis[0] = 0x27;  // FIS type: Reg H2D
-  cfis[1] = 1<<7;  // C=1 (command)
-  cfis[2] = 0x25;  // ATA READ DMA EXT
-  cfis[3] = 0;     // features low
+  int rc = port_ready(port);
+  if (rc != 0) return rc;
 
-  // LBA (48-bit)
-  cfis[4] = (uint8_t)(lba & 0xFF);
-  cfis[5] = (uint8_t)((lba >> 8) & 0xFF);
-  cfis[6] = (uint8_t)((lba >> 16) & 0xFF);
-  cfis[7] = 1<<6;  // device: LBA mode
-  cfis[8] = (uint8_t)((lba >> 24) & 0xFF);
-  cfis[9] = (uint8_t)((lba >> 32) & 0xFF);
-  cfis[10]= (uint8_t)((lba >> 40) & 0xFF);
-  cfis[11]= 0;     // features high
+  AhciPortState *ps = &g_ports[port];
+  volatile uint8_t *pr = port_regs(port);
+  uint32_t all = (ps->depth >= 32) ? 0xFFFFFFFFu : ((1u << ps->depth) - 1);
+
+  // Claim a slot
+  uint64_t f = irq_lock();
+  uint32_t free_slots = all & ~ps->busy;
+  if (!free_slots) { irq_unlock(f); return -6; }
+  uint32_t slot = (uint32_t)__builtin_ctz(free_slots);
+  ps->busy |= 1u << slot;
+  irq_unlock(f);
+
+  // Large or fragmented buffers: the command takes what fits
+  HbaCmdTbl *tbl = slot_table(ps, slot);
+  uint32_t count = (rq->count < AHCI_MAX_SECTORS) ? rq->count : AHCI_MAX_SECTORS;
+  uint32_t nprd = 0;
+  uint32_t bytes = prdt_build(tbl, rq, count * 512, &nprd);
+  if (!bytes) {
+    f = irq_lock();
+    ps->busy &= ~(1u << slot);
+    irq_unlock(f);
+    return -5;
+  }
+  rq->count = bytes / 512;
+
+  memclr(tbl->cfis, sizeof(tbl->cfis));
+  slot_hdr(ps, slot, rq->write, nprd);
+  if (ps->ncq)
+    build_fis(tbl->cfis, rq->write ? ATA_WRITE_FPDMA : ATA_READ_FPDMA,
+              rq->lba, rq->count, (int)slot);
+  else
+    build_fis(tbl->cfis, rq->write ? ATA_WRITE_DMA_EXT : ATA_READ_DMA_EXT,
+              rq->lba, rq->count, -1);
+
+  rq->slot   = slot;
+  rq->status = AHCI_REQ_PENDING;
+
+  f = irq_lock();
+  ps->req[slot] = rq;
+  ps->issue_ns[slot] = time_now_ns();
+  ps->done_ns[slot]  = 0;
+  if (ps->ncq) mmio_write32(pr + P_SACT, 1u << slot);
+  mmio_write32(pr + P_CI, 1u << slot);
+  ps->issued |= 1u << slot;
+  uint32_t n = bit_count(ps->issued);
+  if (n > ps->max_inflight) ps->max_inflight = n;
+  irq_unlock(f);
+  return 0;
+}
 
-  // sector count (16-bit)
-  cfis[12]= (uint8_t)(count & 0xFF);
-  cfis[13]= (uint8_t)((count >> 8) & 0xFF);
-  cfis[14]= 0;
-  cfis[15]= 0;
+// Read and acknowledge PxIS and note which issued commands have finished.
+// Runs in the interrupt handler, and from ahci_poll; interrupts are off.
+static void port_scan(uint32_t port){
+  AhciPortState *ps = &g_ports[port];
+  volatile uint8_t *pr = port_regs(port);
 
-  // Ensure header is read, PRDTL is 1, read op
-  cl[0].w = 0;
-  cl[0].prdtl = 1;
+  uint32_t is = mmio_read32(pr + P_IS);
+  if (is) mmio_write32(pr + P_IS, is);
+  if (is & P_IS_FATAL) ps->fatal = 1;
+  if (!ps->issued) return;
 
-  // Clear interrupts + errors
-  mmio_write32_phys(pr + P_IS, 0xFFFFFFFF);
-  mmio_write32_phys(pr + P_SERR, 0xFFFFFFFF);
+  uint32_t active = mmio_read32(pr + P_CI);
+  if (ps->ncq) active |= mmio_read32(pr + P_SACT);
+  uint32_t done = ps->issued & ~active & ~ps->completed;
+  if (!done) return;
 
-  // Issue command in slot 0 by setting PxCI bit0
-  mmio_write32_phys(pr + P_CI, 1u);
+  uint64_t now = time_now_ns();
+  ps->completed |= done;
+  for (uint32_t d = done; d; d &= d - 1) ps->done_ns[__builtin_ctz(d)] = now;
+}
 
-  // Poll for completion
-  for (int i=0; i<5000000; i++){
-    uint32_t ci = mmio_read32_phys(pr + P_CI);
-    if ((ci & 1u) == 0) break;
+static void ahci_irq(int irq, void *ctx){
+  (void)irq; (void)ctx;
+  if (!g_hba) return;
+
+  uint32_t is = mmio_read32(g_hba + AHCI_IS);
+  if (!is) return;   // INTx may be shared
+
+  for (uint32_t d = is; d; d &= d - 1){
+    uint32_t port = (uint32_t)__builtin_ctz(d);
+    if (g_ports[port].inited) {
+      g_ports[port].irqs++;
+      port_scan(port);
+    } else {
+      volatile uint8_t *pr = port_regs(port);
+      mmio_write32(pr + P_IS, mmio_read32(pr + P_IS));
+    }
   }
+  mmio_write32(g_hba + AHCI_IS, is);   // after the PxIS bits behind it
+}
 
-  // Check errors
-  uint32_t is = mmio_read32_phys(pr + P_IS);
-  uint32_t tfd = mmio_read32_phys(pr + P_TFD);
-  if (is & (1u<<30)) { // TFES
-    kprintf("AHCI: read error TFES, IS=0x%x TFD=0x%x\n", is, tfd);
-    return -10;
+// MSI when there is a local APIC to send it to, else INTx
+static void ahci_irq_setup(uint8_t b, uint8_t d, uint8_t f){
+  if (g_irq_mode != AHCI_IRQ_NONE) return;
+
+  if (lapic_ready() && pci_find_cap(b, d, f, PCI_CAP_MSI)) {
+    int vec = intr_alloc_msi(ahci_irq, 0);
+    if (vec >= 0 && pci_msi_enable(b, d, f, (uint8_t)vec, (uint8_t)lapic_id()) == 0) {
+      g_irq_mode = AHCI_IRQ_MSI;
+      g_irq_num  = vec;
+    }
   }
 
-  return 0;
+  if (g_irq_mode == AHCI_IRQ_NONE) {
+    uint8_t line = pci_read8(b, d, f, 0x3C);
+    // 0-2 are the timer, keyboard and cascade
+    if (line > 2 && line < IRQ_LEGACY_COUNT && irq_register(line, ahci_irq, 0) == 0) {
+      uint16_t cmd = pci_read16(b, d, f, 0x04);
+      pci_write16(b, d, f, 0x04, (uint16_t)(cmd & ~PCI_CMD_INTX_DISABLE));
+      pic_set_mask(line, 0);
+      g_irq_mode = AHCI_IRQ_INTX;
+      g_irq_num  = line;
+    }
+  }
+
+  if (g_irq_mode == AHCI_IRQ_MSI)
+    kprintf("AHCI: completions by MSI, vector 0x%x\n", (uint32_t)g_irq_num);
+  else if (g_irq_mode == AHCI_IRQ_INTX)
+    kprintf("AHCI: completions by INTx, IRQ %u\n", (uint32_t)g_irq_num);
+  else
+    kprintf("AHCI: no interrupt available, polling\n");
 }
 
-int ahci_write(uint32_t port, uint64_t lba, uint32_t count, const void *buf){
-  if (!buf || count == 0) return -1;
+uint32_t ahci_poll(uint32_t port){
+  if (port >= 32 || !g_ports[port].inited) return 0;
 
-  if (!abar) {
-    int prc = ahci_probe();
-    if (prc != 0 || !abar) return -2;
+  AhciPortState *ps = &g_ports[port];
+
+  uint64_t f = irq_lock();
+  port_scan(port);
+  if (ps->fatal) {
+    port_recover(port, -10);
+  } else {
+    for (uint32_t done = ps->completed; done; done &= done - 1)
+      slot_release(ps, (uint32_t)__builtin_ctz(done), 0);
   }
+  irq_unlock(f);
+  return port_drain(ps);
+}
 
-  int rc = ahci_port_init(port);
-  if (rc != 0) return rc;
+// Nothing to finish on the port: sleep until the next interrupt (the
+// AHCI one, or at worst the 1 kHz timer). Only when AHCI interrupts are
+// wired up and the caller runs with interrupts on; else return at once and
+// the caller polls. Checking with interrupts off and then STI;HLT closes
+// the window in which the completion could slip by.
+static void idle_wait(uint32_t port){
+  if (g_irq_mode == AHCI_IRQ_NONE) return;
 
-  uint64_t hba = (uint64_t)(uintptr_t)iomap(abar, 0x2000, 0);
-  uint64_t pr  = hba + AHCI_PORTS + (uint64_t)port * AHCI_PORT_SZ;
+  uint64_t f = intr_save();
+  if (!(f & (1u<<9))) return;   // IF clear
 
+  intr_disable();
   AhciPortState *ps = &g_ports[port];
-  HbaCmdHdr *cl = (HbaCmdHdr*)ps->clb;
-  HbaCmdTbl *tbl = (HbaCmdTbl*)ps->ctba;
+  if (!ps->completed && !ps->fatal && !ps->fin_head) {
+    ps->halts++;
+    __asm__ volatile ("sti; hlt" ::: "memory");
+  }
+  intr_restore(f);
+}
 
-  for (int i=0; i<1000000; i++){
-    uint32_t tfd = mmio_read32_phys(pr + P_TFD);
-    if ((tfd & (1u<<7)) == 0 && (tfd & (1u<<3)) == 0) break;
-  }
-
-  for (size_t i = 0; i < sizeof(HbaCmdTbl); i++) ((uint8_t*)tbl)[i] = 0;
-
-  uint64_t buf_phys = (uint64_t)(uintptr_t)buf;
-  tbl->prdt[0].dba  = (uint32_t)(buf_phys & 0xFFFFFFFF);
-  tbl->prdt[0].dbau = (uint32_t)(buf_phys >> 32);
-  tbl->prdt[0].dbc  = (count * 512) - 1;
-  tbl->prdt[0].i    = 0;
-
-  uint8_t *cfis = tbl->cfis;
-  cfis[0] = 0x27;
-  cfis[1] = 1<<7;
-  cfis[2] = 0x35;   // ATA WRITE DMA EXT
-  cfis[3] = 0;
-
-  cfis[4]  = (uint8_t)(lba & 0xFF);
-  cfis[5]  = (uint8_t)((lba >> 8) & 0xFF);
-  cfis[6]  = (uint8_t)((lba >> 16) & 0xFF);
-  cfis[7]  = 1<<6;
-  cfis[8]  = (uint8_t)((lba >> 24) & 0xFF);
-  cfis[9]  = (uint8_t)((lba >> 32) & 0xFF);
-  cfis[10] = (uint8_t)((lba >> 40) & 0xFF);
-  cfis[11] = 0;
-
-  cfis[12]= (uint8_t)(count & 0xFF);
-  cfis[13]= (uint8_t)((count >> 8) & 0xFF);
-  cfis[14]= 0;
-  cfis[15]= 0;
+int ahci_wait(uint32_t port, AhciReq *rq){
+  if (!rq) return -1;
+
+  uint64_t t0 = time_now_ns();
+  for (uint64_t i = 0; rq->status == AHCI_REQ_PENDING; i++){
+    if (ahci_poll(port) || rq->status != AHCI_REQ_PENDING) continue;
+    if (t0 ? (time_now_ns() - t0 > AHCI_TIMEOUT_NS) : (i > AHCI_SPIN)) break;
+    idle_wait(port);
+  }
 
-  cl[0].w = 1;      // WRITE
-  cl[0].prdtl = 1;
+  if (rq->status == AHCI_REQ_PENDING) {
+    kprintf("AHCI: port %u: command timed out (lba=%llu count=%u)\n", port,
+            (unsigned long long)rq->lba, rq->count);
+    uint64_t f = irq_lock();
+    port_recover(port, -11);
+    irq_unlock(f);
+    port_drain(&g_ports[port]);
+  }
+  return rq->status;
+}
 
-  mmio_write32_phys(pr + P_IS,   0xFFFFFFFF);
-  mmio_write32_phys(pr + P_SERR, 0xFFFFFFFF);
+static int submit_spin(uint32_t port, AhciReq *rq){
+  int rc = ahci_submit(port, rq);
+  for (int i=0; i<AHCI_SPIN && rc == -6; i++){
+    if (!ahci_poll(port)) idle_wait(port);
+    rc = ahci_submit(port, rq);
+  }
+  return rc;
+}
 
-  mmio_write32_phys(pr + P_CI, 1u);
+// Wait for rq, resubmitting it while it only failed because another
+// queued command did
+static int finish_cmd(uint32_t port, AhciReq *rq){
+  int rc = ahci_wait(port, rq);
+  for (int tries = 0; rc == -12 && tries < 3; tries++){
+    rc = submit_spin(port, rq);
+    if (rc == 0) rc = ahci_wait(port, rq);
+  }
+  return rc;
+}
+
+// Synchronous transfer of any size: as many commands as the buffer needs,
+// up to AHCI_RW_BATCH of them in flight at once.
+static int ahci_rw(uint32_t port, uint64_t lba, uint32_t count, void *buf, int write){
+  if (!buf || count == 0) return -1;
+
+  AhciReq rq[AHCI_RW_BATCH];
+  memclr(rq, sizeof(rq));
+  uint8_t *p = (uint8_t*)buf;
+  uint64_t first = lba;
+  uint32_t total = count;
+  int rc = 0;
+
+  for (uint32_t i = 0; count && rc == 0; i = (i + 1) % AHCI_RW_BATCH){
+    AhciReq *r = &rq[i];
+    if (r->status == AHCI_REQ_PENDING) rc = finish_cmd(port, r);
+    if (rc != 0) break;
+
+    *r = (AhciReq){ .lba = lba, .count = count, .buf = p, .write = (uint8_t)write };
+    rc = submit_spin(port, r);
+    if (rc != 0) break;
+
+    // r->count is what the command took
+    lba   += r->count;
+    p     += (size_t)r->count * 512;
+    count -= r->count;
+  }
 
-  for (int i=0; i<5000000; i++){
-    uint32_t ci = mmio_read32_phys(pr + P_CI);
-    if ((ci & 1u) == 0) break;
+  for (uint32_t i = 0; i < AHCI_RW_BATCH; i++){
+    if (rq[i].status != AHCI_REQ_PENDING) continue;
+    int st = finish_cmd(port, &rq[i]);
+    if (st != 0 && rc == 0) rc = st;
   }
 
-  uint32_t is  = mmio_read32_phys(pr + P_IS);
-  uint32_t tfd = mmio_read32_phys(pr + P_TFD);
-  if (is & (1u<<30)) {
-    kprintf("AHCI: write error TFES, IS=0x%x TFD=0x%x\n", is, tfd);
-    return -10;
-  } 
+  if (rc == -10)
+    kprintf("AHCI: %s error, port %u lba=%llu count=%u\n", write ? "write" : "read",
+            port, (unsigned long long)first, total);
+  return rc;
+}
+
+int ahci_read(uint32_t port, uint64_t lba, uint32_t count, void *buf){
+  return ahci_rw(port, lba, count, buf, 0);
+}
 
+int ahci_write(uint32_t port, uint64_t lba, uint32_t count, const void *buf){
+  return ahci_rw(port, lba, count, (void*)buf, 1);
+}
+
+int ahci_port_info(uint32_t port, AhciPortInfo *out){
+  if (!out) return -1;
+  int rc = port_ready(port);
+  if (rc != 0) return rc;
+
+  AhciPortState *ps = &g_ports[port];
+  *out = (AhciPortInfo){
+    .ncq          = ps->ncq,
+    .depth        = ps->depth,
+    .sectors      = ps->sectors,
+    .commands     = ps->commands,
+    .errors       = ps->errors,
+    .max_inflight = ps->max_inflight,
+    .irq          = (g_irq_mode == AHCI_IRQ_MSI)  ? "msi" :
+                    (g_irq_mode == AHCI_IRQ_INTX) ? "intx" : "polled",
+    .irqs         = ps->irqs,
+    .halts        = ps->halts,
+    .lat_avg_ns   = ps->lat_n ? ps->lat_sum_ns / ps->lat_n : 0,
+    .lat_max_ns   = ps->lat_max_ns,
+  };
   return 0;
-}
\ No newline at end of file
+}
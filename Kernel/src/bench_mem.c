@@ -0,0 +1,256 @@
+// Kernel/src/bench_mem.c
+#include <stdint.h>
+#include <stddef.h>
+
+#include <carlos/bench.h>
+
+/*
+  Each result runs one operation in a loop, doubling the count until the
+  loop takes at least min_ns, and reports the last loop: time per call and
+  bytes per nanosecond (= GB/s). Calls go through the ops table on both the
+  kernel and the glibc side, so the call overhead is the same for both.
+  Nothing here may use the functions being measured except through ops.
+  Results are integer fixed point, so nothing needs the FPU or a %f.
+
+  Buffers: dst at buf, src at buf + BENCH_MEM_MAX + 2048. "misaligned" puts
+  dst at +1 and src at +3, so the two are also off from each other. src
+  holds a path-like string ("/ab/./cd/../..."), NUL at n-1, and dst a copy
+  of it, which suits every test: memcmp and kstreq see equal data and scan
+  all of it, and the path functions have components to chew on.
+*/
+
+#define BENCH_MIN_NS   2000000ull   // 2 ms
+#define BENCH_SRC_OFF  (BENCH_MEM_MAX + 2048)
+#define BENCH_RESET    257          // path_normalize_abs writes <= 256 bytes
+
+typedef struct {
+  const BenchMemOps *ops;
+  uint8_t *dst;
+  uint8_t *src;
+  size_t   n;
+} Run;
+
+typedef void (*BenchFn)(Run *r);
+
+static volatile uint64_t g_sink;
+
+static const size_t g_sizes[] = {
+  8, 64, 512, 4u << 10, 32u << 10, 256u << 10, 2u << 20, BENCH_MEM_MAX,
+};
+
+// ---- the operations ----
+
+static void op_memcpy(Run *r)  { r->ops->cpy(r->dst, r->src, r->n); }
+static void op_memset(Run *r)  { r->ops->set(r->dst, 0x5a, r->n); }
+static void op_memmove(Run *r) { r->ops->move(r->dst + 32, r->dst, r->n); }   // overlapping, backward
+static void op_memcmp(Run *r)  { g_sink += (uint64_t)r->ops->cmp(r->dst, r->src, r->n); }
+static void op_strlen(Run *r)  { g_sink += r->ops->slen((const char*)r->src); }
+static void op_streq(Run *r)   { g_sink += (uint64_t)r->ops->seq((const char*)r->src, (const char*)r->dst); }
+static void op_norm83(Run *r)  { r->ops->norm83((const char*)r->src, (char*)r->dst, r->n); }
+
+// path_normalize_abs works in place and shortens the path, so every call
+// first puts back the part it overwrote; op_reset alone is timed as well
+// and taken off.
+static void op_reset(Run *r)
+{
+  r->ops->cpy(r->dst, r->src, r->n < BENCH_RESET ? r->n : BENCH_RESET);
+}
+
+static void op_norm_abs(Run *r)
+{
+  op_reset(r);
+  r->ops->norm_abs((char*)r->dst, r->n);
+}
+
+typedef struct {
+  const char *name;
+  BenchFn     fn;
+  BenchFn     overhead;   // timed separately and subtracted, may be 0
+} BenchOp;
+
+static const BenchOp g_ops[] = {
+  { "memcpy",             op_memcpy,   0 },
+  { "memset",             op_memset,   0 },
+  { "memmove",            op_memmove,  0 },
+  { "memcmp",             op_memcmp,   0 },
+  { "kstrlen",            op_strlen,   0 },
+  { "kstreq",             op_streq,    0 },
+  { "path_normalize_abs", op_norm_abs, op_reset },
+  { "path_norm83",        op_norm83,   0 },
+};
+
+// ---- output: fixed point into a line buffer, columns padded by hand ----
+
+typedef struct {
+  char     s[128];
+  unsigned n;
+} Line;
+
+static void put_c(Line *l, char c)
+{
+  if (l->n + 1 < sizeof(l->s)) l->s[l->n++] = c;
+  l->s[l->n] = 0;
+}
+
+static void put_s(Line *l, const char *s)
+{
+  while (*s) put_c(l, *s++);
+}
+
+static void put_u(Line *l, uint64_t v)
+{
+  char t[24];
+  int i = 0;
+  do { t[i++] = (char)('0' + v % 10); v /= 10; } while (v);
+  while (i) put_c(l, t[--i]);
+}
+
+// v / 10^dec with dec digits after the point
+static void put_fix(Line *l, uint64_t v, unsigned dec)
+{
+  uint64_t div = 1;
+  for (unsigned i = 0; i < dec; i++) div *= 10;
+  put_u(l, v / div);
+  put_c(l, '.');
+  uint64_t frac = v % div;
+  for (uint64_t d = div / 10; d; d /= 10) { put_c(l, (char)('0' + frac / d)); frac %= d; }
+}
+
+// right-align what was written since `from` in a field of `width`
+static void pad_left(Line *l, unsigned from, unsigned width)
+{
+  unsigned len = l->n - from;
+  if (len >= width || from + width + 1 > sizeof(l->s)) return;
+  unsigned sh = width - len;
+  for (unsigned i = l->n; i-- > from; ) l->s[i + sh] = l->s[i];
+  for (unsigned i = 0; i < sh; i++) l->s[from + i] = ' ';
+  l->n += sh;
+  l->s[l->n] = 0;
+}
+
+static void pad_right(Line *l, unsigned col)
+{
+  while (l->n < col) put_c(l, ' ');
+}
+
+static void put_size(Line *l, size_t n)
+{
+  if (n >= (1u << 20))      { put_u(l, n >> 20); put_c(l, 'M'); }
+  else if (n >= (1u << 10)) { put_u(l, n >> 10); put_c(l, 'K'); }
+  else                      { put_u(l, n);       put_c(l, 'B'); }
+}
+
+// ---- timing ----
+
+static uint64_t time_loop(const BenchEnv *env, Run *r, BenchFn fn, uint64_t iters)
+{
+  uint64_t t0 = env->now_ns();
+  for (uint64_t i = 0; i < iters; i++) fn(r);
+  return env->now_ns() - t0;
+}
+
+// ns for `iters` calls, iters grown until the loop takes min_ns
+static uint64_t measure(const BenchEnv *env, Run *r, BenchFn fn, uint64_t *iters)
+{
+  uint64_t min = env->min_ns ? env->min_ns : BENCH_MIN_NS;
+  uint64_t it = 1, dt;
+
+  fn(r);   // warm up caches and TLB
+  for (;;) {
+    dt = time_loop(env, r, fn, it);
+    if (dt >= min || it >= (1ull << 32)) break;
+    it *= (dt < min / 16) ? 8 : 2;
+  }
+  *iters = it;
+  return dt;
+}
+
+// src = "/ab/./cd/../ab/./cd/../..." NUL-terminated at n-1, dst = same
+static void fill(Run *r)
+{
+  static const char pat[] = "/ab/./cd/../";
+  size_t plen = sizeof(pat) - 1;
+  for (size_t i = 0; i + 1 < r->n; i++) r->src[i] = (uint8_t)pat[i % plen];
+  r->src[r->n - 1] = 0;
+  for (size_t i = 0; i < r->n; i++) r->dst[i] = r->src[i];
+}
+
+static void run_one(const BenchEnv *env, Line *l, Run *r, const BenchOp *op)
+{
+  uint64_t iters, ns, oh_iters, oh_ns;
+
+  fill(r);
+  ns = measure(env, r, op->fn, &iters);
+  if (op->overhead) {
+    oh_ns = measure(env, r, op->overhead, &oh_iters);
+    uint64_t per = oh_ns * iters / oh_iters;
+    ns = (ns > per) ? ns - per : 1;
+  }
+  if (!ns) ns = 1;
+
+  unsigned at = l->n;
+  put_fix(l, ns * 10 / iters, 1);                 // ns/op
+  pad_left(l, at, 12);
+  at = l->n;
+  put_fix(l, (uint64_t)r->n * iters * 100 / ns, 2);   // bytes/ns = GB/s
+  pad_left(l, at, 9);
+}
+
+void bench_mem_run(const BenchEnv *env, const BenchMemOps *ops)
+{
+  Line l = {0};
+  uint64_t min = env->min_ns ? env->min_ns : BENCH_MIN_NS;
+
+  put_s(&l, "bench mem: ");
+  put_s(&l, ops->name);
+  put_s(&l, ", loops of >= ");
+  put_u(&l, min / 1000000);
+  put_s(&l, " ms\n");
+  env->out(l.s);
+
+  l = (Line){0};
+  pad_right(&l, 24);
+  put_s(&l, "   ----- aligned -----   ---- misaligned ----\n");
+  env->out(l.s);
+  l = (Line){0};
+  put_s(&l, "primitive");
+  pad_right(&l, 20);
+  put_s(&l, "size");
+  for (unsigned mis = 0; mis < 2; mis++) {
+    unsigned at = l.n;
+    put_s(&l, "ns/op");
+    pad_left(&l, at, 12);
+    at = l.n;
+    put_s(&l, "GB/s");
+    pad_left(&l, at, 9);
+  }
+  put_c(&l, '\n');
+  env->out(l.s);
+
+  for (unsigned o = 0; o < sizeof(g_ops) / sizeof(g_ops[0]); o++) {
+    const BenchOp *op = &g_ops[o];
+    if (op->fn == op_norm_abs && !ops->norm_abs) continue;
+    if (op->fn == op_norm83 && !ops->norm83) continue;
+
+    for (unsigned s = 0; s < sizeof(g_sizes) / sizeof(g_sizes[0]); s++) {
+      l = (Line){0};
+      put_s(&l, op->name);
+      pad_right(&l, 18);
+      unsigned at = l.n;
+      put_size(&l, g_sizes[s]);
+      pad_left(&l, at, 6);
+
+      for (unsigned mis = 0; mis < 2; mis++) {
+        Run r = {
+          .ops = ops,
+          .dst = env->buf + (mis ? 1 : 0),
+          .src = env->buf + BENCH_SRC_OFF + (mis ? 3 : 0),
+          .n   = g_sizes[s],
+        };
+        run_one(env, &l, &r, op);
+      }
+      put_c(&l, '\n');
+      env->out(l.s);
+    }
+  }
+}
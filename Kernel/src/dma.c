@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <carlos/dma.h>
+#include <carlos/pmm.h>
+#include <carlos/phys.h>
+#include <carlos/klog.h>
+#include <carlos/shrinker.h>
+
+#define PAGE_SIZE 4096ULL
+
+// dma.c logging (runtime controlled by g_klog_level + g_klog_mask)
+#define DMA_DBG(...)  KLOG(KLOG_MOD_KMEM, KLOG_DBG,  __VA_ARGS__)
+#define DMA_WARN(...) KLOG(KLOG_MOD_KMEM, KLOG_WARN, __VA_ARGS__)
+
+/*
+  DMA memory comes straight from the PMM with an address limit, so a
+  buffer is always reachable by the device that asked for it. Freed
+  buffers are parked (still allocated, "pinned") in a small pool and
+  reused for requests with the same page count whose alignment and
+  address limit they satisfy; this keeps hot driver buffers warm.
+*/
+
+#define DMA_POOL_MAX 16
+
+typedef struct {
+  uint64_t phys;
+  uint64_t pages;
+} DmaPoolEnt;
+
+static DmaPoolEnt g_pool[DMA_POOL_MAX];
+static uint32_t   g_pool_n = 0;
+static uint64_t   g_hits = 0;
+static uint64_t   g_misses = 0;
+static int        g_shrinker_on = 0;
+
+static int pool_take(uint64_t pages, uint64_t align, uint64_t max_phys, uint64_t *phys){
+  for (uint32_t i = 0; i < g_pool_n; i++){
+    const DmaPoolEnt *e = &g_pool[i];
+    if (e->pages != pages) continue;
+    if (e->phys & (align - 1)) continue;
+    if (e->phys + pages * PAGE_SIZE - 1 > max_phys) continue;
+
+    *phys = e->phys;
+    g_pool[i] = g_pool[--g_pool_n];
+    return 1;
+  }
+  return 0;
+}
+
+// Shrinker: hand parked buffers back to the PMM.
+static uint64_t dma_pool_shrink(void *ctx, uint64_t nr_pages){
+  (void)ctx;
+  uint64_t n = 0;
+  while (g_pool_n && n < nr_pages){
+    DmaPoolEnt *e = &g_pool[--g_pool_n];
+    pmm_free_contig_pages_phys(e->phys, e->pages);
+    n += e->pages;
+  }
+  return n;
+}
+
+static Shrinker g_dma_shrinker = {
+  .name = "dma-pool", .scan = dma_pool_shrink, .priority = SHRINK_PRIO_POOL,
+};
+
+int dma_alloc(uint64_t size, uint64_t align, uint64_t max_phys, DmaBuf *out){
+  if (!out) return -1;
+  *out = (DmaBuf){0};
+  if (size == 0) return -1;
+  if (align == 0) align = 1;
+  if (align & (align - 1)) return -2;
+
+  uint64_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+  uint64_t phys = 0;
+
+  if (pool_take(pages, align, max_phys, &phys)) {
+    g_hits++;
+  } else {
+    phys = pmm_alloc_contig_pages_below_phys(pages, align, max_phys);
+    if (!phys) {
+      DMA_WARN("dma: no memory below 0x%llx for %llu pages\n",
+               (unsigned long long)max_phys, (unsigned long long)pages);
+      return -3;
+    }
+    g_misses++;
+  }
+
+  // the pool only fills from buffers handed out here
+  if (!g_shrinker_on) {
+    shrinker_register(&g_dma_shrinker);
+    g_shrinker_on = 1;
+  }
+
+  out->virt = phys_to_ptr(phys);
+  out->phys = phys;
+  out->size = pages * PAGE_SIZE;
+
+  DMA_DBG("dma: alloc phys=0x%llx size=%llu\n",
+          (unsigned long long)phys, (unsigned long long)out->size);
+  return 0;
+}
+
+void dma_free(DmaBuf *b){
+  if (!b || !b->phys) return;
+
+  uint64_t pages = b->size / PAGE_SIZE;
+  if (g_pool_n < DMA_POOL_MAX) {
+    g_pool[g_pool_n++] = (DmaPoolEnt){ .phys = b->phys, .pages = pages };
+  } else {
+    pmm_free_contig_pages_phys(b->phys, pages);
+  }
+  *b = (DmaBuf){0};
+}
+
+void dma_get_stats(DmaStats *st){
+  if (!st) return;
+  st->pooled = g_pool_n;
+  st->pooled_pages = 0;
+  for (uint32_t i = 0; i < g_pool_n; i++) st->pooled_pages += g_pool[i].pages;
+  st->hits   = g_hits;
+  st->misses = g_misses;
+}
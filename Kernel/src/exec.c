@@ -5,7 +5,8 @@
 #include <carlos/exec.h>
 #include <carlos/fs.h>
 #include <carlos/klog.h>
-#include <carlos/kmem.h>
+#include <carlos/karena.h>
+#include <carlos/mm.h>
 #include <carlos/kapi.h>   // g_api
 #include <carlos/pmm.h>    // optional: pmm_free_count() for debug prints
 
@@ -25,63 +26,97 @@ extern void kapi_set_cwd(const char *cwd);
 int  exec_enter(void *entry, void *stack_top, void *api, int argc, char **argv);
 void carlos_kexit(int code);
 
+#define EXEC_STACK_SIZE (64 * 1024)
+
+// ExecReadFn over an open file
+static int exec_read_file(void *ctx, uint64_t off, void *buf, uint32_t len)
+{
+  uint32_t got = 0;
+  int rc = fs_read_at((const FsFile*)ctx, (uint32_t)off, buf, len, &got);
+  if (rc != 0) return rc;
+  return (got == len) ? 0 : -1;
+}
+
 int exec_run_path(Fs *fs, const char *path, int argc, char **argv, const char *cwd)
 {
   int rc = 0;
   int code = 0;
 
-  void *file = 0;
-  uint32_t file_sz = 0;
+  FsFile file;
   ExecImage img = (ExecImage){0};
+  MmSpace as = (MmSpace){0};
+  MmStats st0, st1;
   uint8_t *stk = 0;
+  ExecText *text = 0;
 
   if (!fs || !path) return -1;
 
-  // One-call load (alloc + read) owned by FS layer
-  rc = fs_read_file(fs, path, &file, &file_sz);
+  // Everything that only lives for this exec (stack, loader state) comes
+  // from one arena and is released in one go at the end.
+  // The first chunk is sized so the stack fits next to the arena header.
+  KArena *arena = karena_create(EXEC_STACK_SIZE + 4096);
+  if (!arena) return -3;
+
+  stk = (uint8_t*)karena_alloc(arena, EXEC_STACK_SIZE, 16);
+  if (!stk) { rc = -4; goto cleanup; }
+
+  // Only resolve the file here; its pages are read on first touch
+  rc = fs_open(fs, path, &file);
   if (rc != 0) {
-    EXEC_ERR("exec: fs_read_file rc=%d path=%s\n", rc, path);
-    return rc;
+    EXEC_ERR("exec: fs_open rc=%d path=%s\n", rc, path);
+    goto cleanup;
   }
 
-  EXEC_DBG("exec: loaded %s size=%u (pmm_free=%llu) buf=%p\n",
-           path, (unsigned)file_sz,
-           (unsigned long long)pmm_free_count(),
-           file);
+  EXEC_DBG("exec: open %s size=%u (pmm_free=%llu)\n",
+           path, (unsigned)file.size,
+           (unsigned long long)pmm_free_count());
 
-  if (file_sz == 0 || !file) {
+  if (file.size == 0) {
     // treat empty as error for exec
-    if (file) kfree(file);
-    return -2;
+    rc = -2;
+    goto cleanup;
   }
 
-  rc = exec_elf_load_pie(file, (size_t)file_sz, &img);
+  // pages built by earlier runs of the same file are mapped, not re-read
+  text = exec_text_get(&file);
 
-  // File buffer is no longer needed after load attempt
-  kfree(file);
-  file = 0;
-  file_sz = 0;
+  rc = mm_space_create(&as);
+  if (rc != 0) {
+    EXEC_ERR("exec: no address space rc=%d\n", rc);
+    rc = -5;
+    goto cleanup;
+  }
 
+  ExecSource src = { .read = exec_read_file, .ctx = &file, .size = file.size };
+  rc = exec_elf_load_pie(&src, arena, &as, text, &img);
   if (rc != 0) {
     EXEC_ERR("exec: elf_load rc=%d path=%s\n", rc, path);
-    // img is guaranteed empty on failure with current exec_elf_load_pie()
-    return rc;
+    goto cleanup;
   }
 
-  stk = (uint8_t*)kmalloc(64 * 1024);
-  if (!stk) { rc = -4; goto cleanup; }
-
-  EXEC_INFO("exec: %s base=%p entry=%p\n", path, img.base, img.entry);
+  EXEC_INFO("exec: %s base=%p entry=%p size=%llu\n", path,
+            img.base, img.entry, (unsigned long long)img.size);
 
   kapi_set_cwd(cwd);
-  code = exec_enter(img.entry, stk + 64 * 1024, (void*)&g_api, argc, argv);
+  mm_stats(&st0);
+  mm_space_switch(&as);
+  code = exec_enter(img.entry, stk + EXEC_STACK_SIZE, (void*)&g_api, argc, argv);
+  mm_space_switch(0);
+  mm_stats(&st1);
 
   EXEC_INFO("\n[app exit %d]\n", code);
+  EXEC_DBG("exec: %llu of %llu image pages faulted in, %llu cached, %llu zero, %llu cow\n",
+           (unsigned long long)(st1.faults - st0.faults),
+           (unsigned long long)(img.size / 4096),
+           (unsigned long long)(st1.shared_maps - st0.shared_maps),
+           (unsigned long long)(st1.zero_maps - st0.zero_maps),
+           (unsigned long long)(st1.cow_faults - st0.cow_faults));
 
 cleanup:
-  if (stk) kfree(stk);
-  if (img.raw) kfree(img.raw);
+  mm_space_destroy(&as);
+  exec_text_put(text);   // only after nothing maps its pages
+  karena_destroy(arena);
 
   if (rc != 0) return rc;
   return code;
-}
\ No newline at end of file
+}
@@ -0,0 +1,64 @@
+// Kernel/src/exec_cache.c
+#include <stdint.h>
+#include <stddef.h>
+
+#include <carlos/exec.h>
+#include <carlos/fs.h>
+#include <carlos/pcache.h>
+#include <carlos/klog.h>
+
+#define EXEC_DBG(...)   KLOG(KLOG_MOD_EXEC, KLOG_DBG,   __VA_ARGS__)
+
+/*
+  Images are always placed at the same address, so the pages the loader
+  builds (file bytes plus relocations) come out identical on every run of
+  an unchanged file. An entry keeps those frames, indexed by image page,
+  for as long as nobody needs the memory back. Frames are only ever
+  mapped, never written, so sharing them needs no further bookkeeping;
+  the address spaces that map them don't own them. Slots, pinning and
+  reclaim are the page-slot cache's (pcache.c).
+*/
+
+#define EXEC_TEXT_SLOTS  8
+
+static PCacheFile g_text_slots[EXEC_TEXT_SLOTS];
+static PCache     g_text = PCACHE_INIT("exec-text", g_text_slots);
+
+ExecText *exec_text_get(const FsFile *f)
+{
+  return pcache_get(&g_text, f);
+}
+
+void exec_text_put(ExecText *t)
+{
+  if (!t) return;
+  pcache_put(&g_text, t);
+  EXEC_DBG("exec: text cache clus=%u holds %llu pages\n", (unsigned)t->file.clus,
+           (unsigned long long)t->held);
+}
+
+int exec_text_bind(ExecText *t, uint64_t pages)
+{
+  return pcache_bind(&g_text, t, pages);
+}
+
+uint64_t exec_text_page(ExecText *t, uint64_t idx)
+{
+  return pcache_lookup(&g_text, t, idx);
+}
+
+int exec_text_set_page(ExecText *t, uint64_t idx, uint64_t phys)
+{
+  return pcache_insert(&g_text, t, idx, phys);
+}
+
+void exec_text_stats(ExecTextStats *st)
+{
+  if (!st) return;
+  PCacheStats pc;
+  pcache_stats_of(&g_text, &pc);
+  *st = (ExecTextStats){
+    .entries = pc.files, .pages = pc.pages, .hits = pc.hits,
+    .fills = pc.misses, .evictions = pc.evictions,
+  };
+}
@@ -3,10 +3,9 @@
 #include <stddef.h>
 
 #include <carlos/exec.h>
-#include <carlos/kmem.h>
-
-static inline void memclr(void *p, size_t n){ __builtin_memset(p, 0, n); }
-static inline void memcp(void *d, const void *s, size_t n){ __builtin_memcpy(d, s, n); }
+#include <carlos/mm.h>
+#include <carlos/karena.h>
+#include <carlos/pmm.h>
 
 #define EI_NIDENT 16
 typedef struct __attribute__((packed)) {
@@ -62,21 +61,200 @@ typedef struct __attribute__((packed)) {
 #define ELF64_R_TYPE(i) ((uint32_t)((i) & 0xFFFFFFFFu))
 #define R_X86_64_RELATIVE 8
 
-static void *kmem_align_up(void *p, uint64_t align){
-  uint64_t x = (uint64_t)(uintptr_t)p;
-  uint64_t y = (x + (align - 1)) & ~(align - 1);
-  return (void*)(uintptr_t)y;
+#define PF_W        2
+
+// Where PIE images are placed inside their address space
+#define EXEC_IMAGE_BASE APP_SPACE_BASE
+
+// RELATIVE relocation, kept sorted by offset so a page fill can find its own
+typedef struct {
+  uint64_t off;
+  uint64_t addend;
+} ExecReloc;
+
+// Everything the fault handler needs to build an image page. Lives in the
+// exec arena, which outlives the address space.
+typedef struct {
+  ExecSource  src;
+  uint64_t    bias;      // vaddr v lives at bias + v
+  Elf64_Phdr *ph;        // PT_LOAD headers only
+  uint16_t    nph;
+  ExecReloc  *rel;
+  uint64_t    nrel;
+  ExecText   *text;      // optional cache for built pages
+} ExecLazy;
+
+static int src_read(const ExecSource *src, uint64_t off, void *buf, uint64_t len)
+{
+  if (len == 0) return 0;
+  if (off + len > src->size || len > 0xFFFFFFFFull) return -1;
+  return src->read(src->ctx, off, buf, (uint32_t)len);
+}
+
+// File offset backing [v, v + len) of some PT_LOAD segment
+static int vaddr_to_off(const ExecLazy *lz, uint64_t v, uint64_t len, uint64_t *off)
+{
+  for (uint16_t i = 0; i < lz->nph; i++){
+    const Elf64_Phdr *p = &lz->ph[i];
+    if (v < p->p_vaddr || v + len > p->p_vaddr + p->p_filesz) continue;
+    *off = p->p_offset + (v - p->p_vaddr);
+    return 0;
+  }
+  return -1;
 }
 
-int exec_elf_load_pie(const void *file, size_t file_sz, ExecImage *out)
+// First reloc whose 8 bytes end past v
+static uint64_t reloc_lower_bound(const ExecLazy *lz, uint64_t v)
 {
-  int rc = 0;
-  void *raw = 0;
+  uint64_t lo = 0, hi = lz->nrel;
+  while (lo < hi) {
+    uint64_t mid = (lo + hi) / 2;
+    if (lz->rel[mid].off + 8 <= v) lo = mid + 1;
+    else                           hi = mid;
+  }
+  return lo;
+}
 
-  if (!file || file_sz < sizeof(Elf64_Ehdr) || !out) return -1;
+// PTE flags for image page v; returns whether the page has any content
+// (file bytes or relocations). Pages with neither are .bss / p_memsz tails.
+static int image_page_info(const ExecLazy *lz, uint64_t v, uint64_t *pte_flags)
+{
+  int writable = 0, any = 0, content = 0;
+
+  for (uint16_t i = 0; i < lz->nph; i++){
+    const Elf64_Phdr *p = &lz->ph[i];
+    if (p->p_vaddr >= v + PAGE_SIZE || p->p_vaddr + p->p_memsz <= v) continue;
+    any = 1;
+    if (p->p_flags & PF_W) writable = 1;
+    if (p->p_filesz && p->p_vaddr < v + PAGE_SIZE && p->p_vaddr + p->p_filesz > v)
+      content = 1;
+  }
+
+  uint64_t first = reloc_lower_bound(lz, v);
+  if (first < lz->nrel && lz->rel[first].off < v + PAGE_SIZE) content = 1;
+
+  *pte_flags = (writable || !any) ? PTE_W : 0;
+  return content;
+}
+
+// Build image page v into a zeroed page: the file bytes of every segment that
+// overlaps it, then the relocations that land in it (a relocation straddling
+// two pages is written half by each).
+static int image_build(const ExecLazy *lz, uint64_t v, uint8_t *dst)
+{
+  for (uint16_t i = 0; i < lz->nph; i++){
+    const Elf64_Phdr *p = &lz->ph[i];
+    uint64_t lo = p->p_vaddr, hi = p->p_vaddr + p->p_filesz;
+    if (lo < v) lo = v;
+    if (hi > v + PAGE_SIZE) hi = v + PAGE_SIZE;
+    if (lo >= hi) continue;
+    if (src_read(&lz->src, p->p_offset + (lo - p->p_vaddr), dst + (lo - v), hi - lo) != 0)
+      return -1;
+  }
+
+  for (uint64_t i = reloc_lower_bound(lz, v); i < lz->nrel; i++){
+    const ExecReloc *r = &lz->rel[i];
+    if (r->off >= v + PAGE_SIZE) break;
+    uint64_t val = lz->bias + r->addend;
+    for (unsigned b = 0; b < 8; b++){
+      uint64_t at = r->off + b;
+      if (at >= v && at < v + PAGE_SIZE) dst[at - v] = (uint8_t)(val >> (8 * b));
+    }
+  }
+  return 0;
+}
+
+// MmFillFn for the image VMA. Probes (page == NULL) answer MM_FILL_ZERO for
+// empty pages; with a text cache, pages with content are built once into a
+// frame the cache keeps and handed out as MM_FILL_SHARED from then on.
+static int image_fill(void *ctx, uint64_t va, void *page, uint64_t *pte_flags)
+{
+  const ExecLazy *lz = (const ExecLazy*)ctx;
+  uint64_t v = va - lz->bias;
+  uint64_t flags;
+  int content = image_page_info(lz, v, &flags);
+
+  *pte_flags = flags;
+  if (page) return image_build(lz, v, (uint8_t*)page);
+  if (!content) return MM_FILL_ZERO;
+  if (!lz->text) return 0;
+
+  uint64_t idx = (va - EXEC_IMAGE_BASE) / PAGE_SIZE;
+  uint64_t phys = exec_text_page(lz->text, idx);
+  if (!phys) {
+    phys = pmm_alloc_zeroed_page_phys();
+    if (!phys) return 0;   // the handler tries a private page
+    if (image_build(lz, v, (uint8_t*)phys_to_ptr(phys)) != 0 ||
+        exec_text_set_page(lz->text, idx, phys) != 0) {
+      pmm_free_page_phys(phys);
+      return -1;
+    }
+  }
+
+  *pte_flags = phys | flags;
+  return MM_FILL_SHARED;
+}
+
+static int image_probe(void *ctx, uint64_t va, uint64_t *pte_flags)
+{
+  const ExecLazy *lz = (const ExecLazy*)ctx;
+  return image_page_info(lz, va - lz->bias, pte_flags) ? 0 : MM_FILL_ZERO;
+}
+
+// Collect RELATIVE relocations, sorted by offset (linkers emit them sorted,
+// so the insertion sort is a single pass in practice).
+static int load_relocs(ExecLazy *lz, KArena *arena, const Elf64_Phdr *dyn_ph,
+                       uint64_t minv, uint64_t maxv)
+{
+  if (!dyn_ph || dyn_ph->p_filesz == 0) return 0;
+
+  Elf64_Dyn *dyn = (Elf64_Dyn*)karena_alloc(arena, (size_t)dyn_ph->p_filesz, 16);
+  if (!dyn) return -3;
+  if (src_read(&lz->src, dyn_ph->p_offset, dyn, dyn_ph->p_filesz) != 0) return -23;
+  uint64_t ndyn = dyn_ph->p_filesz / sizeof(Elf64_Dyn);
+
+  uint64_t rela_v = 0, rela_sz = 0, rela_ent = sizeof(Elf64_Rela);
+  for (uint64_t i = 0; i < ndyn && dyn[i].d_tag != DT_NULL; i++){
+    if (dyn[i].d_tag == DT_RELA)    rela_v  = dyn[i].d_un.d_ptr;
+    if (dyn[i].d_tag == DT_RELASZ)  rela_sz = dyn[i].d_un.d_val;
+    if (dyn[i].d_tag == DT_RELAENT) rela_ent = dyn[i].d_un.d_val;
+  }
+  if (!rela_v || !rela_sz) return 0;
+  if (rela_ent != sizeof(Elf64_Rela)) return -24;
+
+  uint64_t rela_off;
+  if (vaddr_to_off(lz, rela_v, rela_sz, &rela_off) != 0) return -25;
+
+  Elf64_Rela *r = (Elf64_Rela*)karena_alloc(arena, (size_t)rela_sz, 16);
+  uint64_t n = rela_sz / sizeof(Elf64_Rela);
+  lz->rel = (ExecReloc*)karena_alloc(arena, (size_t)(n * sizeof(ExecReloc)), 16);
+  if (!r || !lz->rel) return -3;
+  if (src_read(&lz->src, rela_off, r, rela_sz) != 0) return -25;
+
+  for (uint64_t i = 0; i < n; i++){
+    if (ELF64_R_TYPE(r[i].r_info) != R_X86_64_RELATIVE) continue;
+    if (r[i].r_offset < minv || r[i].r_offset + 8 > maxv) return -26;
+
+    ExecReloc e = { r[i].r_offset, (uint64_t)r[i].r_addend };
+    uint64_t j = lz->nrel++;
+    while (j > 0 && lz->rel[j - 1].off > e.off) {
+      lz->rel[j] = lz->rel[j - 1];
+      j--;
+    }
+    lz->rel[j] = e;
+  }
+  return 0;
+}
+
+int exec_elf_load_pie(const ExecSource *src, KArena *arena, MmSpace *as,
+                      ExecText *text, ExecImage *out)
+{
+  if (!src || !src->read || !arena || !as || !as->pml4_phys || !out) return -1;
   *out = (ExecImage){0};
 
-  const Elf64_Ehdr *eh = (const Elf64_Ehdr*)file;
+  Elf64_Ehdr ehdr;
+  const Elf64_Ehdr *eh = &ehdr;
+  if (src->size < sizeof(ehdr) || src_read(src, 0, &ehdr, sizeof(ehdr)) != 0) return -1;
 
   if (eh->e_ident[0] != 0x7F || eh->e_ident[1] != 'E' || eh->e_ident[2] != 'L' || eh->e_ident[3] != 'F') return -11;
   if (eh->e_ident[4] != 2) return -12;
@@ -86,88 +264,60 @@ int exec_elf_load_pie(const void *file, size_t file_sz, ExecImage *out)
 
   if (eh->e_phoff == 0 || eh->e_phnum == 0) return -16;
   if (eh->e_phentsize != sizeof(Elf64_Phdr)) return -17;
-  if (eh->e_phoff + (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr) > file_sz) return -18;
+  if (eh->e_phoff + (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr) > src->size) return -18;
+
+  uint64_t ph_bytes = (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr);
+  Elf64_Phdr *ph = (Elf64_Phdr*)karena_alloc(arena, (size_t)ph_bytes, 16);
+  ExecLazy *lz = (ExecLazy*)karena_alloc(arena, sizeof(ExecLazy), 16);
+  if (!ph || !lz) return -3;
+  if (src_read(src, eh->e_phoff, ph, ph_bytes) != 0) return -18;
 
-  const Elf64_Phdr *ph = (const Elf64_Phdr*)((const uint8_t*)file + eh->e_phoff);
+  *lz = (ExecLazy){ .src = *src, .ph = ph };
 
   uint64_t minv = ~0ull, maxv = 0;
-  const Elf64_Phdr *dyn_ph = 0;
+  Elf64_Phdr dyn = {0};
+  int have_dyn = 0;
 
+  // Keep only the PT_LOAD headers, packed at the front of ph[] (writes never
+  // run ahead of the read index)
   for (uint16_t i = 0; i < eh->e_phnum; i++){
-    if (ph[i].p_type == PT_LOAD) {
-      if (ph[i].p_memsz == 0) continue;
-      if (ph[i].p_offset + ph[i].p_filesz > file_sz) return -19;
-      if (ph[i].p_vaddr < minv) minv = ph[i].p_vaddr;
-      uint64_t end = ph[i].p_vaddr + ph[i].p_memsz;
-      if (end > maxv) maxv = end;
-    } else if (ph[i].p_type == PT_DYNAMIC) {
-      dyn_ph = &ph[i];
+    if (ph[i].p_type == PT_DYNAMIC) {
+      dyn = ph[i];
+      have_dyn = 1;
+      continue;
     }
+    if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0) continue;
+    if (ph[i].p_offset + ph[i].p_filesz > src->size) return -19;
+    if (ph[i].p_filesz > ph[i].p_memsz) return -19;
+    if (ph[i].p_vaddr < minv) minv = ph[i].p_vaddr;
+    uint64_t end = ph[i].p_vaddr + ph[i].p_memsz;
+    if (end > maxv) maxv = end;
+    ph[lz->nph++] = ph[i];
   }
   if (minv == ~0ull) return -20;
 
-  uint64_t img_sz = maxv - minv;
-
-  raw = kmalloc((size_t)img_sz + 0x1000);
-  if (!raw) return -21;
-
-  uint8_t *base = (uint8_t*)kmem_align_up(raw, 0x1000);
-  memclr(base, (size_t)img_sz);
-
-  for (uint16_t i = 0; i < eh->e_phnum; i++){
-    if (ph[i].p_type != PT_LOAD) continue;
-    if (ph[i].p_filesz == 0) continue;
-
-    uint64_t dst_off = ph[i].p_vaddr - minv;
-    if (dst_off + ph[i].p_filesz > img_sz) { rc = -22; goto fail; }
-
-    memcp(base + dst_off, (const uint8_t*)file + ph[i].p_offset, (size_t)ph[i].p_filesz);
-  }
-
-  if (dyn_ph) {
-    uint64_t dyn_off = dyn_ph->p_vaddr - minv;
-    if (dyn_off + dyn_ph->p_memsz > img_sz) { rc = -23; goto fail; }
-
-    Elf64_Dyn *dyn = (Elf64_Dyn*)(base + dyn_off);
-
-    uint64_t rela_v = 0, rela_sz = 0, rela_ent = sizeof(Elf64_Rela);
-    for (; dyn->d_tag != DT_NULL; dyn++){
-      if (dyn->d_tag == DT_RELA)    rela_v  = dyn->d_un.d_ptr;
-      if (dyn->d_tag == DT_RELASZ)  rela_sz = dyn->d_un.d_val;
-      if (dyn->d_tag == DT_RELAENT) rela_ent = dyn->d_un.d_val;
-    }
-
-    if (rela_v && rela_sz) {
-      if (rela_ent != sizeof(Elf64_Rela)) { rc = -24; goto fail; }
+  uint64_t lo = minv & ~(PAGE_SIZE - 1);
+  uint64_t hi = page_align_up(maxv);
+  if (hi - lo > APP_SPACE_END - EXEC_IMAGE_BASE) return -21;
 
-      uint64_t rela_off = rela_v - minv;
-      if (rela_off + rela_sz > img_sz) { rc = -25; goto fail; }
+  // bias keeps page offsets intact, so segment pages line up with the file
+  lz->bias = EXEC_IMAGE_BASE - lo;
 
-      Elf64_Rela *r = (Elf64_Rela*)(base + rela_off);
-      uint64_t n = rela_sz / sizeof(Elf64_Rela);
+  int rc = load_relocs(lz, arena, have_dyn ? &dyn : 0, minv, maxv);
+  if (rc != 0) return rc;
 
-      for (uint64_t i = 0; i < n; i++){
-        if (ELF64_R_TYPE(r[i].r_info) != R_X86_64_RELATIVE) continue;
+  if (eh->e_entry < minv || eh->e_entry >= maxv) return -27;
 
-        uint64_t off = r[i].r_offset - minv;
-        if (off + 8 > img_sz) { rc = -26; goto fail; }
+  // an entry that can't take this image just isn't used
+  if (text && exec_text_bind(text, (hi - lo) / PAGE_SIZE) == 0) lz->text = text;
 
-        *(uint64_t*)(base + off) =
-          (uint64_t)(uintptr_t)(base + (uint64_t)r[i].r_addend);
-      }
-    }
-  }
+  // Nothing is read or mapped yet: pages come in through image_fill() on
+  // first touch.
+  if (mm_space_add_vma(as, lz->bias + lo, lz->bias + hi, PTE_W, image_fill, image_probe, 0, lz) != 0)
+    return -22;
 
-  uint64_t entry_off = eh->e_entry - minv;
-  if (entry_off >= img_sz) { rc = -27; goto fail; }
-
-  out->raw   = raw;
-  out->base  = base;
-  out->size  = img_sz;
-  out->entry = (void*)(base + entry_off);
+  out->base  = (void*)(uintptr_t)EXEC_IMAGE_BASE;
+  out->size  = hi - lo;
+  out->entry = (void*)(uintptr_t)(lz->bias + eh->e_entry);
   return 0;
-
-fail:
-  if (raw) kfree(raw);
-  return rc;
-}
\ No newline at end of file
+}
@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <carlos/fat16.h>
 #include <carlos/klog.h>
+#include <carlos/kmem.h>
 
 // fat16.c logging (runtime controlled by g_klog_level + g_klog_mask)
 #define FAT_TRACE(...) KLOG(KLOG_MOD_FAT, KLOG_TRACE, __VA_ARGS__)
@@ -55,10 +56,14 @@ static uint64_t clus_to_lba(const Fat16 *fs, uint16_t clus){
   return fs->data_lba + (uint64_t)(clus - 2) * (uint64_t)fs->spc;
 }
 
-static int fat_read_sector(Fat16 *fs, uint64_t lba, void *buf){
+static int fat_read_sectors(Fat16 *fs, uint64_t lba, uint32_t count, void *buf){
   if (!fs || !fs->disk) return -1;
   if (fs->disk->sector_size != 512) return -2;
-  return disk_read(fs->disk, lba, 1, buf);
+  return disk_read(fs->disk, lba, count, buf);
+}
+
+static int fat_read_sector(Fat16 *fs, uint64_t lba, void *buf){
+  return fat_read_sectors(fs, lba, 1, buf);
 }
 
 static int fat_next_clus(Fat16 *fs, uint16_t clus, uint16_t *out){
@@ -197,6 +202,21 @@ static int dir_iter_begin_clus(Fat16 *fs, FatDirIter *it, uint16_t first_clus){
   return 0;
 }
 
+// Iterators carry a full sector buffer; keep them off the (small) kernel stack.
+static KmemCache *g_iter_cache = 0;
+
+FatDirIter* fat16_dir_iter_alloc(void){
+  if (!g_iter_cache) {
+    g_iter_cache = kmem_cache_create("fat_dir_iter", sizeof(FatDirIter), 16);
+    if (!g_iter_cache) return 0;
+  }
+  return (FatDirIter*)kmem_cache_alloc(g_iter_cache);
+}
+
+void fat16_dir_iter_free(FatDirIter *it){
+  if (it) kmem_cache_free(g_iter_cache, it);
+}
+
 int fat16_dir_iter_begin(Fat16 *fs, FatDirIter *it, uint16_t first_clus){
   if (!fs || !it) return -1;
   if (first_clus < 2) return -2;
@@ -298,6 +318,7 @@ int fat16_dir_iter_next(FatDirIter *it, char name83[13],
       if (attr) *attr = e->Attr;
       if (clus) *clus = e->FstClusLO;
       if (size) *size = e->FileSize;
+      it->mtime = ((uint32_t)e->WrtDate << 16) | e->WrtTime;
       return 0;
     }
 
@@ -327,13 +348,12 @@ int fat16_dir_iter_next(FatDirIter *it, char name83[13],
   }
 }
 
-static int find_in_dir(Fat16 *fs, int in_root, uint16_t dir_clus,
-                       const uint8_t target11[11],
-                       /*out*/ FatDirEnt *out)
+static int find_in_dir_it(Fat16 *fs, FatDirIter *it, int in_root, uint16_t dir_clus,
+                          const uint8_t target11[11],
+                          /*out*/ FatDirEnt *out)
 {
-  FatDirIter it;
-  if (in_root) dir_iter_begin_root(fs, &it);
-  else         dir_iter_begin_clus(fs, &it, dir_clus);
+  if (in_root) dir_iter_begin_root(fs, it);
+  else         dir_iter_begin_clus(fs, it, dir_clus);
 
     // We need raw name[11] for exact match; reload from sector buffer:
     // easiest: recompute from tmp -> target11 is already built, so compare entry name directly:
@@ -349,7 +369,7 @@ static int find_in_dir(Fat16 *fs, int in_root, uint16_t dir_clus,
     uint8_t a;
     uint16_t c;
     uint32_t s;
-    int rc = fat16_dir_iter_next(&it, tmp, &a, &c, &s);
+    int rc = fat16_dir_iter_next(it, tmp, &a, &c, &s);
     if (rc != 0) {
       if (rc == 1) FAT_DBG("fat: find_in_dir miss '%s'\n", tname);
       return rc;
@@ -371,13 +391,36 @@ static int find_in_dir(Fat16 *fs, int in_root, uint16_t dir_clus,
       out->Attr = a;
       out->FstClusLO = c;
       out->FileSize = s;
+      out->WrtTime = (uint16_t)it->mtime;
+      out->WrtDate = (uint16_t)(it->mtime >> 16);
     }
     return 0;
   }
 }
 
+static int find_in_dir(Fat16 *fs, int in_root, uint16_t dir_clus,
+                       const uint8_t target11[11],
+                       /*out*/ FatDirEnt *out)
+{
+  // the fs layer resets its scratch arena per call, so nothing to free there
+  FatDirIter *it = fs->scratch
+    ? (FatDirIter*)karena_alloc(fs->scratch, sizeof(FatDirIter), 16)
+    : fat16_dir_iter_alloc();
+  if (!it) return -12;
+  int rc = find_in_dir_it(fs, it, in_root, dir_clus, target11, out);
+  if (!fs->scratch) fat16_dir_iter_free(it);
+  return rc;
+}
+
 int fat16_stat_path83(Fat16 *fs, const char *path,
                       uint16_t *clus, uint8_t *attr, uint32_t *size)
+{
+  return fat16_stat_path83_mtime(fs, path, clus, attr, size, 0);
+}
+
+int fat16_stat_path83_mtime(Fat16 *fs, const char *path,
+                            uint16_t *clus, uint8_t *attr, uint32_t *size,
+                            uint32_t *mtime)
 {
   FAT_TRACE("fat: stat '%s'\n", path);
 
@@ -386,6 +429,7 @@ int fat16_stat_path83(Fat16 *fs, const char *path,
   if (clus) *clus = 0;
   if (attr) *attr = 0;
   if (size) *size = 0;
+  if (mtime) *mtime = 0;
 
   // Skip leading seps
   while (*path && is_sep(*path)) path++;
@@ -438,6 +482,7 @@ int fat16_stat_path83(Fat16 *fs, const char *path,
     if (attr) *attr = e.Attr;
     if (clus) *clus = e.FstClusLO;
     if (size) *size = e.FileSize;
+    if (mtime) *mtime = ((uint32_t)e.WrtDate << 16) | e.WrtTime;
     return 0;
   }
 
@@ -476,13 +521,36 @@ int fat16_read_file_by_clus(Fat16 *fs, uint16_t first_clus,
   while (size > 0) {
     if (clus < 2 || clus_is_eoc(clus)) return -5;
 
-    uint64_t base = clus_to_lba(fs, clus);
+    uint64_t lba = clus_to_lba(fs, clus) + offset / bps;
+    uint32_t sec_off = offset % bps;
 
-    uint32_t sec_index = offset / bps;
-    uint32_t sec_off   = offset % bps;
+    if (sec_off == 0 && size >= bps) {
+      // Whole sectors go straight to `out`, as one read that runs on into
+      // the following clusters for as long as the chain is contiguous.
+      uint32_t run = clus_bytes - offset;
+      uint16_t last = clus;
+      while (run < size) {
+        uint16_t nxt = 0;
+        if (fat_next_clus(fs, last, &nxt) != 0) return -6;
+        if (nxt != (uint16_t)(last + 1)) break;
+        last = nxt;
+        run += clus_bytes;
+      }
+      if (run > size) run = size - size % bps;
 
-    for (; sec_index < spc && size > 0; sec_index++) {
-      int rc = fat_read_sector(fs, base + sec_index, secbuf);
+      int rc = fat_read_sectors(fs, lba, run / bps, dst);
+      if (rc != 0) return rc;
+
+      dst  += run;
+      size -= run;
+
+      // land in the cluster holding the last byte read
+      uint32_t end = offset + run;
+      uint32_t k = (end - 1) / clus_bytes;
+      clus   = (uint16_t)(clus + k);
+      offset = end - k * clus_bytes;
+    } else {
+      int rc = fat_read_sector(fs, lba, secbuf);
       if (rc != 0) return rc;
 
       uint32_t take = bps - sec_off;
@@ -490,19 +558,20 @@ int fat16_read_file_by_clus(Fat16 *fs, uint16_t first_clus,
 
       memcp(dst, secbuf + sec_off, take);
 
-      dst += take;
-      size -= take;
-
-      sec_off = 0;
-      offset = 0;
+      dst    += take;
+      size   -= take;
+      offset += take;
     }
 
     if (size == 0) break;
+    if (offset < clus_bytes) continue;
 
     uint16_t nxt = 0;
     if (fat_next_clus(fs, clus, &nxt) != 0) return -6;
     if (clus_is_eoc(nxt)) { FAT_ERR("fat: read hit eoc clus=%u\n", (unsigned)clus); return -7; }
     if (nxt < 2)          { FAT_ERR("fat: read bad next=%u from clus=%u\n", (unsigned)nxt, (unsigned)clus); return -8; }
+    clus = nxt;
+    offset = 0;
   }
   return 0;
 }
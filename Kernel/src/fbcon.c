@@ -1,21 +1,34 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <carlos/fbcon.h>
-#include <carlos/phys.h>
+#include <carlos/iomap.h>
+#include <carlos/mem.h>
 #include "font8x8_basic.h"
 
 #define CHAR_W 8
 #define CHAR_H 16
 
+// Text kept in ordinary (write-back) memory: the framebuffer mapping is WC,
+// where every read is an uncached bus access, so scrolling redraws from
+// here instead of copying pixels within the framebuffer. Screens larger
+// than this use their top-left part.
+#define TEXT_COLS_MAX 320    // 2560 px
+#define TEXT_ROWS_MAX 160    // 2560 px
+
 // EFI_GRAPHICS_PIXEL_FORMAT values (UEFI spec)
 #define PixelRedGreenBlueReserved8BitPerColor 0
 #define PixelBlueGreenRedReserved8BitPerColor 1
 
 static volatile uint32_t *fb = 0;
 static uint64_t fb_phys = 0;   // optional, but nice for debugging
+static uint64_t fb_bytes = 0;
 static uint32_t fb_w=0, fb_h=0, fb_ppsl=0, fb_fmt=0;
 static uint32_t cur_x=0, cur_y=0;
 
+static char     text[TEXT_ROWS_MAX][TEXT_COLS_MAX];
+static uint32_t text_cols=0, text_rows=0;
+static uint32_t line_px[TEXT_COLS_MAX * CHAR_W];   // one scanline being built
+
 static int cursor_enabled = 1;
 static int cursor_visible = 0;
 
@@ -37,33 +50,43 @@ static inline void put_px(uint32_t x, uint32_t y, uint32_t c) {
   fb[y * fb_ppsl + x] = c;
 }
 
-// Scroll framebuffer console up by one character row
-static void scroll(void) {
-  // scroll up by CHAR_H pixels
-  uint32_t rows_px = fb_h;
-  uint32_t move_px = CHAR_H;
-  uint32_t pitch = fb_ppsl;
-
-  for (uint32_t y = 0; y < rows_px - move_px; y++) {
-    for (uint32_t x = 0; x < fb_w; x++) {
-      fb[y*pitch + x] = fb[(y+move_px)*pitch + x];
-    }
-  }
-  // clear bottom area
-  for (uint32_t y = rows_px - move_px; y < rows_px; y++) {
-    for (uint32_t x = 0; x < fb_w; x++) {
-      fb[y*pitch + x] = bg;
+static inline const uint8_t *glyph(char ch) {
+  if (ch < 32 || ch > 127) ch = '?';
+  return (const uint8_t*)font8x8_basic[(unsigned char)ch];
+}
+
+// Redraw text row cy from text[]: each scanline is built in line_px and
+// streamed to the framebuffer whole
+static void redraw_row(uint32_t cy) {
+  uint32_t *p = (uint32_t*)fb;
+  for (uint32_t y = 0; y < CHAR_H; y++) {
+    uint32_t *o = line_px;
+    for (uint32_t cx = 0; cx < text_cols; cx++) {
+      uint8_t bits = glyph(text[cy][cx])[y / 2];
+      for (uint32_t col = 0; col < CHAR_W; col++)
+        *o++ = (bits & (1u << col)) ? fg : bg;
     }
+    memcpy_nt(p + (cy * CHAR_H + y) * fb_ppsl, line_px, text_cols * CHAR_W * sizeof(uint32_t));
   }
+}
+
+// Scroll framebuffer console up by one character row
+static void scroll(void) {
+  for (uint32_t cy = 0; cy + 1 < text_rows; cy++)
+    memcpy(text[cy], text[cy + 1], text_cols);
+  memset(text[text_rows - 1], ' ', text_cols);
+
+  for (uint32_t cy = 0; cy < text_rows; cy++)
+    redraw_row(cy);
   if (cur_y > 0) cur_y--;
 }
 
-/* 
-    Draw character 'ch' at character cell (cx, cy)
-*/
-static void draw_char(uint32_t cx, uint32_t cy, char ch) {
-  if (ch < 32 || ch > 127) ch = '?';
-  const uint8_t *g = (const uint8_t*)font8x8_basic[(unsigned char)ch];
+// Draw the character text[] holds for cell (cx, cy), colours swapped if
+// `invert` (the cursor)
+static void draw_cell(uint32_t cx, uint32_t cy, int invert) {
+  const uint8_t *g = glyph(text[cy][cx]);
+  uint32_t on  = invert ? bg : fg;
+  uint32_t off = invert ? fg : bg;
 
   uint32_t px0 = cx * CHAR_W;
   uint32_t py0 = cy * CHAR_H;
@@ -71,12 +94,20 @@ static void draw_char(uint32_t cx, uint32_t cy, char ch) {
   for (uint32_t row = 0; row < 8; row++) {
     uint8_t bits = g[row];
     for (uint32_t dy = 0; dy < 2; dy++) {
-        for (uint32_t col = 0; col < 8; col++) {
-        uint32_t c = (bits & (1u << col)) ? fg : bg;
+      for (uint32_t col = 0; col < 8; col++) {
+        uint32_t c = (bits & (1u << col)) ? on : off;
         put_px(px0 + col, py0 + row*2 + dy, c);
+      }
     }
   }
 }
+
+/* 
+    Draw character 'ch' at character cell (cx, cy)
+*/
+static void draw_char(uint32_t cx, uint32_t cy, char ch) {
+  text[cy][cx] = ch;
+  draw_cell(cx, cy, 0);
 }
 
 /* 
@@ -91,8 +122,6 @@ static void draw_char(uint32_t cx, uint32_t cy, char ch) {
 void fbcon_init(uint64_t fb_base_phys, uint64_t fb_size,
                 uint32_t w, uint32_t h, uint32_t ppsl, uint32_t fmt)
 {
-  (void)fb_size;
-
   fb_phys = fb_base_phys;
   if (fb_phys == 0 || w == 0 || h == 0 || ppsl == 0) {
     fb = 0;
@@ -100,8 +129,18 @@ void fbcon_init(uint64_t fb_base_phys, uint64_t fb_size,
     return;
   }
 
-  fb = (volatile uint32_t*)phys_to_ptr(fb_phys);
+  if (w < CHAR_W || h < CHAR_H) {   // not even one text cell
+    fb = 0;
+    return;
+  }
+
+  fb_bytes = fb_size ? fb_size : (uint64_t)ppsl * h * 4;
+  fb = (volatile uint32_t*)iomap(fb_phys, (size_t)fb_bytes, IOMAP_WC);
   fb_w = w; fb_h = h; fb_ppsl = ppsl; fb_fmt = fmt;
+  text_cols = w / CHAR_W;
+  text_rows = h / CHAR_H;
+  if (text_cols > TEXT_COLS_MAX) text_cols = TEXT_COLS_MAX;
+  if (text_rows > TEXT_ROWS_MAX) text_rows = TEXT_ROWS_MAX;
 
   fg = pack_rgb(255,255,255);
   bg = pack_rgb(0,0,0);
@@ -110,36 +149,28 @@ void fbcon_init(uint64_t fb_base_phys, uint64_t fb_size,
   fbcon_clear();
 }
 
-// Invert character cell at (cx, cy)
-static void invert_cell(uint32_t cx, uint32_t cy) {
-  if (!fb) return;
-
-  uint32_t px0 = cx * CHAR_W;
-  uint32_t py0 = cy * CHAR_H;
-
-  for (uint32_t y = 0; y < CHAR_H; y++) {
-    for (uint32_t x = 0; x < CHAR_W; x++) {
-      uint32_t px = px0 + x;
-      uint32_t py = py0 + y;
-      if (px < fb_w && py < fb_h) {
-        uint32_t i = py * fb_ppsl + px;
-        fb[i] ^= 0x00FFFFFF; // invert RGB bits (good enough for our 32bpp formats)
-      }
-    }
-  }
+// Re-map the framebuffer with different caching (IOMAP_*). fbcon_init() runs
+// before paging is set up, so kmain calls this once mm_init() is done.
+int fbcon_remap(uint32_t iomap_flags)
+{
+  if (!fb_phys || !fb) return -1;
+  volatile uint32_t *p = (volatile uint32_t*)iomap(fb_phys, (size_t)fb_bytes, iomap_flags);
+  if (!p) return -2;
+  fb = p;
+  return 0;
 }
 
-// Show cursor
+// Show cursor (redrawn from text[]: reading the WC framebuffer back is slow)
 static void cursor_show(void) {
-  if (!cursor_enabled || cursor_visible) return;
-  invert_cell(cur_x, cur_y);
+  if (!cursor_enabled || cursor_visible || !fb) return;
+  draw_cell(cur_x, cur_y, 1);
   cursor_visible = 1;
 }
 
 // Hide cursor
 static void cursor_hide(void) {
-  if (!cursor_enabled || !cursor_visible) return;
-  invert_cell(cur_x, cur_y);
+  if (!cursor_enabled || !cursor_visible || !fb) return;
+  draw_cell(cur_x, cur_y, 0);
   cursor_visible = 0;
 }
 
@@ -158,8 +189,9 @@ void fbcon_enable_cursor(int enable) {
 void fbcon_clear(void) {
   if (!fb) return;
   for (uint32_t y = 0; y < fb_h; y++)
-    for (uint32_t x = 0; x < fb_w; x++)
-      fb[y * fb_ppsl + x] = bg;
+    memset32_nt((uint32_t*)fb + y * fb_ppsl, bg, fb_w);
+  for (uint32_t cy = 0; cy < text_rows; cy++)
+    memset(text[cy], ' ', text_cols);
 
   cur_x = 0; cur_y = 0;
   cursor_visible = 0;
@@ -177,8 +209,7 @@ void fbcon_putc(char c) {
   if (c == '\n') {
     cur_x = 0;
     cur_y++;
-    uint32_t rows = fb_h / CHAR_H;
-    if (cur_y >= rows) scroll();
+    if (cur_y >= text_rows) scroll();
     cursor_show();
     return;
   }
@@ -192,21 +223,28 @@ void fbcon_putc(char c) {
     return;
   }
 
-  uint32_t cols = fb_w / CHAR_W;
-  uint32_t rows = fb_h / CHAR_H;
-
   draw_char(cur_x, cur_y, c);
   cur_x++;
 
-  if (cur_x >= cols) {
+  if (cur_x >= text_cols) {
     cur_x = 0;
     cur_y++;
-    if (cur_y >= rows) scroll();
+    if (cur_y >= text_rows) scroll();
   }
 
   cursor_show();
 }
 
+// Scroll one text row (keeps the cursor row)
+void fbcon_scroll(void) {
+  if (!fb) return;
+  cursor_hide();
+  uint32_t y = cur_y;
+  scroll();
+  cur_y = y;
+  cursor_show();
+}
+
 // Print string to framebuffer console
 void fbcon_puts(const char *s) {
   for (; s && *s; s++) fbcon_putc(*s);
@@ -10,8 +10,26 @@
 #include <carlos/fat16.h>
 #include <carlos/fat16_w.h>   // only fs.c gets write access
 #include <carlos/disk.h>
+#include <carlos/path.h>
+#include <carlos/karena.h>
 
 #define FAT_ATTR_DIR 0x10
+#define FS_PATH83_MAX 256
+
+// Scratch space for one FS call: reset on entry, shared with the FAT
+// lookups underneath, never freed. Callers don't hold onto anything in it.
+static KArena* fs_scratch(Fs *fs){
+  if (!fs->scratch) fs->scratch = karena_create(0);
+  else              karena_reset(fs->scratch);
+  fs->fat.scratch = fs->scratch;
+  return fs->scratch;
+}
+
+static char* fs_path83(KArena *a, const char *path){
+  char *p83 = a ? (char*)karena_alloc(a, FS_PATH83_MAX, 1) : 0;
+  if (p83) path_norm83(path, p83, FS_PATH83_MAX);
+  return p83;
+}
 
 static int streq(const char *a, const char *b){
   if (!a || !b) return 0;
@@ -36,38 +54,6 @@ static void kputs_pad12(const char *s){
   for (; i < 12; i++) kputc(' ');
 }
 
-// normalize:  "/efi/carlos" -> "EFI/CARLOS"
-// also collapses leading slashes and converts '\' -> '/'
-static void norm_path83(const char *in, char *out, size_t cap){
-  size_t j = 0;
-  if (!cap) return;
-  out[0] = 0;
-
-  // skip leading slashes
-  while (in && (*in == '/' || *in == '\\')) in++;
-
-  for (size_t i = 0; in && in[i] && j + 1 < cap; i++){
-    char c = in[i];
-    if (c == '\\') c = '/';
-
-    // collapse duplicate '/'
-    if (c == '/'){
-      if (j == 0 || out[j-1] == '/') continue;
-      out[j++] = '/';
-      continue;
-    }
-
-    // uppercase for FAT 8.3 usage
-    if (c >= 'a' && c <= 'z') c = (char)(c - 'a' + 'A');
-    out[j++] = c;
-  }
-
-  // trim trailing '/'
-  if (j > 0 && out[j-1] == '/') j--;
-
-  out[j] = 0;
-}
-
 int fs_mount_esp(Fs *out)
 {
   if (!out) return -1;
@@ -87,23 +73,20 @@ int fs_mount_esp(Fs *out)
   return 0;
 }
 
-int fs_list_dir(Fs *fs, const char *path)
+static int fs_list_dir_it(Fs *fs, KArena *a, const char *path, FatDirIter *it)
 {
-  if (!fs) return -1;
-
-  FatDirIter it;
   int rc = 0;
 
   if (is_root_path(path)) {
-    rc = fat16_root_iter_begin(&fs->fat, &it);
+    rc = fat16_root_iter_begin(&fs->fat, it);
     if (rc != 0) {
       kprintf("FS: fat16_root_iter_begin failed rc=%d\n", rc);
       return rc;
     }
     kprintf("DIR /\n");
   } else {
-    char p83[256];
-    norm_path83(path, p83, sizeof(p83));
+    char *p83 = fs_path83(a, path);
+    if (!p83) return -12;
 
     uint8_t  attr = 0;
     uint16_t clus = 0;
@@ -120,7 +103,7 @@ int fs_list_dir(Fs *fs, const char *path)
       return -2;
     }
 
-    rc = fat16_dir_iter_begin(&fs->fat, &it, clus);
+    rc = fat16_dir_iter_begin(&fs->fat, it, clus);
     if (rc != 0) {
       kprintf("FS: fat16_dir_iter_begin failed clus=%u rc=%d\n", (uint32_t)clus, rc);
       return rc;
@@ -135,7 +118,7 @@ int fs_list_dir(Fs *fs, const char *path)
     uint16_t clus = 0;
     uint32_t size = 0;
 
-    rc = fat16_dir_iter_next(&it, name83, &attr, &clus, &size);
+    rc = fat16_dir_iter_next(it, name83, &attr, &clus, &size);
     if (rc > 0) break;        // end
     if (rc < 0) return rc;    // error
 
@@ -152,6 +135,16 @@ int fs_list_dir(Fs *fs, const char *path)
   return 0;
 }
 
+int fs_list_dir(Fs *fs, const char *path)
+{
+  if (!fs) return -1;
+
+  KArena *a = fs_scratch(fs);
+  FatDirIter *it = a ? (FatDirIter*)karena_alloc(a, sizeof(FatDirIter), 16) : 0;
+  if (!it) return -12;
+  return fs_list_dir_it(fs, a, path, it);
+}
+
 int fs_mount_root(Fs *out, const BootInfo *bi){
   if (!out || !bi) return -1;
   *out = (Fs){0};
@@ -228,8 +221,8 @@ int fs_read_file(Fs *fs, const char *path, void **out_buf, uint32_t *out_size)
   if (out_size) *out_size = 0;
   if (!fs || !path || !out_buf || !out_size) return -1;
 
-  char p83[256];
-  norm_path83(path, p83, sizeof(p83));
+  char *p83 = fs_path83(fs_scratch(fs), path);
+  if (!p83) return -12;
 
   uint16_t clus = 0;
   uint8_t  attr = 0;
@@ -269,23 +262,51 @@ int fs_read_file_at(Fs *fs, const char *path,
   if (!fs || !path || !buf) return -1;
   if (len == 0) return 0;
 
-  char p83[256];
-  norm_path83(path, p83, sizeof(p83));
+  FsFile f;
+  int rc = fs_open(fs, path, &f);
+  if (rc != 0) return rc;
+
+  return fs_read_at(&f, offset, buf, len, out_read);
+}
+
+// fs_open: resolve path once; fs_read_at then reads by cluster.
+int fs_open(Fs *fs, const char *path, FsFile *out)
+{
+  if (!fs || !path || !out) return -1;
+  *out = (FsFile){0};
+
+  char *p83 = fs_path83(fs_scratch(fs), path);
+  if (!p83) return -12;
 
   uint16_t clus = 0;
   uint8_t  attr = 0;
   uint32_t size = 0;
+  uint32_t mtime = 0;
 
-  int rc = fat16_stat_path83(&fs->fat, p83, &clus, &attr, &size);
+  int rc = fat16_stat_path83_mtime(&fs->fat, p83, &clus, &attr, &size, &mtime);
   if (rc != 0) return rc;
 
   if (attr & FAT_ATTR_DIR) return -2;
-  if (offset >= size) return -4; // EOF
 
-  uint32_t remain = size - offset;
+  out->fs    = fs;
+  out->clus  = clus;
+  out->size  = size;
+  out->mtime = mtime;
+  return 0;
+}
+
+int fs_read_at(const FsFile *f, uint32_t offset, void *buf, uint32_t len,
+               uint32_t *out_read)
+{
+  if (out_read) *out_read = 0;
+  if (!f || !f->fs || !buf) return -1;
+  if (len == 0) return 0;
+  if (offset >= f->size) return -4; // EOF
+
+  uint32_t remain = f->size - offset;
   uint32_t take = (len < remain) ? len : remain;
 
-  rc = fat16_read_file_by_clus(&fs->fat, clus, offset, take, buf);
+  int rc = fat16_read_file_by_clus(&f->fs->fat, f->clus, offset, take, buf);
   if (rc != 0) return rc;
 
   if (out_read) *out_read = take;
@@ -296,26 +317,24 @@ int fs_mkdir(Fs *fs, const char *path)
 {
   if (!fs || !path) return -1;
 
-  char p83[256];
-  norm_path83(path, p83, sizeof(p83));
+  char *p83 = fs_path83(fs_scratch(fs), path);
+  if (!p83) return -12;
 
   // write API is only visible via fat16_w.h
   return fat16_mkdir_path83(&fs->fat, p83);
 }
 
-int fs_listdir(Fs *fs, const char *path, fs_listdir_cb cb, void *ud)
+static int fs_listdir_it(Fs *fs, KArena *a, const char *path,
+                         fs_listdir_cb cb, void *ud, FatDirIter *it)
 {
-  if (!fs || !cb) return -1;
-
-  FatDirIter it;
   int rc = 0;
 
   if (is_root_path(path)) {
-    rc = fat16_root_iter_begin(&fs->fat, &it);
+    rc = fat16_root_iter_begin(&fs->fat, it);
     if (rc != 0) return rc;
   } else {
-    char p83[256];
-    norm_path83(path, p83, sizeof(p83));
+    char *p83 = fs_path83(a, path);
+    if (!p83) return -12;
 
     uint8_t  attr = 0;
     uint16_t clus = 0;
@@ -326,7 +345,7 @@ int fs_listdir(Fs *fs, const char *path, fs_listdir_cb cb, void *ud)
 
     if ((attr & FAT_ATTR_DIR) == 0) return -2;
 
-    rc = fat16_dir_iter_begin(&fs->fat, &it, clus);
+    rc = fat16_dir_iter_begin(&fs->fat, it, clus);
     if (rc != 0) return rc;
   }
 
@@ -337,7 +356,7 @@ int fs_listdir(Fs *fs, const char *path, fs_listdir_cb cb, void *ud)
     uint16_t clus = 0;
     uint32_t size = 0;
 
-    rc = fat16_dir_iter_next(&it, name83, &attr, &clus, &size);
+    rc = fat16_dir_iter_next(it, name83, &attr, &clus, &size);
     if (rc > 0) break;      // end
     if (rc < 0) return rc;  // error
 
@@ -354,13 +373,23 @@ int fs_listdir(Fs *fs, const char *path, fs_listdir_cb cb, void *ud)
   return n;
 }
 
+int fs_listdir(Fs *fs, const char *path, fs_listdir_cb cb, void *ud)
+{
+  if (!fs || !cb) return -1;
+
+  KArena *a = fs_scratch(fs);
+  FatDirIter *it = a ? (FatDirIter*)karena_alloc(a, sizeof(FatDirIter), 16) : 0;
+  if (!it) return -12;
+  return fs_listdir_it(fs, a, path, cb, ud, it);
+}
+
 int fs_stat(Fs *fs, const char *path, FsStat *st)
 {
   if (st) *st = (FsStat){0};
   if (!fs || !path || !st) return -1;
 
-  char p83[256];
-  norm_path83(path, p83, sizeof(p83));
+  char *p83 = fs_path83(fs_scratch(fs), path);
+  if (!p83) return -12;
 
   uint16_t clus = 0;
   uint8_t  attr = 0;
@@ -1,7 +1,7 @@
 #include <stdint.h>
 #include <carlos/hpet.h>
 #include <carlos/klog.h>
-#include <carlos/phys.h>
+#include <carlos/iomap.h>
 #include <carlos/acpi.h>   // we’ll add/find acpi_find_sdt("HPET")
 
 // Generic Address Structure (GAS)
@@ -34,7 +34,7 @@ typedef struct __attribute__((packed)) {
   volatile uint64_t MAIN;      // 0xF0
 } HpetRegs;
 
-static volatile HpetRegs *g_hpet = 0;   // mapped pointer (via phys_to_ptr for now)
+static volatile HpetRegs *g_hpet = 0;   // registers, mapped UC
 static uint64_t  g_hpet_phys = 0;        // physical base
 static uint64_t  g_fs_per_tick = 0; // femtoseconds per tick
 static uint64_t  g_hz = 0;          // HPET frequency (ticks per second)
@@ -60,7 +60,8 @@ int hpet_init_from_acpi(void){
 
   uint64_t base = t->BaseAddress.Address;
   g_hpet_phys = base;
-  g_hpet = (volatile HpetRegs*)phys_to_ptr(base);
+  g_hpet = (volatile HpetRegs*)iomap(base, 0x400, IOMAP_UC);
+  if (!g_hpet) return -6;
 
   uint64_t cap = g_hpet->GCAP_ID;
   g_fs_per_tick = (cap >> 32); // HPET period in femtoseconds
@@ -3,7 +3,7 @@
 #include <carlos/idt.h>
 
 #define IRQ_BASE_VEC 0x20
-#define IRQ_COUNT    16
+#define IRQ_COUNT    (IRQ_LEGACY_COUNT + IRQ_MSI_COUNT)
 
 extern void irq0(void);
 extern void irq1(void);
@@ -21,10 +21,19 @@ extern void irq12(void);
 extern void irq13(void);
 extern void irq14(void);
 extern void irq15(void);
+extern void irq16(void);
+extern void irq17(void);
+extern void irq18(void);
+extern void irq19(void);
+extern void irq20(void);
+extern void irq21(void);
+extern void irq22(void);
+extern void irq23(void);
 
 static void *const g_irq_stubs[IRQ_COUNT] = {
   irq0, irq1, irq2, irq3, irq4, irq5, irq6, irq7,
-  irq8, irq9, irq10, irq11, irq12, irq13, irq14, irq15
+  irq8, irq9, irq10, irq11, irq12, irq13, irq14, irq15,
+  irq16, irq17, irq18, irq19, irq20, irq21, irq22, irq23
 };
 
 typedef struct {
@@ -34,6 +43,8 @@ typedef struct {
 
 static IrqSlot g_irq[IRQ_COUNT];
 
+volatile uint32_t g_intr_nesting = 0;
+
 void intr_disable(void){
   __asm__ volatile ("cli" ::: "memory");
 }
@@ -53,12 +64,23 @@ void intr_restore(uint64_t f){
 }
 
 int irq_register(int irq, irq_handler_t fn, void *ctx){
-  if (irq < 0 || irq >= IRQ_COUNT) return -1;
+  if (irq < 0 || irq >= IRQ_LEGACY_COUNT) return -1;
   g_irq[irq].fn  = fn;
   g_irq[irq].ctx = ctx;
   return 0;
 }
 
+int intr_alloc_msi(irq_handler_t fn, void *ctx){
+  if (!fn) return -1;
+  for (int i = IRQ_LEGACY_COUNT; i < IRQ_COUNT; i++){
+    if (g_irq[i].fn) continue;
+    g_irq[i].fn  = fn;
+    g_irq[i].ctx = ctx;
+    return IRQ_BASE_VEC + i;
+  }
+  return -2;
+}
+
 // Called from irq.c
 void intr_dispatch_irq(int irq){
   if (irq < 0 || irq >= IRQ_COUNT) return;
@@ -68,7 +90,7 @@ void intr_dispatch_irq(int irq){
 }
 
 void intr_init(void){
-  // install 0x20..0x2F gates
+  // install 0x20..0x37 gates
   for (int i = 0; i < IRQ_COUNT; i++){
     idt_set_gate(IRQ_BASE_VEC + i, g_irq_stubs[i], IDT_TYPE_INTGATE, 0);
     g_irq[i] = (IrqSlot){0};
@@ -0,0 +1,124 @@
+// src/iomap.c
+#include <stdint.h>
+#include <stddef.h>
+#include <carlos/iomap.h>
+#include <carlos/mm.h>
+#include <carlos/klog.h>
+
+#define IOMAP_DBG(...)  KLOG(KLOG_MOD_MM, KLOG_DBG,  __VA_ARGS__)
+#define IOMAP_ERR(...)  KLOG(KLOG_MOD_MM, KLOG_ERR,  __VA_ARGS__)
+
+// PML4 slot 384: a 512 GiB window nobody else uses
+#define IOMAP_BASE  MM_IOMAP_BASE
+#define IOMAP_LIMIT (IOMAP_BASE + (1ull << 39))
+
+#define IOMAP_MAX 32
+
+typedef struct {
+  uint64_t phys;   // page aligned
+  uint64_t len;
+  uint64_t va;
+  uint32_t flags;
+} IoMapping;
+
+static IoMapping g_maps[IOMAP_MAX];
+static uint32_t  g_nmaps = 0;
+static uint64_t  g_next_va = IOMAP_BASE;
+
+static uint64_t cache_bits(uint32_t flags)
+{
+  switch (flags) {
+    case IOMAP_WB:       return PTE_CACHE_WB;
+    case IOMAP_WC:       return PTE_CACHE_WC;
+    case IOMAP_UC_MINUS: return PTE_CACHE_UC_MIN;
+    default:             return PTE_CACHE_UC;
+  }
+}
+
+// New type for a whole window: its leaves and the direct map are rewritten
+// together, and everyone already holding a pointer into it sees the change.
+static int iomap_retype(IoMapping *m, uint32_t flags)
+{
+  uint64_t bits = cache_bits(flags);
+  if (mm_set_cache(m->va, m->len, bits) != 0) {
+    IOMAP_ERR("iomap: retype of va=0x%llx failed\n", (unsigned long long)m->va);
+    return -1;
+  }
+  if (mm_direct_set_cache(m->phys, m->len, bits) != 0)
+    IOMAP_ERR("iomap: direct map of phys=0x%llx len=0x%llx not retyped\n",
+              (unsigned long long)m->phys, (unsigned long long)m->len);
+
+  IOMAP_DBG("iomap: phys=0x%llx len=0x%llx flags %u -> %u\n",
+            (unsigned long long)m->phys, (unsigned long long)m->len, m->flags, flags);
+  m->flags = flags;
+  return 0;
+}
+
+void* iomap(uint64_t phys, size_t size, uint32_t flags)
+{
+  uint64_t cr3 = mm_kernel_cr3();
+  if (!cr3) return phys_to_ptr(phys);
+  if (size == 0) size = 1;
+
+  uint64_t off  = phys & (PAGE_SIZE - 1);
+  uint64_t base = phys - off;
+  uint64_t len  = page_align_up(off + size);
+
+  // One window per physical range, whatever its type: a second alias with
+  // another type would leave the range mapped two ways (SDM 11.12.4).
+  for (uint32_t i = 0; i < g_nmaps; i++) {
+    IoMapping *m = &g_maps[i];
+    if (base >= m->phys + m->len || base + len <= m->phys) continue;
+    if (base < m->phys || base + len > m->phys + m->len) {
+      IOMAP_ERR("iomap: phys=0x%llx len=0x%llx straddles window phys=0x%llx\n",
+                (unsigned long long)base, (unsigned long long)len,
+                (unsigned long long)m->phys);
+      return 0;
+    }
+    if (m->flags != flags && iomap_retype(m, flags) != 0) return 0;
+    return (void*)(uintptr_t)(m->va + (base - m->phys) + off);
+  }
+
+  if (g_nmaps == IOMAP_MAX) {
+    IOMAP_ERR("iomap: too many windows (phys=0x%llx)\n", (unsigned long long)phys);
+    return 0;
+  }
+
+  // Keep va and phys congruent mod 2 MiB so big windows get large pages.
+  uint64_t va = g_next_va;
+  if (len >= MM_PAGE_2M) {
+    va = (va + MM_PAGE_2M - 1) & ~(MM_PAGE_2M - 1);
+    va += base & (MM_PAGE_2M - 1);
+  }
+  if (va + len > IOMAP_LIMIT) {
+    IOMAP_ERR("iomap: window full (phys=0x%llx len=0x%llx)\n",
+              (unsigned long long)phys, (unsigned long long)len);
+    return 0;
+  }
+
+  if (mm_map(cr3, va, base, len, PTE_W | cache_bits(flags)) != 0) {
+    IOMAP_ERR("iomap: map failed phys=0x%llx len=0x%llx\n",
+              (unsigned long long)phys, (unsigned long long)len);
+    return 0;
+  }
+  g_next_va = va + len;
+
+  // the direct map covers the range too (it is WB there): match it
+  if (flags != IOMAP_WB && mm_direct_set_cache(base, len, cache_bits(flags)) != 0)
+    IOMAP_ERR("iomap: direct map of phys=0x%llx len=0x%llx keeps WB\n",
+              (unsigned long long)base, (unsigned long long)len);
+
+  g_maps[g_nmaps++] = (IoMapping){ .phys = base, .len = len, .va = va, .flags = flags };
+
+  IOMAP_DBG("iomap: phys=0x%llx len=0x%llx flags=%u -> 0x%llx\n",
+            (unsigned long long)base, (unsigned long long)len, flags,
+            (unsigned long long)va);
+  return (void*)(uintptr_t)(va + off);
+}
+
+void iomap_stats(IomapStats *st)
+{
+  if (!st) return;
+  st->maps = g_nmaps;
+  st->bytes = g_next_va - IOMAP_BASE;
+}
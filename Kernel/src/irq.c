@@ -2,6 +2,7 @@
 #include <carlos/isr.h>
 #include <carlos/pic.h>
 #include <carlos/intr.h>
+#include <carlos/lapic.h>
 
 // from intr.c
 void intr_dispatch_irq(int irq);
@@ -14,8 +15,11 @@ void irq_common_handler(IsrFrame *f){
   int irq = vec - IRQ_BASE_VEC;
 
   // dispatch handler (if any)
+  g_intr_nesting++;
   intr_dispatch_irq(irq);
+  g_intr_nesting--;
 
-  // EOI (PIC for now)
-  if (irq >= 0 && irq < 16) pic_eoi((uint8_t)irq);
+  // EOI: PIC for legacy IRQs, local APIC for MSI
+  if (irq >= 0 && irq < IRQ_LEGACY_COUNT) pic_eoi((uint8_t)irq);
+  else if (irq >= IRQ_LEGACY_COUNT && irq < IRQ_LEGACY_COUNT + IRQ_MSI_COUNT) lapic_eoi();
 }
\ No newline at end of file
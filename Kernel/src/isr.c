@@ -1,6 +1,8 @@
 #include <stdint.h>
 #include <carlos/isr.h>
+#include <carlos/intr.h>
 #include <carlos/klog.h>
+#include <carlos/mm.h>
 
 static volatile int g_panic = 0;
 
@@ -17,6 +19,20 @@ static void halt_forever(void){
 
 void isr_common_handler(IsrFrame *f)
 {
+  // Demand paging: a fault in app memory is resolved and the access retried.
+  // Filling may read the disk, so let interrupts in if the faulting code had
+  // them enabled. The stub saves only the GPRs; kernel C is built
+  // general-regs-only and mem.c keeps its vector paths out of traps.
+  if (f->vector == 14) {
+    uint64_t cr2 = rd_cr2();
+    g_intr_nesting++;
+    if (f->rflags & (1ull << 9)) __asm__ volatile ("sti");
+    int rc = mm_handle_fault(cr2, f->error);
+    __asm__ volatile ("cli");
+    g_intr_nesting--;
+    if (rc == 0) return;
+  }
+
   if (__atomic_exchange_n(&g_panic, 1, __ATOMIC_SEQ_CST)) {
     // if we re-enter, just return (don’t deadlock the system)
     return;
@@ -4,6 +4,10 @@
 #include <carlos/fs.h>     // <-- use FS only
 #include <carlos/str.h>
 #include <carlos/path.h>
+#include <carlos/karena.h>
+#include <carlos/kmem.h>
+#include <carlos/mm.h>
+#include <carlos/pcache.h>
 
 #define KAPI_FS_DEBUG 1
 #if KAPI_FS_DEBUG
@@ -15,6 +19,16 @@
 static Fs *g_kapi_fs = 0;
 static char g_kapi_cwd[128] = "/";
 
+// Scratch space for per-call temporaries (path building etc.).
+// Reset at the start of every call that uses it; never freed.
+static KArena *g_kapi_scratch = 0;
+
+static KArena* kapi_scratch(void){
+  if (!g_kapi_scratch) g_kapi_scratch = karena_create(0);
+  else                 karena_reset(g_kapi_scratch);
+  return g_kapi_scratch;
+}
+
 extern void carlos_kexit(int code);
 
 void kapi_bind_fs(Fs *fs){ g_kapi_fs = fs; }
@@ -43,7 +57,7 @@ void kapi_set_cwd(const char *cwd){
 
 static void* api_alloc_pages(size_t pages){
   if (pages != 1) return 0;
-  return pmm_alloc_page();
+  return pmm_alloc_zeroed_page();
 }
 
 static void api_free_pages(void *p, size_t pages){
@@ -74,27 +88,25 @@ static int kapi_list_cb(void *ud, const char name83[13], uint8_t attr, uint32_t
   return 0;
 }
 
-static s32 api_fs_listdir(const char *path, CarlosDirEnt *ents, u32 max_ents)
+// Resolve an app path (relative to the cwd) into a normalized absolute one
+// allocated from `scratch`.
+static int kapi_abs_path(KArena *scratch, const char *p, char **out)
 {
-  if (!g_kapi_fs || !ents || max_ents == 0) return -1;
-
-  const char *p = path;
-  if (!p || p[0] == 0 || (p[0] == '.' && p[1] == 0)) p = g_kapi_cwd;
-
-  // Build abs path
-  char abs[512];
+  const size_t abs_cap = 512;
+  char *abs = (char*)karena_alloc(scratch, abs_cap, 16);
+  if (!abs) return -3;
   const int is_abs = (p[0] == '/' || p[0] == '\\');
 
   if (is_abs) {
-    kstrncpy(abs, p, sizeof(abs)-1);
-    abs[sizeof(abs)-1] = 0;
+    kstrncpy(abs, p, abs_cap-1);
+    abs[abs_cap-1] = 0;
   } else {
     const char *cwd = (g_kapi_cwd[0] ? g_kapi_cwd : "/");
     size_t a = kstrlen(cwd);
     size_t b = kstrlen(p);
     if (a == 1 && cwd[0] == '/') a = 0;
 
-    if (1 + a + (a ? 1 : 0) + b + 1 > sizeof(abs)) return -2;
+    if (1 + a + (a ? 1 : 0) + b + 1 > abs_cap) return -2;
 
     size_t j = 0;
     abs[j++] = '/';
@@ -104,15 +116,126 @@ static s32 api_fs_listdir(const char *path, CarlosDirEnt *ents, u32 max_ents)
     abs[j] = 0;
   }
 
-  path_normalize_abs(abs, sizeof(abs));
+  path_normalize_abs(abs, abs_cap);
+  *out = abs;
+  return 0;
+}
+
+static s32 api_fs_listdir(const char *path, CarlosDirEnt *ents, u32 max_ents)
+{
+  if (!g_kapi_fs || !ents || max_ents == 0) return -1;
+
+  const char *p = path;
+  if (!p || p[0] == 0 || (p[0] == '.' && p[1] == 0)) p = g_kapi_cwd;
+
+  // Build abs path
+  KArena *scratch = kapi_scratch();
+  if (!scratch) return -3;
+  char *abs = 0;
+  int rc = kapi_abs_path(scratch, p, &abs);
+  if (rc != 0) return (s32)rc;
 
   ListCtx ctx = { .ents = ents, .max = max_ents, .n = 0 };
-  int rc = fs_listdir(g_kapi_fs, abs, kapi_list_cb, &ctx);
+  rc = fs_listdir(g_kapi_fs, abs, kapi_list_cb, &ctx);
   if (rc < 0) return (s32)rc;
 
   return (s32)ctx.n;
 }
 
+// ---- file mappings ----
+// Mappings go above the image, in the upper half of the app slot. Pages
+// come straight from the page cache: read-only mappings share its frames,
+// private ones get them copy-on-write.
+#define KAPI_MMAP_BASE (APP_SPACE_BASE + ((APP_SPACE_END - APP_SPACE_BASE) / 2))
+
+typedef struct {
+  PCacheFile *pf;
+  uint64_t    start;       // first va of the mapping
+  uint64_t    first;       // file page mapped at start
+  uint64_t    file_pages;
+} KapiMap;
+
+static int kapi_map_fill(void *ctx, uint64_t va, void *page, uint64_t *pte_flags)
+{
+  const KapiMap *m = (const KapiMap*)ctx;
+  uint64_t idx = m->first + (va - m->start) / PAGE_SIZE;
+  if (idx >= m->file_pages) return MM_FILL_ZERO;
+
+  uint64_t phys = pcache_page(m->pf, idx);
+  if (!phys) return -1;
+
+  if (page) {
+    __builtin_memcpy(page, phys_to_cptr(phys), PAGE_SIZE);
+    return 0;
+  }
+  *pte_flags |= phys;
+  return MM_FILL_SHARED;
+}
+
+static int kapi_map_probe(void *ctx, uint64_t va, uint64_t *pte_flags)
+{
+  const KapiMap *m = (const KapiMap*)ctx;
+  (void)pte_flags;
+  return (m->first + (va - m->start) / PAGE_SIZE >= m->file_pages) ? MM_FILL_ZERO : 0;
+}
+
+static void kapi_map_drop(void *ctx)
+{
+  KapiMap *m = (KapiMap*)ctx;
+  pcache_close(m->pf);
+  kfree(m);
+}
+
+static void* api_mmap(const char *path, u64 off, u64 len, u32 flags)
+{
+  MmSpace *as = mm_space_current();
+  if (!g_kapi_fs || !as || !path || !path[0] || len == 0) return 0;
+  if (off & (PAGE_SIZE - 1)) return 0;
+  if (flags != CARLOS_MAP_READ && flags != CARLOS_MAP_PRIVATE) return 0;
+
+  KArena *scratch = kapi_scratch();
+  if (!scratch) return 0;
+  char *abs = 0;
+  if (kapi_abs_path(scratch, path, &abs) != 0) return 0;
+
+  FsFile file;
+  if (fs_open(g_kapi_fs, abs, &file) != 0 || off >= file.size) return 0;
+
+  uint64_t size = page_align_up(len);
+  // large mappings start on a 2 MiB boundary: blocks past the end of the
+  // file can then take 2 MiB pages
+  uint64_t align = (size >= MM_PAGE_2M) ? MM_PAGE_2M : PAGE_SIZE;
+  uint64_t va = mm_space_find_gap(as, KAPI_MMAP_BASE, size, align);
+  if (!va) return 0;
+
+  KapiMap *m = (KapiMap*)kmalloc_tagged(sizeof(*m), "kapi-mmap");
+  if (!m) return 0;
+  *m = (KapiMap){ .pf = pcache_open(&file), .start = va, .first = off / PAGE_SIZE,
+                  .file_pages = page_align_up(file.size) / PAGE_SIZE };
+  if (!m->pf) {
+    kfree(m);
+    return 0;
+  }
+
+  uint64_t pte = (flags == CARLOS_MAP_PRIVATE) ? PTE_W : 0;
+  if (mm_space_add_vma(as, va, va + size, pte, kapi_map_fill, kapi_map_probe, kapi_map_drop, m) != 0) {
+    kapi_map_drop(m);
+    return 0;
+  }
+
+  KAPI_DBG("kapi: mmap %s off=%llu len=%llu -> 0x%llx\n", abs,
+           (unsigned long long)off, (unsigned long long)len, (unsigned long long)va);
+  return (void*)(uintptr_t)va;
+}
+
+static s32 api_munmap(void *addr, u64 len)
+{
+  MmSpace *as = mm_space_current();
+  uint64_t va = (uint64_t)(uintptr_t)addr;
+  if (!as || len == 0 || va < KAPI_MMAP_BASE) return -1;   // never the image
+  return (s32)mm_space_remove_vma(as, va, va + page_align_up(len));
+}
+
 const CarlosApi g_api = {
   .abi_version = CARLOS_ABI_VERSION,
   .write       = api_write,
@@ -120,4 +243,6 @@ const CarlosApi g_api = {
   .alloc_pages = api_alloc_pages,
   .free_pages  = api_free_pages,
   .fs_listdir  = api_fs_listdir,
+  .mmap        = api_mmap,
+  .munmap      = api_munmap,
 };
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <carlos/karena.h>
+#include <carlos/pmm.h>
+#include <carlos/phys.h>
+#include <carlos/klog.h>
+
+#define PAGE_SIZE 4096ULL
+
+// karena.c logging (runtime controlled by g_klog_level + g_klog_mask)
+#define ARENA_DBG(...)  KLOG(KLOG_MOD_KMEM, KLOG_DBG,  __VA_ARGS__)
+#define ARENA_WARN(...) KLOG(KLOG_MOD_KMEM, KLOG_WARN, __VA_ARGS__)
+
+/*
+  Every chunk starts with a KArenaChunk header; chunks are chained newest
+  first. The KArena itself lives in the first chunk, right after its
+  header, so creating an arena is a single PMM allocation and resetting
+  one touches no memory besides the header.
+
+  Requests that do not fit a regular chunk get a chunk of their own,
+  sized to fit.
+*/
+
+typedef struct KArenaChunk {
+  struct KArenaChunk *next;   // older chunk
+  uint64_t pages;
+} KArenaChunk;
+
+struct KArena {
+  KArenaChunk *cur;           // newest chunk (allocations come from here)
+  KArenaChunk *first;         // chunk holding this header
+  uint64_t used;              // offset of the next free byte in cur
+  uint64_t cap;               // size of cur in bytes
+  uint64_t chunk_pages;       // regular chunk size
+  uint64_t retired;           // bytes used in chunks older than cur
+};
+
+static inline uint64_t align_up_u64(uint64_t x, uint64_t a) {
+  return (x + a - 1) & ~(a - 1);
+}
+
+#define FIRST_DATA_OFF align_up_u64(sizeof(KArenaChunk) + sizeof(KArena), 16)
+#define CHUNK_DATA_OFF align_up_u64(sizeof(KArenaChunk), 16)
+
+static KArenaChunk* chunk_new(uint64_t pages){
+  uint64_t phys = pmm_alloc_contig_pages_phys(pages);
+  if (!phys) return 0;
+
+  KArenaChunk *c = (KArenaChunk*)phys_to_ptr(phys);
+  c->next  = 0;
+  c->pages = pages;
+  return c;
+}
+
+static void chunk_free(KArenaChunk *c){
+  pmm_free_contig_pages_phys(ptr_to_phys(c), c->pages);
+}
+
+KArena* karena_create(size_t chunk_bytes){
+  uint64_t pages = align_up_u64(chunk_bytes ? chunk_bytes : PAGE_SIZE, PAGE_SIZE) / PAGE_SIZE;
+
+  KArenaChunk *c = chunk_new(pages);
+  if (!c) return 0;
+
+  KArena *a = (KArena*)(c + 1);
+  a->cur         = c;
+  a->first       = c;
+  a->used        = FIRST_DATA_OFF;
+  a->cap         = pages * PAGE_SIZE;
+  a->chunk_pages = pages;
+  a->retired     = 0;
+  return a;
+}
+
+void* karena_alloc(KArena *a, size_t size, size_t align){
+  if (!a || size == 0) return 0;
+  if (align < 16) align = 16;
+  if (align & (align - 1)) return 0;
+
+  uint64_t off = align_up_u64(a->used, align);
+  if (off + size > a->cap) {
+    uint64_t need  = align_up_u64(CHUNK_DATA_OFF, align) + size;
+    uint64_t pages = align_up_u64(need, PAGE_SIZE) / PAGE_SIZE;
+    if (pages < a->chunk_pages) pages = a->chunk_pages;
+
+    KArenaChunk *c = chunk_new(pages);
+    if (!c) {
+      ARENA_WARN("arena: out of memory (size=%llu)\n", (unsigned long long)size);
+      return 0;
+    }
+
+    ARENA_DBG("arena: %p new chunk %p pages=%llu\n", a, c, (unsigned long long)pages);
+
+    a->retired += a->used;
+    c->next = a->cur;
+    a->cur  = c;
+    a->used = CHUNK_DATA_OFF;
+    a->cap  = pages * PAGE_SIZE;
+    off = align_up_u64(a->used, align);
+  }
+
+  a->used = off + size;
+  return (uint8_t*)a->cur + off;
+}
+
+void karena_reset(KArena *a){
+  if (!a) return;
+
+  KArenaChunk *c = a->cur;
+  while (c != a->first) {
+    KArenaChunk *next = c->next;
+    chunk_free(c);
+    c = next;
+  }
+
+  a->cur     = a->first;
+  a->used    = FIRST_DATA_OFF;
+  a->cap     = a->first->pages * PAGE_SIZE;
+  a->retired = 0;
+}
+
+void karena_destroy(KArena *a){
+  if (!a) return;
+  karena_reset(a);
+  chunk_free(a->first);
+}
+
+uint64_t karena_bytes_used(const KArena *a){
+  if (!a) return 0;
+  return a->retired + a->used;
+}
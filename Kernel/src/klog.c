@@ -291,6 +291,7 @@ static int klog_parse_mask_name(const char *s, uint32_t *out){
   if (kstreq(s, "core")  || kstreq(s, "KLOG_MOD_CORE"))  { *out = KLOG_MOD_CORE; return 0; }
   if (kstreq(s, "pmm")   || kstreq(s, "KLOG_MOD_PMM"))   { *out = KLOG_MOD_PMM;  return 0; }
   if (kstreq(s, "kmem")  || kstreq(s, "KLOG_MOD_KMEM"))  { *out = KLOG_MOD_KMEM; return 0; }
+  if (kstreq(s, "mm")    || kstreq(s, "KLOG_MOD_MM"))    { *out = KLOG_MOD_MM;   return 0; }
   if (kstreq(s, "exec")  || kstreq(s, "KLOG_MOD_EXEC"))  { *out = KLOG_MOD_EXEC; return 0; }
   if (kstreq(s, "fat")   || kstreq(s, "KLOG_MOD_FAT"))   { *out = KLOG_MOD_FAT;  return 0; }
   if (kstreq(s, "fs")    || kstreq(s, "KLOG_MOD_FS"))    { *out = KLOG_MOD_FS;   return 0; }
@@ -6,15 +6,20 @@
 
 #include <carlos/gdt.h>
 #include <carlos/idt.h>
+#include <carlos/mem.h>
 
 #include <carlos/acpi.h>
 #include <carlos/pci.h>
 
 #include <carlos/pmm.h>
+#include <carlos/mm.h>
+#include <carlos/iomap.h>
+#include <carlos/fbcon.h>
 #include <carlos/kmem.h>
 
 #include <carlos/intr.h>
 #include <carlos/pic.h>
+#include <carlos/lapic.h>
 
 #include <carlos/time.h>
 
@@ -136,6 +141,9 @@ void kmain(BootInfo *bi)
   idt_init();
   BOOT_PRINT("cpu: IDT: OK\n");
 
+  mem_init();
+  BOOT_PRINT("cpu: mem routines: %s\n", mem_impl_name());
+
   // ---------- bootinfo validation + snapshot ----------
   boot_validate_bootinfo(bi);
   boot_snapshot_bootinfo(bi);
@@ -155,6 +163,11 @@ void kmain(BootInfo *bi)
   pmm_init(g_bip);
   BOOT_PRINT("mm: PMM free pages=%llu\n", (unsigned long long)pmm_free_count());
 
+  // own page tables + direct map; on failure we keep running on the firmware's
+  rc = mm_init(g_bip);
+  BOOT_PRINT("mm: paging rc=%d cr3=0x%llx\n", rc, (unsigned long long)mm_kernel_cr3());
+  if (rc == 0 && fbcon_remap(IOMAP_WC) == 0) BOOT_PRINT("mm: framebuffer mapped WC\n");
+
   kmem_init();
   BOOT_PRINT("mm: heap: OK\n");
 
@@ -181,9 +194,13 @@ void kmain(BootInfo *bi)
   }
 
   // ---------- interrupts (PIC + IRQ stubs) ----------
-  intr_init();            // install IDT gates 0x20..0x2F
+  intr_init();            // install IDT gates 0x20..0x37
   pic_init(0x20, 0x28);   // remap PIC
 
+  // Local APIC only as the MSI target; legacy IRQs stay on the PIC
+  rc = lapic_init();
+  BOOT_PRINT("lapic: init rc=%d id=%u\n", rc, lapic_ready() ? lapic_id() : 0u);
+
   // Unmask what you want enabled initially
   pic_set_mask(0, 0);     // timer
   pic_set_mask(1, 0);     // keyboard
@@ -4,21 +4,366 @@
 #include <carlos/pmm.h>
 #include <carlos/phys.h>
 #include <carlos/klog.h>
+#include <carlos/str.h>
+#include <carlos/memacct.h>
+#include <carlos/shrinker.h>
 
 #define PAGE_SIZE 4096ULL
 
-// Simple bump-pointer kernel heap allocator (small allocs)
-// (not thread-safe, no freeing for small allocs yet)
-static uint64_t heap_phys_cur = 0;
-static uint64_t heap_phys_end = 0;
+// kmem.c logging (runtime controlled by g_klog_level + g_klog_mask)
+#define KMEM_DBG(...)  KLOG(KLOG_MOD_KMEM, KLOG_DBG,  __VA_ARGS__)
+#define KMEM_WARN(...) KLOG(KLOG_MOD_KMEM, KLOG_WARN, __VA_ARGS__)
 
 static inline uint64_t align_up_u64(uint64_t x, uint64_t a) {
   return (x + a - 1) & ~(a - 1);
 }
 
+/* ---------------- slab caches ---------------- */
+
+/*
+  Each slab is one page of objects, described by a KmemSlab. Caches of
+  small objects keep it at offset 0 of the page, before the objects; from
+  KMEM_OFF_SLAB_MIN bytes up it would cost whole objects (kmalloc-2048 would
+  hold one), so it is kmalloc'd separately and the page is all objects.
+  Either way the PMM keeps a pointer to it per page (pmm_page_priv).
+  Free objects are chained through their first word (LIFO), so the most
+  recently freed object is the next one handed out.
+
+  A cache keeps three slab lists: partial (some free objects), full and
+  empty. At most KMEM_KEEP_EMPTY empty slabs are kept around for reuse;
+  the rest go back to the PMM.
+*/
+
+#define KMEM_SLAB_MAGIC 0x42414C534D454B21ull /* "!KEMSLAB" */
+#define KMEM_KEEP_EMPTY 1
+#define KMEM_OFF_SLAB_MIN 512     // descriptor <= 64 bytes: never off-slab itself
+#define KMEM_SITE_FREE  0xFFFFu   // site[] of a free object
+
+typedef struct KmemSlab {
+  uint64_t magic;
+  KmemCache *cache;
+  struct KmemSlab *next;
+  struct KmemSlab *prev;
+  uint8_t *mem;       // the slab page
+  void    *free;      // LIFO list of free objects
+  uint32_t inuse;
+  uint32_t _pad;
+#if KMEM_ACCT
+  uint16_t site[];    // accounting site per object, KMEM_SITE_FREE if free
+#endif
+} KmemSlab;
+
+struct KmemCache {
+  const char *name;
+  uint32_t obj_size;    // rounded up to align
+  uint32_t align;
+  uint32_t first_off;   // offset of object 0 within the slab page
+  uint32_t per_slab;
+  uint8_t  off_slab;    // KmemSlab kmalloc'd, not at the page start
+
+  KmemSlab *partial;
+  KmemSlab *full;
+  KmemSlab *empty;
+  uint32_t  nr_empty;
+  uint32_t  nr_slabs;
+
+  uint64_t  allocs;
+  uint64_t  frees;
+
+  struct KmemCache *next_cache;   // registry (for stats / shrink)
+};
+
+static KmemCache *g_caches = 0;
+
+static void slab_unlink(KmemSlab **list, KmemSlab *s){
+  if (s->prev) s->prev->next = s->next;
+  else         *list = s->next;
+  if (s->next) s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+static void slab_push(KmemSlab **list, KmemSlab *s){
+  s->prev = 0;
+  s->next = *list;
+  if (*list) (*list)->prev = s;
+  *list = s;
+}
+
+static void cache_setup(KmemCache *c, const char *name, size_t obj_size, size_t align){
+  if (align < 16) align = 16;
+  if (obj_size < sizeof(void*)) obj_size = sizeof(void*);
+
+  *c = (KmemCache){0};
+  c->name      = name;
+  c->align     = (uint32_t)align;
+  c->obj_size  = (uint32_t)align_up_u64(obj_size, align);
+  if (c->obj_size >= KMEM_OFF_SLAB_MIN) {
+    c->off_slab  = 1;
+    c->first_off = 0;
+    c->per_slab  = (uint32_t)(PAGE_SIZE / c->obj_size);
+  } else {
+    c->first_off = (uint32_t)align_up_u64(sizeof(KmemSlab), align);
+    c->per_slab  = (uint32_t)((PAGE_SIZE - c->first_off) / c->obj_size);
+#if KMEM_ACCT
+    // make room for the per-object site array behind the header
+    while (c->per_slab) {
+      c->first_off = (uint32_t)align_up_u64(sizeof(KmemSlab) + c->per_slab * sizeof(uint16_t), align);
+      if (c->first_off + (uint64_t)c->per_slab * c->obj_size <= PAGE_SIZE) break;
+      c->per_slab--;
+    }
+#endif
+  }
+
+  c->next_cache = g_caches;
+  g_caches = c;
+}
+
+static inline uint32_t obj_index(const KmemCache *c, const KmemSlab *s, const void *obj){
+  return (uint32_t)(((const uint8_t*)obj - s->mem - c->first_off) / c->obj_size);
+}
+
+static KmemSlab* slab_new(KmemCache *c){
+  uint64_t phys = pmm_alloc_page_phys();
+  if (!phys) return 0;
+
+  KmemSlab *s = (KmemSlab*)phys_to_ptr(phys);
+  if (c->off_slab) {
+    size_t sz = sizeof(KmemSlab);
+#if KMEM_ACCT
+    sz += c->per_slab * sizeof(uint16_t);
+#endif
+    s = (KmemSlab*)kmalloc_tagged(sz, "kmem-slab");
+    if (!s) {
+      pmm_free_page_phys(phys);
+      return 0;
+    }
+  }
+  *s = (KmemSlab){0};
+  s->magic = KMEM_SLAB_MAGIC;
+  s->cache = c;
+  s->mem   = (uint8_t*)phys_to_ptr(phys);
+#if KMEM_ACCT
+  for (uint32_t i = 0; i < c->per_slab; i++) s->site[i] = KMEM_SITE_FREE;
+#endif
+  pmm_set_page_priv(phys, s);
+
+  // chain objects so that object 0 is handed out first
+  uint8_t *base = s->mem + c->first_off;
+  void *head = 0;
+  for (uint32_t i = c->per_slab; i > 0; i--){
+    void *obj = base + (uint64_t)(i - 1) * c->obj_size;
+    *(void**)obj = head;
+    head = obj;
+  }
+  s->free = head;
+
+  c->nr_slabs++;
+  KMEM_DBG("kmem: %s new slab %p (%u objs)\n", c->name, s, c->per_slab);
+  return s;
+}
+
+static void slab_release(KmemCache *c, KmemSlab *s){
+  uint8_t *mem = s->mem;
+  s->magic = 0;
+  c->nr_slabs--;
+  if (c->off_slab) kfree(s);
+  pmm_free_page(mem);
+}
+
+KmemCache* kmem_cache_create(const char *name, size_t obj_size, size_t align){
+  if (obj_size == 0 || (align & (align - 1)) != 0) return 0;
+
+  KmemCache *c = (KmemCache*)kmalloc(sizeof(KmemCache));
+  if (!c) return 0;
+
+  cache_setup(c, name, obj_size, align);
+  if (c->per_slab == 0) {
+    // object does not fit in a single-page slab
+    g_caches = c->next_cache;
+    kfree(c);
+    return 0;
+  }
+  return c;
+}
+
+static void* cache_alloc(KmemCache *c, uint16_t site){
+
+  KmemSlab *s = c->partial;
+  if (!s) {
+    s = c->empty;
+    if (s) {
+      slab_unlink(&c->empty, s);
+      c->nr_empty--;
+    } else {
+      s = slab_new(c);
+      if (!s) return 0;
+    }
+    slab_push(&c->partial, s);
+  }
+
+  void *obj = s->free;
+  s->free = *(void**)obj;
+  s->inuse++;
+  c->allocs++;
+
+  if (!s->free) {
+    slab_unlink(&c->partial, s);
+    slab_push(&c->full, s);
+  }
+
+#if KMEM_ACCT
+  s->site[obj_index(c, s, obj)] = site;
+#endif
+  memacct_alloc(site, c->obj_size);
+  return obj;
+}
+
+void* kmem_cache_alloc(KmemCache *c){
+  if (!c) return 0;
+  return cache_alloc(c, memacct_site(MEMACCT_KMALLOC, MEMACCT_CALLER(), c->name));
+}
+
+static KmemSlab* slab_of(const void *p){
+  uint64_t page = (uint64_t)(uintptr_t)p & ~(PAGE_SIZE - 1);
+  KmemSlab *s = (KmemSlab*)pmm_page_priv(ptr_to_phys((void*)(uintptr_t)page));
+  if (!s || s->magic != KMEM_SLAB_MAGIC) return 0;
+  return s;
+}
+
+// pmm refuses to free a page twice; do the same for objects
+static int obj_is_free(const KmemCache *c, const KmemSlab *s, const void *obj){
+#if KMEM_ACCT
+  return s->site[obj_index(c, s, obj)] == KMEM_SITE_FREE;
+#else
+  (void)c;
+  for (const void *f = s->free; f; f = *(void *const *)f)
+    if (f == obj) return 1;
+  return 0;
+#endif
+}
+
+static void slab_free_obj(KmemSlab *s, void *obj){
+  KmemCache *c = s->cache;
+
+  uint64_t off = (uint64_t)((uint8_t*)obj - s->mem);
+  if (off < c->first_off || ((off - c->first_off) % c->obj_size) != 0 ||
+      off - c->first_off >= (uint64_t)c->per_slab * c->obj_size) {
+    KMEM_WARN("kmem: %s bad free %p\n", c->name, obj);
+    return;
+  }
+  if (obj_is_free(c, s, obj)) {
+    KMEM_WARN("kmem: %s double free %p\n", c->name, obj);
+    return;
+  }
+
+#if KMEM_ACCT
+  uint32_t i = obj_index(c, s, obj);
+  memacct_free(s->site[i], c->obj_size);
+  s->site[i] = KMEM_SITE_FREE;
+#endif
+
+  int was_full = (s->free == 0);
+
+  *(void**)obj = s->free;
+  s->free = obj;
+  s->inuse--;
+  c->frees++;
+
+  if (was_full) {
+    slab_unlink(&c->full, s);
+    slab_push(&c->partial, s);
+  } else if (s != c->partial) {
+    // keep the slab we just freed into at the head (warm objects first)
+    slab_unlink(&c->partial, s);
+    slab_push(&c->partial, s);
+  }
+
+  if (s->inuse == 0) {
+    slab_unlink(&c->partial, s);
+    if (c->nr_empty < KMEM_KEEP_EMPTY) {
+      slab_push(&c->empty, s);
+      c->nr_empty++;
+    } else {
+      slab_release(c, s);
+    }
+  }
+}
+
+void kmem_cache_free(KmemCache *c, void *obj){
+  if (!c || !obj) return;
+
+  KmemSlab *s = slab_of(obj);
+  if (!s || s->cache != c) {
+    KMEM_WARN("kmem: %s free of foreign object %p\n", c ? c->name : "?", obj);
+    return;
+  }
+  slab_free_obj(s, obj);
+}
+
+uint64_t kmem_cache_shrink(KmemCache *c){
+  if (!c) return 0;
+
+  uint64_t n = 0;
+  while (c->empty) {
+    KmemSlab *s = c->empty;
+    slab_unlink(&c->empty, s);
+    c->nr_empty--;
+    slab_release(c, s);
+    n++;
+  }
+  return n;
+}
+
+// Shrinker: release the empty slabs every cache keeps for reuse.
+static uint64_t slab_shrink(void *ctx, uint64_t nr_pages){
+  (void)ctx;
+  uint64_t n = 0;
+  for (KmemCache *c = g_caches; c && n < nr_pages; c = c->next_cache){
+    n += kmem_cache_shrink(c);
+  }
+  return n;
+}
+
+static Shrinker g_slab_shrinker = {
+  .name = "slab-empty", .scan = slab_shrink, .priority = SHRINK_PRIO_SLAB,
+};
+
+void kmem_dump_caches(void){
+  kputs("cache            objsz  slabs  allocs    frees\n");
+  for (KmemCache *c = g_caches; c; c = c->next_cache){
+    kprintf("  %s", c->name);
+    for (size_t i = kstrlen(c->name); i < 15; i++) kputc(' ');
+    kprintf("%u  %u  %llu  %llu\n",
+            c->obj_size, c->nr_slabs,
+            (unsigned long long)c->allocs, (unsigned long long)c->frees);
+  }
+}
+
+/* ---------------- kmalloc size classes ---------------- */
+
+#define KMALLOC_NR_CLASSES 8   // 16, 32, ..., 2048
+#define KMALLOC_SMALL_MAX  2048
+
+static KmemCache g_kmalloc_cache[KMALLOC_NR_CLASSES];
+static const char *const g_kmalloc_names[KMALLOC_NR_CLASSES] = {
+  "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+  "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+};
+static int g_kmem_ready = 0;
+
 void kmem_init(void) {
-  heap_phys_cur = 0;
-  heap_phys_end = 0;
+  g_caches = 0;
+  for (int i = KMALLOC_NR_CLASSES - 1; i >= 0; i--) {
+    cache_setup(&g_kmalloc_cache[i], g_kmalloc_names[i], (size_t)16 << i, 16);
+  }
+  g_kmem_ready = 1;
+  shrinker_register(&g_slab_shrinker);
+}
+
+static inline int kmalloc_class(size_t size){
+  int i = 0;
+  while (((size_t)16 << i) < size) i++;
+  return i;
 }
 
 /* ---------------- BIG allocations (page-backed, freeable) ---------------- */
@@ -28,12 +373,12 @@ void kmem_init(void) {
 typedef struct __attribute__((packed)) {
   uint64_t magic;
   uint32_t pages;
-  uint32_t _pad0;
+  uint32_t site;        // accounting site
   uint64_t base_phys;   // page-aligned physical base returned by PMM
   uint64_t _pad1;       // keep header 32B
 } KmallocBigHdr;
 
-static void* kmalloc_big(size_t size) {
+static void* kmalloc_big(size_t size, uint16_t site) {
   uint64_t total = (uint64_t)size + (uint64_t)sizeof(KmallocBigHdr);
   uint64_t pages = (total + (PAGE_SIZE - 1)) / PAGE_SIZE;
   if (pages == 0) return 0;
@@ -46,39 +391,36 @@ static void* kmalloc_big(size_t size) {
   KmallocBigHdr *h = (KmallocBigHdr*)base;
   h->magic    = KMALLOC_BIG_MAGIC;
   h->pages    = (uint32_t)pages;
-  h->_pad0    = 0;
+  h->site     = site;
   h->base_phys= base_phys;
   h->_pad1    = 0;
 
+  memacct_alloc(site, pages * PAGE_SIZE);
+
   return (void*)(base + sizeof(KmallocBigHdr));
 }
 
 /* ---------------- kmalloc ---------------- */
 
-void* kmalloc(size_t size) {
+static void* kmalloc_site(size_t size, uint16_t site) {
   if (size == 0) return 0;
 
   // BIG allocation: go to PMM contiguous allocator, and make it freeable
-  if (size > (PAGE_SIZE - 32)) {
-    // optional debug (you already had something similar)
-    // kprintf("kmalloc BIG: size=%u\n", (unsigned)size);
-    return kmalloc_big(size);
+  if (size > KMALLOC_SMALL_MAX) {
+    return kmalloc_big(size, site);
   }
 
-  // SMALL allocation: bump within a single page (no free yet)
-  if (heap_phys_cur == 0 || align_up_u64(heap_phys_cur, 16) + size > heap_phys_end) {
-    uint64_t page_phys = pmm_alloc_page_phys();
-    if (!page_phys) return 0;
-
-    heap_phys_cur = page_phys;
-    heap_phys_end = page_phys + PAGE_SIZE;
-  }
+  // SMALL allocation: size-class slab
+  if (!g_kmem_ready) kmem_init();
+  return cache_alloc(&g_kmalloc_cache[kmalloc_class(size)], site);
+}
 
-  uint64_t cur  = align_up_u64(heap_phys_cur, 16);
-  uint64_t next = cur + (uint64_t)size;
+void* kmalloc(size_t size) {
+  return kmalloc_site(size, memacct_site(MEMACCT_KMALLOC, MEMACCT_CALLER(), 0));
+}
 
-  heap_phys_cur = next;
-  return phys_to_ptr(cur);
+void* kmalloc_tagged(size_t size, const char *tag) {
+  return kmalloc_site(size, memacct_site(MEMACCT_KMALLOC, MEMACCT_CALLER(), tag));
 }
 
 /* ---------------- kfree ---------------- */
@@ -86,12 +428,89 @@ void* kmalloc(size_t size) {
 void kfree(void *p) {
   if (!p) return;
 
+  uint8_t *u = (uint8_t*)p;
+
+  // Page-backed allocations always sit right after a header at the page start,
+  // slab objects never do (offset 0 of a slab page is the KmemSlab header).
+  KmallocBigHdr *h = (KmallocBigHdr*)(u - sizeof(KmallocBigHdr));
+  if (((uint64_t)(uintptr_t)h & (PAGE_SIZE - 1)) == 0 && h->magic == KMALLOC_BIG_MAGIC) {
+    if (h->pages == 0) return;
+    if (h->base_phys == 0) return;
+    h->magic = 0;
+    memacct_free((uint16_t)h->site, (uint64_t)h->pages * PAGE_SIZE);
+    pmm_free_contig_pages_phys(h->base_phys, (uint64_t)h->pages);
+    return;
+  }
+
+  KmemSlab *s = slab_of(p);
+  if (s) {
+    slab_free_obj(s, p);
+    return;
+  }
+
+  KMEM_WARN("kmem: kfree of unknown pointer %p\n", p);
+}
+
+/* ---------- krealloc ---------- */
+
+static inline void memcp(void *d, const void *s, size_t n){ __builtin_memcpy(d, s, n); }
+
+static void* realloc_big(KmallocBigHdr *h, void *p, size_t size){
+  uint64_t need = ((uint64_t)size + sizeof(KmallocBigHdr) + (PAGE_SIZE - 1)) / PAGE_SIZE;
+  uint64_t have = h->pages;
+
+  if (need <= have) {
+    // shrink in place; give whole tail pages back
+    if (need < have && size > KMALLOC_SMALL_MAX) {
+      pmm_free_contig_pages_phys(h->base_phys + need * PAGE_SIZE, have - need);
+      memacct_resize((uint16_t)h->site, have * PAGE_SIZE, need * PAGE_SIZE);
+      h->pages = (uint32_t)need;
+    }
+    if (size > KMALLOC_SMALL_MAX) return p;
+  } else if (pmm_claim_pages_phys(h->base_phys + have * PAGE_SIZE, need - have) == 0) {
+    // grow in place by taking the physically adjacent free pages
+    memacct_resize((uint16_t)h->site, have * PAGE_SIZE, need * PAGE_SIZE);
+    h->pages = (uint32_t)need;
+    return p;
+  }
+
+  void *np = kmalloc_site(size, (uint16_t)h->site);
+  if (!np) return 0;
+
+  uint64_t old_sz = have * PAGE_SIZE - sizeof(KmallocBigHdr);
+  memcp(np, p, (size_t)(old_sz < size ? old_sz : size));
+  kfree(p);
+  return np;
+}
+
+void* krealloc(void *p, size_t size) {
+  if (!p) return kmalloc_site(size, memacct_site(MEMACCT_KMALLOC, MEMACCT_CALLER(), 0));
+  if (size == 0) { kfree(p); return 0; }
+
   uint8_t *u = (uint8_t*)p;
   KmallocBigHdr *h = (KmallocBigHdr*)(u - sizeof(KmallocBigHdr));
+  if (((uint64_t)(uintptr_t)h & (PAGE_SIZE - 1)) == 0 && h->magic == KMALLOC_BIG_MAGIC) {
+    return realloc_big(h, p, size);
+  }
 
-  if (h->magic != KMALLOC_BIG_MAGIC) return;
-  if (h->pages == 0) return;
-  if (h->base_phys == 0) return;
+  KmemSlab *s = slab_of(p);
+  if (!s) {
+    KMEM_WARN("kmem: krealloc of unknown pointer %p\n", p);
+    return 0;
+  }
 
-  pmm_free_contig_pages_phys(h->base_phys, (uint64_t)h->pages);
-}
\ No newline at end of file
+  // stay put if the object still fits and the class is not oversized
+  KmemCache *c = s->cache;
+  if (size <= c->obj_size && (size > c->obj_size / 2 || c->obj_size == 16)) return p;
+
+  uint16_t site = MEMACCT_KMALLOC;
+#if KMEM_ACCT
+  site = s->site[obj_index(c, s, p)];
+#endif
+
+  void *np = kmalloc_site(size, site);
+  if (!np) return 0;
+  memcp(np, p, size < c->obj_size ? size : c->obj_size);
+  slab_free_obj(s, p);
+  return np;
+}
@@ -0,0 +1,64 @@
+// src/lapic.c
+#include <stdint.h>
+#include <carlos/lapic.h>
+#include <carlos/iomap.h>
+#include <carlos/mmio.h>
+#include <carlos/idt.h>
+#include <carlos/klog.h>
+
+#define MSR_IA32_APIC_BASE  0x1B
+#define APIC_BASE_X2APIC    (1ull << 10)
+#define APIC_BASE_ENABLE    (1ull << 11)
+
+enum {
+  LAPIC_ID  = 0x20,
+  LAPIC_EOI = 0xB0,
+  LAPIC_SVR = 0xF0,
+};
+
+#define LAPIC_SVR_ENABLE  (1u << 8)
+#define LAPIC_SPURIOUS    0xFF
+
+extern void irq_spurious(void);
+
+static volatile uint8_t *g_lapic = 0;
+
+static inline uint64_t rdmsr(uint32_t msr){
+  uint32_t lo, hi;
+  __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+int lapic_init(void){
+  if (g_lapic) return 0;
+
+  uint64_t base = rdmsr(MSR_IA32_APIC_BASE);
+  if (!(base & APIC_BASE_ENABLE)) return -1;   // globally disabled: leave it
+  // x2APIC mode ignores the MMIO page (EOI would go nowhere); callers
+  // fall back to the PIC
+  if (base & APIC_BASE_X2APIC) return -3;
+
+  volatile uint8_t *l = (volatile uint8_t*)iomap(base & 0x000FFFFFFFFFF000ull, 4096, IOMAP_UC);
+  if (!l) return -2;
+
+  // Software-enable (firmware usually has already) and point spurious
+  // interrupts at a stub that just returns
+  idt_set_gate(LAPIC_SPURIOUS, irq_spurious, IDT_TYPE_INTGATE, 0);
+  uint32_t svr = mmio_read32(l + LAPIC_SVR);
+  mmio_write32(l + LAPIC_SVR, (svr & ~0xFFu) | LAPIC_SVR_ENABLE | LAPIC_SPURIOUS);
+
+  g_lapic = l;
+  return 0;
+}
+
+int lapic_ready(void){
+  return g_lapic != 0;
+}
+
+uint32_t lapic_id(void){
+  return g_lapic ? (mmio_read32(g_lapic + LAPIC_ID) >> 24) : 0;
+}
+
+void lapic_eoi(void){
+  if (g_lapic) mmio_write32(g_lapic + LAPIC_EOI, 0);
+}
@@ -1,16 +1,330 @@
 // src/mem.c
 #include <stddef.h>
 #include <stdint.h>
+#include <carlos/mem.h>
+#include <carlos/intr.h>
+#include <carlos/klog.h>
 
-void *memset(void *dst, int c, size_t n){
-  uint8_t *p = (uint8_t*)dst;
-  for (size_t i = 0; i < n; i++) p[i] = (uint8_t)c;
+#define MEM_INFO(...) KLOG(KLOG_MOD_CORE, KLOG_INFO, __VA_ARGS__)
+
+/*
+  Runs shorter than one SSE vector are done with (overlapping) scalar moves.
+  Longer ones use the vector loops in mem_s.S, AVX2 when the CPU and XCR0
+  allow it. With ERMS, copies and fills of MEM_REP_MIN bytes and up go to
+  rep movsb / rep stosb, which the CPU runs at full line width.
+  Inside trap handlers only string instructions are used: the stubs save
+  no SSE/AVX state, so the vector registers still hold the interrupted
+  code's values. This guard covers only the mem_s.S routines; the rest of
+  the kernel stays off those registers by being built -mgeneral-regs-only.
+
+  Copies and fills of g_mem_nt_min bytes and up (half the last-level cache)
+  would only push out everything else, so they bypass the caches with
+  non-temporal stores, like memcpy_nt/memset_nt do for any size.
+*/
+
+#define MEM_REP_MIN 2048
+#define MEM_NT_RUN  128                // below this the _nt calls just store
+#define MEM_NT_MIN_DEFAULT (1ull << 20)
+
+#define CR4_OSXSAVE (1ull << 18)
+#define XCR0_YMM    0x6ull   // SSE | AVX state
+
+// mem_s.S, n >= 16 (sse2) / 32 (avx2)
+void mem_copy_sse2(void *dst, const void *src, size_t n);
+void mem_copy_back_sse2(void *dst, const void *src, size_t n);
+void mem_set_sse2(void *dst, int c, size_t n);
+int  mem_cmp_sse2(const void *a, const void *b, size_t n);
+void mem_copy_avx2(void *dst, const void *src, size_t n);
+void mem_copy_back_avx2(void *dst, const void *src, size_t n);
+void mem_set_avx2(void *dst, int c, size_t n);
+int  mem_cmp_avx2(const void *a, const void *b, size_t n);
+void mem_copy_nt_sse2(void *dst, const void *src, size_t n);
+void mem_set_nt_sse2(void *dst, uint64_t pattern, size_t n);
+void mem_copy_nti(void *dst, const void *src, size_t n);
+void mem_set_nti(void *dst, uint64_t pattern, size_t n);
+
+static uint8_t  g_mem_avx2 = 0;
+static uint8_t  g_mem_erms = 0;
+static uint64_t g_mem_nt_min = MEM_NT_MIN_DEFAULT;
+
+static inline void rep_movsb(void *d, const void *s, size_t n){
+  __asm__ volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(n) :: "memory");
+}
+
+// from the last byte down, for dst above an overlapping src
+static inline void rep_movsb_back(void *d, const void *s, size_t n){
+  uint8_t *dl = (uint8_t*)d + n - 1;
+  const uint8_t *sl = (const uint8_t*)s + n - 1;
+  __asm__ volatile ("std; rep movsb; cld" : "+D"(dl), "+S"(sl), "+c"(n) :: "memory");
+}
+
+static inline void rep_stosb(void *d, int c, size_t n){
+  __asm__ volatile ("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+}
+
+// n < 16; every load happens before the first store, so overlap is fine
+static inline void copy_small(uint8_t *d, const uint8_t *s, size_t n)
+{
+  if (n >= 8) {
+    uint64_t a, b;
+    __builtin_memcpy(&a, s, 8);
+    __builtin_memcpy(&b, s + n - 8, 8);
+    __builtin_memcpy(d, &a, 8);
+    __builtin_memcpy(d + n - 8, &b, 8);
+  } else if (n >= 4) {
+    uint32_t a, b;
+    __builtin_memcpy(&a, s, 4);
+    __builtin_memcpy(&b, s + n - 4, 4);
+    __builtin_memcpy(d, &a, 4);
+    __builtin_memcpy(d + n - 4, &b, 4);
+  } else if (n) {
+    uint8_t a = s[0], b = s[n / 2], c = s[n - 1];
+    d[0] = a;
+    d[n / 2] = b;
+    d[n - 1] = c;
+  }
+}
+
+static inline void set_small(uint8_t *d, uint8_t c, size_t n)
+{
+  uint64_t v = 0x0101010101010101ull * c;
+  if (n >= 8) {
+    __builtin_memcpy(d, &v, 8);
+    __builtin_memcpy(d + n - 8, &v, 8);
+  } else if (n >= 4) {
+    __builtin_memcpy(d, &v, 4);
+    __builtin_memcpy(d + n - 4, &v, 4);
+  } else if (n) {
+    d[0] = c;
+    d[n / 2] = c;
+    d[n - 1] = c;
+  }
+}
+
+static inline void sfence(void){
+  __asm__ volatile ("sfence" ::: "memory");
+}
+
+// forward copy; also right for dst below an overlapping src
+static inline void copy_cached(uint8_t *d, const uint8_t *s, size_t n)
+{
+  if (n < 16)                                                  copy_small(d, s, n);
+  else if (intr_in_trap() || (g_mem_erms && n >= MEM_REP_MIN)) rep_movsb(d, s, n);
+  else if (g_mem_avx2 && n >= 32)                              mem_copy_avx2(d, s, n);
+  else                                                         mem_copy_sse2(d, s, n);
+}
+
+static inline void set_cached(uint8_t *d, int c, size_t n)
+{
+  if (n < 16)                                                  set_small(d, (uint8_t)c, n);
+  else if (intr_in_trap() || (g_mem_erms && n >= MEM_REP_MIN)) rep_stosb(d, c, n);
+  else if (g_mem_avx2 && n >= 32)                              mem_set_avx2(d, c, n);
+  else                                                         mem_set_sse2(d, c, n);
+}
+
+// Unaligned head and the tail go through the cache, whole 64-byte blocks
+// around it. Blocks are loaded before they are stored, so dst below an
+// overlapping src is fine too.
+static void copy_nt(uint8_t *d, const uint8_t *s, size_t n)
+{
+  size_t head = (size_t)(-(uintptr_t)d & 15);
+  copy_cached(d, s, head);
+  d += head; s += head; n -= head;
+
+  size_t bulk = n & ~(size_t)63;
+  if (intr_in_trap()) mem_copy_nti(d, s, bulk);
+  else                mem_copy_nt_sse2(d, s, bulk);
+  copy_cached(d + bulk, s + bulk, n - bulk);
+  sfence();
+}
+
+// `pattern` repeats every 8 bytes, phase taken from the address
+static void set_nt(uint8_t *d, uint64_t pattern, size_t n)
+{
+  size_t head = (size_t)(-(uintptr_t)d & 15);
+  for (size_t i = 0; i < head; i++) d[i] = (uint8_t)(pattern >> (8 * (((uintptr_t)d + i) & 7)));
+  d += head; n -= head;
+
+  size_t bulk = n & ~(size_t)63;
+  if (intr_in_trap()) mem_set_nti(d, pattern, bulk);
+  else                mem_set_nt_sse2(d, pattern, bulk);
+  for (size_t i = bulk; i < n; i++) d[i] = (uint8_t)(pattern >> (8 * (((uintptr_t)d + i) & 7)));
+  sfence();
+}
+
+static inline void copy_fwd(uint8_t *d, const uint8_t *s, size_t n)
+{
+  if (n >= g_mem_nt_min) copy_nt(d, s, n);
+  else                   copy_cached(d, s, n);
+}
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+  copy_fwd((uint8_t*)dst, (const uint8_t*)src, n);
   return dst;
 }
 
-void *memcpy(void *dst, const void *src, size_t n){
+void *memmove(void *dst, const void *src, size_t n)
+{
   uint8_t *d = (uint8_t*)dst;
   const uint8_t *s = (const uint8_t*)src;
-  for (size_t i = 0; i < n; i++) d[i] = s[i];
+
+  // dst below src, or no overlap at all
+  if ((uintptr_t)d - (uintptr_t)s >= n) {
+    copy_fwd(d, s, n);
+    return dst;
+  }
+
+  if (n < 16)                     copy_small(d, s, n);
+  else if (intr_in_trap())        rep_movsb_back(d, s, n);
+  else if (g_mem_avx2 && n >= 32) mem_copy_back_avx2(d, s, n);
+  else                            mem_copy_back_sse2(d, s, n);
+  return dst;
+}
+
+void *memset(void *dst, int c, size_t n)
+{
+  if (n >= g_mem_nt_min) set_nt((uint8_t*)dst, 0x0101010101010101ull * (uint8_t)c, n);
+  else                   set_cached((uint8_t*)dst, c, n);
   return dst;
-}
\ No newline at end of file
+}
+
+void *memcpy_nt(void *dst, const void *src, size_t n)
+{
+  if (n < MEM_NT_RUN) copy_cached((uint8_t*)dst, (const uint8_t*)src, n);
+  else                copy_nt((uint8_t*)dst, (const uint8_t*)src, n);
+  return dst;
+}
+
+void *memset_nt(void *dst, int c, size_t n)
+{
+  if (n < MEM_NT_RUN) set_cached((uint8_t*)dst, c, n);
+  else                set_nt((uint8_t*)dst, 0x0101010101010101ull * (uint8_t)c, n);
+  return dst;
+}
+
+void *memset32_nt(void *dst, uint32_t v, size_t count)
+{
+  uint32_t *d = (uint32_t*)dst;
+  if (count * 4 < MEM_NT_RUN) {
+    for (size_t i = 0; i < count; i++) d[i] = v;
+    return dst;
+  }
+  set_nt((uint8_t*)dst, ((uint64_t)v << 32) | v, count * 4);
+  return dst;
+}
+
+int memcmp(const void *a, const void *b, size_t n)
+{
+  const uint8_t *p = (const uint8_t*)a;
+  const uint8_t *q = (const uint8_t*)b;
+
+  if (n >= 16 && !intr_in_trap()) {
+    if (g_mem_avx2 && n >= 32) return mem_cmp_avx2(p, q, n);
+    return mem_cmp_sse2(p, q, n);
+  }
+
+  for (; n >= 8; p += 8, q += 8, n -= 8) {
+    uint64_t x, y;
+    __builtin_memcpy(&x, p, 8);
+    __builtin_memcpy(&y, q, 8);
+    // big-endian order compares like the bytes do
+    if (x != y) return (__builtin_bswap64(x) < __builtin_bswap64(y)) ? -1 : 1;
+  }
+  for (; n; p++, q++, n--)
+    if (*p != *q) return (int)*p - (int)*q;
+  return 0;
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t sub, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d){
+  __asm__ volatile ("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(sub));
+}
+
+static inline uint64_t xgetbv0(void){
+  uint32_t lo, hi;
+  __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void xsetbv0(uint64_t v){
+  __asm__ volatile ("xsetbv" :: "c"(0), "a"((uint32_t)v), "d"((uint32_t)(v >> 32)) : "memory");
+}
+
+// Turn on the YMM register state if the CPU has it. Nothing switches
+// register state between tasks, so enabling it is all AVX needs.
+static int avx_state_init(void)
+{
+  uint32_t a, b, c, d;
+  cpuid(1, 0, &a, &b, &c, &d);
+  if (!((c >> 26) & 1) || !((c >> 28) & 1)) return 0;   // XSAVE, AVX
+  int osxsave = (c >> 27) & 1;
+
+  cpuid(0xD, 0, &a, &b, &c, &d);
+  if ((a & XCR0_YMM) != XCR0_YMM) return 0;
+
+  // CPUID reflects CR4.OSXSAVE; checking it first keeps the CR4 access out
+  // of the host build of the benchmarks, which runs this in user mode
+  if (!osxsave) {
+    uint64_t cr4;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    __asm__ volatile ("mov %0, %%cr4" :: "r"(cr4 | CR4_OSXSAVE) : "memory");
+  }
+
+  uint64_t xcr0 = xgetbv0();
+  if ((xcr0 & XCR0_YMM) != XCR0_YMM) xsetbv0(xcr0 | XCR0_YMM | 1);
+  return (xgetbv0() & XCR0_YMM) == XCR0_YMM;
+}
+
+// Largest cache from the deterministic cache parameters (leaf 4 on Intel,
+// 0x8000001D on AMD), 0 if the CPU doesn't report them.
+static uint64_t cache_top_bytes(void)
+{
+  uint32_t a, b, c, d, max;
+  uint64_t best = 0;
+  cpuid(0, 0, &max, &b, &c, &d);
+  uint32_t leaf = 4;
+
+  for (int pass = 0; pass < 2 && !best; pass++) {
+    if (pass == 1) {
+      cpuid(0x80000000u, 0, &max, &b, &c, &d);
+      leaf = 0x8000001Du;
+    }
+    if (max < leaf) continue;
+    for (uint32_t sub = 0; sub < 16; sub++) {
+      cpuid(leaf, sub, &a, &b, &c, &d);
+      if ((a & 31) == 0) break;
+      uint64_t bytes = (uint64_t)((b >> 22) + 1) * (((b >> 12) & 0x3ff) + 1) *
+                       ((b & 0xfff) + 1) * ((uint64_t)c + 1);
+      if (bytes > best) best = bytes;
+    }
+  }
+  return best;
+}
+
+void mem_init(void)
+{
+  uint32_t a, b, c, d;
+  uint64_t llc = cache_top_bytes();
+  if (llc >= (512ull << 10)) g_mem_nt_min = llc / 2;
+
+  cpuid(0, 0, &a, &b, &c, &d);
+  if (a >= 7) {
+    cpuid(7, 0, &a, &b, &c, &d);
+    g_mem_erms = (uint8_t)((b >> 9) & 1);
+    if ((b >> 5) & 1) g_mem_avx2 = (uint8_t)avx_state_init();
+  }
+
+  MEM_INFO("mem: memcpy/memset %s, non-temporal from %llu KiB\n", mem_impl_name(),
+           (unsigned long long)(g_mem_nt_min >> 10));
+}
+
+uint64_t mem_nt_threshold(void)
+{
+  return g_mem_nt_min;
+}
+
+const char *mem_impl_name(void)
+{
+  if (g_mem_avx2) return g_mem_erms ? "avx2+erms" : "avx2";
+  return g_mem_erms ? "sse2+erms" : "sse2";
+}
@@ -0,0 +1,142 @@
+#include <stdint.h>
+#include <carlos/memacct.h>
+#include <carlos/klog.h>
+
+/*
+  Sites are keyed by (kind, caller address) or (kind, tag pointer) and
+  found through a small open-addressing hash. Allocators store the 16-bit
+  site index next to each allocation so frees are charged back to the
+  site that allocated. When the table is full new callers land in the
+  per-kind overflow bucket.
+*/
+
+static const char *const g_kind_name[MEMACCT_NR_KINDS] = { "kmalloc", "pmm" };
+
+#if KMEM_ACCT
+
+typedef struct {
+  uintptr_t   key;
+  const char *tag;        // set for kmalloc_tagged sites
+  uint8_t     kind;
+  uint64_t    allocs;
+  uint64_t    frees;
+  uint64_t    live;       // bytes
+  uint64_t    peak;       // bytes
+} MemAcctSite;
+
+typedef struct {
+  uint64_t live;
+  uint64_t peak;
+} MemAcctTotal;
+
+#define HASH_SLOTS (MEMACCT_MAX_SITES * 2)
+
+static MemAcctSite  g_sites[MEMACCT_MAX_SITES] = {
+  [MEMACCT_KMALLOC] = { .tag = "(other)", .kind = MEMACCT_KMALLOC },
+  [MEMACCT_PMM]     = { .tag = "(other)", .kind = MEMACCT_PMM },
+};
+static uint16_t     g_nsites = MEMACCT_NR_KINDS;
+static uint16_t     g_hash[HASH_SLOTS];      // 0 = empty
+static MemAcctTotal g_total[MEMACCT_NR_KINDS];
+
+uint16_t memacct_site(unsigned kind, uintptr_t caller, const char *tag)
+{
+  uintptr_t key = tag ? (uintptr_t)tag : caller;
+  uint32_t h = (uint32_t)(((key >> 3) ^ (key >> 17) ^ kind) * 0x9E3779B1u) % HASH_SLOTS;
+
+  for (uint32_t n = 0; n < HASH_SLOTS; n++, h = (h + 1) % HASH_SLOTS){
+    uint16_t idx = g_hash[h];
+    if (idx == 0) {
+      if (g_nsites >= MEMACCT_MAX_SITES) return (uint16_t)kind;
+      idx = g_nsites++;
+      g_sites[idx] = (MemAcctSite){ .key = key, .tag = tag, .kind = (uint8_t)kind };
+      g_hash[h] = idx;
+      return idx;
+    }
+    const MemAcctSite *s = &g_sites[idx];
+    if (s->key == key && s->kind == kind && s->tag == tag) return idx;
+  }
+  return (uint16_t)kind;
+}
+
+void memacct_alloc(uint16_t site, uint64_t bytes)
+{
+  if (site >= g_nsites) return;
+  MemAcctSite *s = &g_sites[site];
+  s->allocs++;
+  s->live += bytes;
+  if (s->live > s->peak) s->peak = s->live;
+
+  MemAcctTotal *t = &g_total[s->kind];
+  t->live += bytes;
+  if (t->live > t->peak) t->peak = t->live;
+}
+
+void memacct_free(uint16_t site, uint64_t bytes)
+{
+  if (site >= g_nsites) return;
+  MemAcctSite *s = &g_sites[site];
+  s->frees++;
+  s->live = (s->live >= bytes) ? s->live - bytes : 0;
+
+  MemAcctTotal *t = &g_total[s->kind];
+  t->live = (t->live >= bytes) ? t->live - bytes : 0;
+}
+
+// In-place resize: adjust live bytes without counting an alloc/free.
+void memacct_resize(uint16_t site, uint64_t old_bytes, uint64_t new_bytes)
+{
+  if (site >= g_nsites) return;
+  MemAcctSite  *s = &g_sites[site];
+  MemAcctTotal *t = &g_total[s->kind];
+
+  s->live = (s->live >= old_bytes) ? s->live - old_bytes : 0;
+  t->live = (t->live >= old_bytes) ? t->live - old_bytes : 0;
+  s->live += new_bytes;
+  t->live += new_bytes;
+  if (s->live > s->peak) s->peak = s->live;
+  if (t->live > t->peak) t->peak = t->live;
+}
+
+void memacct_dump(unsigned top)
+{
+  for (unsigned k = 0; k < MEMACCT_NR_KINDS; k++){
+    kprintf("%s: live=%llu KiB peak=%llu KiB\n", g_kind_name[k],
+            (unsigned long long)(g_total[k].live / 1024),
+            (unsigned long long)(g_total[k].peak / 1024));
+  }
+  kprintf("sites: %u/%u\n", (unsigned)g_nsites, (unsigned)MEMACCT_MAX_SITES);
+
+  // selection by live bytes; the table is small
+  static uint8_t shown[MEMACCT_MAX_SITES];
+  for (unsigned i = 0; i < g_nsites; i++) shown[i] = 0;
+
+  kputs("kind  live(B)  peak(B)  allocs  frees  site\n");
+  for (unsigned n = 0; n < top; n++){
+    int best = -1;
+    for (unsigned i = 0; i < g_nsites; i++){
+      if (shown[i] || g_sites[i].allocs == 0) continue;
+      if (best < 0 || g_sites[i].live > g_sites[best].live) best = (int)i;
+    }
+    if (best < 0) break;
+    shown[best] = 1;
+
+    const MemAcctSite *s = &g_sites[best];
+    kprintf("%s  %llu  %llu  %llu  %llu  ", g_kind_name[s->kind],
+            (unsigned long long)s->live, (unsigned long long)s->peak,
+            (unsigned long long)s->allocs, (unsigned long long)s->frees);
+    if (s->tag) kprintf("%s\n", s->tag);
+    else        kprintf("%p\n", (void*)s->key);
+  }
+}
+
+#else
+
+void memacct_dump(unsigned top)
+{
+  (void)top;
+  (void)g_kind_name;
+  kputs("memory accounting disabled (KMEM_ACCT=0)\n");
+}
+
+#endif
@@ -0,0 +1,841 @@
+// src/mm.c
+#include <stdint.h>
+#include <carlos/mm.h>
+#include <carlos/phys.h>
+#include <carlos/pmm.h>
+#include <carlos/kmem.h>
+#include <carlos/klog.h>
+
+#define MM_DBG(...)  KLOG(KLOG_MOD_MM, KLOG_DBG,  __VA_ARGS__)
+#define MM_INFO(...) KLOG(KLOG_MOD_MM, KLOG_INFO, __VA_ARGS__)
+#define MM_ERR(...)  KLOG(KLOG_MOD_MM, KLOG_ERR,  __VA_ARGS__)
+
+// 512 GiB per PML4 slot. The identity window reuses the first slots of the
+// lower half, so cap the direct map at 128 slots (64 TiB) to stay clear of
+// the app slot.
+#define MM_PML4_SLOT  (1ull << 39)
+#define MM_MAX_SLOTS  128u
+#define MM_MIN_TOP    (4ull << 30)   // always cover the 32-bit MMIO hole
+
+#define MM_APP_SLOT   ((unsigned)(APP_SPACE_BASE >> 39) & 511)
+#define MM_IOMAP_SLOT ((unsigned)(MM_IOMAP_BASE >> 39) & 511)
+#define MM_PCID_MAX   4095u
+
+// #PF error code bits
+#define PF_ERR_P    (1ull << 0)   // protection violation (page was present)
+#define PF_ERR_W    (1ull << 1)
+
+#define CR0_WP      (1ull << 16)
+#define CR4_PGE     (1ull << 7)
+#define CR4_PCIDE   (1ull << 17)
+#define CR3_NOFLUSH (1ull << 63)
+
+// PAT layout (same as Linux): PA0 WB, PA1 WC, PA2 UC-, PA3 UC, PA4 WB,
+// PA5 WP, PA6 UC-, PA7 WT. Selecting with PWT/PCD only keeps the PAT bit
+// (which moves between 4K and large leaves) out of the picture.
+#define MSR_IA32_PAT   0x277u
+#define MM_PAT_VALUE   0x0407050600070106ull
+
+typedef struct {
+  uint32_t Type;
+  uint32_t Pad;
+  uint64_t PhysicalStart;
+  uint64_t VirtualStart;
+  uint64_t NumberOfPages;
+  uint64_t Attribute;
+} EfiMemoryDescriptor;
+
+uint64_t g_phys_map_base = 0;
+
+static uint64_t g_kernel_cr3 = 0;
+static MmStats  g_mm_stats;
+
+// Backs every app page that has not been written and has no content
+static uint64_t g_zero_phys = 0;
+
+static uint16_t g_next_pcid = 1;          // 0 is the kernel's
+static MmSpace *g_cur_space = 0;
+
+static inline void cpuid(uint32_t leaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d){
+  __asm__ volatile ("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(0));
+}
+
+static inline uint64_t rd_cr0(void){
+  uint64_t v;
+  __asm__ volatile ("mov %%cr0, %0" : "=r"(v));
+  return v;
+}
+
+static inline void wr_cr0(uint64_t v){
+  __asm__ volatile ("mov %0, %%cr0" :: "r"(v) : "memory");
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t v){
+  __asm__ volatile ("wrmsr" :: "c"(msr), "a"((uint32_t)v), "d"((uint32_t)(v >> 32)) : "memory");
+}
+
+static inline uint64_t rd_cr3(void){
+  uint64_t v;
+  __asm__ volatile ("mov %%cr3, %0" : "=r"(v));
+  return v;
+}
+
+static inline void wr_cr3(uint64_t v){
+  __asm__ volatile ("mov %0, %%cr3" :: "r"(v) : "memory");
+}
+
+static inline uint64_t rd_cr4(void){
+  uint64_t v;
+  __asm__ volatile ("mov %%cr4, %0" : "=r"(v));
+  return v;
+}
+
+static inline void wr_cr4(uint64_t v){
+  __asm__ volatile ("mov %0, %%cr4" :: "r"(v) : "memory");
+}
+
+static inline void invlpg(uint64_t va){
+  __asm__ volatile ("invlpg (%0)" :: "r"(va) : "memory");
+}
+
+// Flipping CR4.PGE drops every TLB entry, global ones and all PCIDs
+static void tlb_flush_all(void)
+{
+  uint64_t cr4 = rd_cr4();
+  wr_cr4(cr4 ^ CR4_PGE);
+  wr_cr4(cr4);
+}
+
+// Drop every TLB entry tagged with pcid (INVPCID type 1)
+static inline void invpcid_single(uint16_t pcid){
+  struct { uint64_t pcid, addr; } __attribute__((aligned(16))) d = { pcid, 0 };
+  __asm__ volatile ("invpcid %0, %1" :: "m"(d), "r"(1ull) : "memory");
+}
+
+static int cpu_has_pat(void)
+{
+  uint32_t a, b, c, d;
+  cpuid(1, &a, &b, &c, &d);
+  return (int)((d >> 16) & 1);
+}
+
+// Reprogram the PAT. Nothing is mapped with PWT/PCD yet, so only the caches
+// need flushing around the switch; the CR3 load that follows flushes the TLB.
+static int pat_init(void)
+{
+  if (!cpu_has_pat()) return 0;
+  __asm__ volatile ("wbinvd" ::: "memory");
+  wrmsr(MSR_IA32_PAT, MM_PAT_VALUE);
+  __asm__ volatile ("wbinvd" ::: "memory");
+  return 1;
+}
+
+// Enable PCIDs (CR3[11:0] must be 0 at this point, which the kernel PML4 is)
+static void pcid_init(void)
+{
+  uint32_t a, b, c, d;
+  cpuid(1, &a, &b, &c, &d);
+  if (!((c >> 17) & 1)) return;
+
+  cpuid(0, &a, &b, &c, &d);
+  if (a >= 7) {
+    cpuid(7, &a, &b, &c, &d);
+    g_mm_stats.invpcid = (uint8_t)((b >> 10) & 1);
+  }
+
+  wr_cr4(rd_cr4() | CR4_PCIDE);
+  g_mm_stats.pcid = 1;
+}
+
+static int cpu_has_1g_pages(void)
+{
+  uint32_t a, b, c, d;
+  cpuid(0x80000000u, &a, &b, &c, &d);
+  if (a < 0x80000001u) return 0;
+  cpuid(0x80000001u, &a, &b, &c, &d);
+  return (int)((d >> 26) & 1);   // Page1GB
+}
+
+// Highest physical address worth mapping: end of any memory map entry
+// (RAM, ACPI, MMIO the firmware told us about), the framebuffer, and the
+// 4 GiB boundary.
+static uint64_t phys_top(const BootInfo *bi)
+{
+  uint64_t top = MM_MIN_TOP;
+
+  const uint64_t desc_sz = bi->memdesc_size;
+  const uint64_t count = desc_sz ? bi->memmap_size / desc_sz : 0;
+  const uint8_t *p = (const uint8_t*)phys_to_cptr(bi->memmap);
+
+  for (uint64_t i = 0; i < count; i++) {
+    const EfiMemoryDescriptor *d =
+      (const EfiMemoryDescriptor *)(const void *)(p + i * desc_sz);
+    uint64_t end = d->PhysicalStart + d->NumberOfPages * PAGE_SIZE;
+    if (end > top) top = end;
+  }
+
+  if (bi->fb_base && bi->fb_base + bi->fb_size > top)
+    top = bi->fb_base + bi->fb_size;
+
+  return (top + MM_PAGE_1G - 1) & ~(MM_PAGE_1G - 1);
+}
+
+static uint64_t table_new(void)
+{
+  uint64_t phys = pmm_alloc_zeroed_page_phys();
+  if (phys) g_mm_stats.table_pages++;
+  return phys;
+}
+
+// Free everything reachable from the upper half of a half-built PML4.
+static void tables_free(uint64_t pml4_phys)
+{
+  uint64_t *pml4 = (uint64_t*)phys_to_ptr(pml4_phys);
+  for (unsigned s = 0; s < 256; s++) {
+    uint64_t e = pml4[256 + s];
+    if (!(e & PTE_P)) continue;
+    uint64_t *pdpt = (uint64_t*)phys_to_ptr(e & PTE_ADDR);
+    for (unsigned i = 0; i < 512; i++) {
+      if ((pdpt[i] & PTE_P) && !(pdpt[i] & PTE_PS))
+        pmm_free_page_phys(pdpt[i] & PTE_ADDR);
+    }
+    pmm_free_page_phys(e & PTE_ADDR);
+  }
+  pmm_free_page_phys(pml4_phys);
+  g_mm_stats.table_pages = 0;
+}
+
+// Descend one level, allocating the next table if needed. Fails when the
+// slot is already covered by a large page.
+static uint64_t *pt_next(uint64_t *table, unsigned idx, uint64_t dir)
+{
+  uint64_t e = table[idx];
+  if (e & PTE_P) {
+    if (e & PTE_PS) return 0;
+    if ((dir & PTE_U) && !(e & PTE_U)) table[idx] = e | PTE_U;
+    return (uint64_t*)phys_to_ptr(e & PTE_ADDR);
+  }
+
+  uint64_t phys = table_new();
+  if (!phys) return 0;
+  table[idx] = phys | dir;
+  return (uint64_t*)phys_to_ptr(phys);
+}
+
+int mm_init(const BootInfo *bi)
+{
+  if (!bi || !bi->memmap || !bi->memdesc_size) return -1;
+  if (g_kernel_cr3) return 0;
+
+  const int use_1g = cpu_has_1g_pages();
+  uint64_t top = phys_top(bi);
+  uint64_t slots = (top + MM_PML4_SLOT - 1) / MM_PML4_SLOT;
+  if (slots > MM_MAX_SLOTS) {
+    slots = MM_MAX_SLOTS;
+    top = slots * MM_PML4_SLOT;
+  }
+
+  g_mm_stats.table_pages = 0;
+  uint64_t pml4_phys = table_new();
+  if (!pml4_phys) return -1;
+  uint64_t *pml4 = (uint64_t*)phys_to_ptr(pml4_phys);
+
+  const uint64_t leaf = PTE_P | PTE_W | PTE_PS;
+  const uint64_t dir  = PTE_P | PTE_W;
+
+  for (uint64_t s = 0; s < slots; s++) {
+    uint64_t pdpt_phys = table_new();
+    if (!pdpt_phys) goto oom;
+    uint64_t *pdpt = (uint64_t*)phys_to_ptr(pdpt_phys);
+    pml4[256 + s] = pdpt_phys | dir;
+
+    for (unsigned i = 0; i < 512; i++) {
+      uint64_t gb = s * MM_PML4_SLOT + (uint64_t)i * MM_PAGE_1G;
+      if (gb >= top) break;
+
+      if (use_1g) {
+        pdpt[i] = gb | leaf;
+        continue;
+      }
+
+      uint64_t pd_phys = table_new();
+      if (!pd_phys) goto oom;
+      uint64_t *pd = (uint64_t*)phys_to_ptr(pd_phys);
+      for (unsigned j = 0; j < 512; j++)
+        pd[j] = (gb + (uint64_t)j * MM_PAGE_2M) | leaf;
+      pdpt[i] = pd_phys | dir;
+    }
+
+    // identity window: same tables, low half
+    pml4[s] = pml4[256 + s];
+  }
+
+  // app address spaces copy the upper half once, so it must not grow new
+  // PML4 entries later: create the iomap window's PDPT now
+  if (!pt_next(pml4, MM_IOMAP_SLOT, dir)) goto oom;
+
+  // The direct map is WB (PAT entry 0); the firmware's MTRRs keep the MMIO
+  // ranges uncached there. Drivers map registers through iomap() instead,
+  // which gives the range the same type here (mm_direct_set_cache).
+  g_mm_stats.pat = (uint8_t)pat_init();
+  wr_cr3(pml4_phys);
+  g_kernel_cr3 = pml4_phys;
+  g_phys_map_base = PHYS_MAP_BASE;
+
+  // honour read-only mappings in ring 0 too
+  wr_cr0(rd_cr0() | CR0_WP);
+  pcid_init();
+
+  // without it every fault just gets its own page
+  g_zero_phys = pmm_alloc_zeroed_page_phys();
+
+  // app pages are movable through their PTE; compaction rewrites it
+  pmm_set_tlb_flush_hook(tlb_flush_all);
+
+  g_mm_stats.mapped_bytes = top;
+  g_mm_stats.page_size = use_1g ? MM_PAGE_1G : MM_PAGE_2M;
+
+  MM_INFO("mm: direct map 0x%llx..0x%llx @0x%llx, %s pages, %u table pages, pcid=%u\n",
+          0ull, (unsigned long long)top, (unsigned long long)PHYS_MAP_BASE,
+          use_1g ? "1G" : "2M", (unsigned)g_mm_stats.table_pages,
+          (unsigned)g_mm_stats.pcid);
+  return 0;
+
+oom:
+  MM_ERR("mm: out of memory building page tables (top=0x%llx)\n",
+         (unsigned long long)top);
+  tables_free(pml4_phys);
+  return -1;
+}
+
+int mm_map(uint64_t pml4_phys, uint64_t va, uint64_t phys, uint64_t size, uint64_t flags)
+{
+  if (!pml4_phys) return -1;
+  if ((va | phys | size) & (PAGE_SIZE - 1)) return -1;
+
+  flags &= ~(PTE_ADDR | PTE_PS);
+  const uint64_t dir = PTE_P | PTE_W | (flags & PTE_U);
+  uint64_t *pml4 = (uint64_t*)phys_to_ptr(pml4_phys);
+
+  while (size) {
+    uint64_t *pdpt = pt_next(pml4, (unsigned)(va >> 39) & 511, dir);
+    uint64_t *pd   = pdpt ? pt_next(pdpt, (unsigned)(va >> 30) & 511, dir) : 0;
+    if (!pd) return -2;
+
+    unsigned pdi = (unsigned)(va >> 21) & 511;
+    uint64_t step;
+
+    if (((va | phys) & (MM_PAGE_2M - 1)) == 0 && size >= MM_PAGE_2M &&
+        !(pd[pdi] & PTE_P)) {
+      pd[pdi] = phys | flags | PTE_P | PTE_PS;
+      step = MM_PAGE_2M;
+    } else {
+      uint64_t *pt = pt_next(pd, pdi, dir);
+      if (!pt) return -2;
+      pt[(va >> 12) & 511] = phys | flags | PTE_P;
+      step = PAGE_SIZE;
+    }
+
+    va += step;
+    phys += step;
+    size -= step;
+  }
+
+  MM_DBG("mm: map done, %u table pages\n", (unsigned)g_mm_stats.table_pages);
+  return 0;
+}
+
+// Replace the direct-map leaf *e (of `size`, 1 GiB or 2 MiB) with a table
+// of 512 leaves one level down covering the same frames.
+static int direct_split(uint64_t *e, uint64_t size)
+{
+  uint64_t t_phys = table_new();
+  if (!t_phys) return -1;
+
+  uint64_t old = *e;
+  uint64_t base = old & PTE_ADDR & ~(size - 1);
+  uint64_t child = size / 512;
+  // 4 KiB leaves have the PAT bit where larger ones have PS
+  uint64_t flags = old & ~PTE_ADDR & ~(child == PAGE_SIZE ? PTE_PS : 0);
+  uint64_t *t = (uint64_t*)phys_to_ptr(t_phys);
+  for (unsigned i = 0; i < 512; i++)
+    t[i] = (base + (uint64_t)i * child) | flags;
+
+  *e = t_phys | PTE_P | PTE_W;
+  return 0;
+}
+
+// Rewrite the PWT/PCD bits of the kernel leaves covering [va, end),
+// splitting large ones that straddle an edge. The caller flushes.
+static int set_cache_walk(uint64_t va, uint64_t end, uint64_t cache)
+{
+  const uint64_t mask = PTE_PWT | PTE_PCD;
+  uint64_t *pml4 = (uint64_t*)phys_to_ptr(g_kernel_cr3);
+  while (va < end) {
+    uint64_t *e = &pml4[(va >> 39) & 511];
+    uint64_t step = MM_PAGE_1G;
+
+    // PDPT, PD, PT: stop at a leaf that lies wholly inside the range
+    for (int level = 0; level < 3; level++) {
+      if (!(*e & PTE_P)) return -2;
+      uint64_t *t = (uint64_t*)phys_to_ptr(*e & PTE_ADDR);
+      e = &t[(va >> (30 - 9 * level)) & 511];
+      step = 1ull << (30 - 9 * level);
+      if (level == 2 || !(*e & PTE_PS)) continue;
+      if (!(va & (step - 1)) && end - va >= step) break;
+      if (direct_split(e, step) != 0) return -3;
+    }
+    if (!(*e & PTE_P)) return -2;
+
+    *e = (*e & ~mask) | (cache & mask);
+    va += step;
+  }
+  return 0;
+}
+
+static void cache_type_flush(void)
+{
+  // old type may still sit in the TLB and the caches
+  tlb_flush_all();
+  __asm__ volatile ("wbinvd" ::: "memory");
+}
+
+int mm_direct_set_cache(uint64_t phys, uint64_t size, uint64_t cache)
+{
+  if (!g_kernel_cr3) return -1;
+  uint64_t pa  = phys & ~(PAGE_SIZE - 1);
+  uint64_t end = page_align_up(phys + size);
+  if (end > g_mm_stats.mapped_bytes) end = g_mm_stats.mapped_bytes;
+  if (pa >= end) return 0;
+
+  int rc = set_cache_walk(PHYS_MAP_BASE + pa, PHYS_MAP_BASE + end, cache);
+  cache_type_flush();
+  return rc;
+}
+
+int mm_set_cache(uint64_t va, uint64_t size, uint64_t cache)
+{
+  if (!g_kernel_cr3) return -1;
+  if ((va | size) & (PAGE_SIZE - 1)) return -1;
+
+  int rc = set_cache_walk(va, va + size, cache);
+  cache_type_flush();
+  return rc;
+}
+
+int mm_translate(uint64_t pml4_phys, uint64_t va, uint64_t *out_phys)
+{
+  if (!pml4_phys) return -1;
+
+  const uint64_t *t = (const uint64_t*)phys_to_cptr(pml4_phys);
+  uint64_t e = t[(va >> 39) & 511];
+  if (!(e & PTE_P)) return -2;
+
+  t = (const uint64_t*)phys_to_cptr(e & PTE_ADDR);
+  e = t[(va >> 30) & 511];
+  if (!(e & PTE_P)) return -2;
+  if (e & PTE_PS) {
+    *out_phys = (e & PTE_ADDR & ~(MM_PAGE_1G - 1)) + (va & (MM_PAGE_1G - 1));
+    return 0;
+  }
+
+  t = (const uint64_t*)phys_to_cptr(e & PTE_ADDR);
+  e = t[(va >> 21) & 511];
+  if (!(e & PTE_P)) return -2;
+  if (e & PTE_PS) {
+    *out_phys = (e & PTE_ADDR & ~(MM_PAGE_2M - 1)) + (va & (MM_PAGE_2M - 1));
+    return 0;
+  }
+
+  t = (const uint64_t*)phys_to_cptr(e & PTE_ADDR);
+  e = t[(va >> 12) & 511];
+  if (!(e & PTE_P)) return -2;
+  *out_phys = (e & PTE_ADDR) + (va & (PAGE_SIZE - 1));
+  return 0;
+}
+
+// 4 KiB leaf entry for va, or NULL if it is not mapped by one
+static uint64_t *pt_leaf(uint64_t pml4_phys, uint64_t va)
+{
+  uint64_t *t = (uint64_t*)phys_to_ptr(pml4_phys);
+  for (unsigned shift = 39; shift > 12; shift -= 9) {
+    uint64_t e = t[(va >> shift) & 511];
+    if (!(e & PTE_P) || (e & PTE_PS)) return 0;
+    t = (uint64_t*)phys_to_ptr(e & PTE_ADDR);
+  }
+  return &t[(va >> 12) & 511];
+}
+
+// PD entry covering va, or NULL if no PD exists for it yet
+static uint64_t *pd_slot(uint64_t pml4_phys, uint64_t va)
+{
+  uint64_t *t = (uint64_t*)phys_to_ptr(pml4_phys);
+  for (unsigned shift = 39; shift > 21; shift -= 9) {
+    uint64_t e = t[(va >> shift) & 511];
+    if (!(e & PTE_P) || (e & PTE_PS)) return 0;
+    t = (uint64_t*)phys_to_ptr(e & PTE_ADDR);
+  }
+  return &t[(va >> 21) & 511];
+}
+
+uint64_t mm_virt_to_phys(uint64_t va)
+{
+  uint64_t phys = 0;
+  if (mm_translate(rd_cr3() & PTE_ADDR, va, &phys) != 0) return 0;
+  return phys;
+}
+
+/* ---------- application address spaces ---------- */
+
+int mm_space_create(MmSpace *as)
+{
+  if (!as) return -1;
+  *as = (MmSpace){0};
+  if (!g_kernel_cr3) return -2;
+
+  uint64_t phys = table_new();
+  if (!phys) return -3;
+
+  // everything but the app slot is the kernel's, shared by reference
+  uint64_t *pml4 = (uint64_t*)phys_to_ptr(phys);
+  const uint64_t *kpml4 = (const uint64_t*)phys_to_cptr(g_kernel_cr3);
+  for (unsigned i = 0; i < 512; i++)
+    if (i != MM_APP_SLOT) pml4[i] = kpml4[i];
+
+  as->pml4_phys = phys;
+  if (g_mm_stats.pcid) {
+    as->pcid = (uint16_t)g_next_pcid;
+    g_next_pcid = (g_next_pcid == MM_PCID_MAX) ? 1 : (uint16_t)(g_next_pcid + 1);
+    // with INVPCID, destroy cleans the tag; otherwise flush on first load
+    as->stale = !g_mm_stats.invpcid;
+  }
+  g_mm_stats.spaces++;
+  return 0;
+}
+
+// Free a table and everything below it; level 3 = PDPT, 2 = PD, 1 = PT.
+static void space_free_tree(uint64_t table_phys, unsigned level)
+{
+  uint64_t *t = (uint64_t*)phys_to_ptr(table_phys);
+
+  for (unsigned i = 0; i < 512; i++) {
+    uint64_t e = t[i];
+    if (!(e & PTE_P)) continue;
+
+    if (level == 1 || (e & PTE_PS)) {
+      if (!(e & PTE_OWNED)) continue;
+      if (level == 2) {
+        pmm_free_huge_page_phys(e & PTE_ADDR & ~(MM_PAGE_2M - 1));
+        continue;
+      }
+      uint64_t pages = (level == 1) ? 1 : 512 * 512;
+      pmm_free_contig_pages_phys(e & PTE_ADDR & ~(pages * PAGE_SIZE - 1), pages);
+      continue;
+    }
+    space_free_tree(e & PTE_ADDR, level - 1);
+  }
+
+  pmm_free_page_phys(table_phys);
+  g_mm_stats.table_pages--;
+}
+
+void mm_space_destroy(MmSpace *as)
+{
+  if (!as || !as->pml4_phys) return;
+  if (g_cur_space == as) mm_space_switch(0);
+
+  uint64_t *pml4 = (uint64_t*)phys_to_ptr(as->pml4_phys);
+  uint64_t e = pml4[MM_APP_SLOT];
+  if (e & PTE_P) space_free_tree(e & PTE_ADDR, 3);
+
+  while (as->vmas) {
+    MmVma *v = as->vmas;
+    as->vmas = v->next;
+    if (v->drop) v->drop(v->ctx);
+    kfree(v);
+  }
+
+  pmm_free_page_phys(as->pml4_phys);
+  g_mm_stats.table_pages--;
+
+  if (g_mm_stats.pcid && g_mm_stats.invpcid) invpcid_single(as->pcid);
+  *as = (MmSpace){0};
+}
+
+void mm_space_switch(MmSpace *as)
+{
+  if (!g_kernel_cr3 || g_cur_space == as) return;
+
+  uint64_t cr3;
+  if (!as) {
+    // kernel mappings never go away, so PCID 0 is never stale
+    cr3 = g_kernel_cr3 | (g_mm_stats.pcid ? CR3_NOFLUSH : 0);
+  } else {
+    cr3 = as->pml4_phys | as->pcid;
+    if (g_mm_stats.pcid && !as->stale) cr3 |= CR3_NOFLUSH;
+    as->stale = 0;
+  }
+
+  wr_cr3(cr3);
+  g_cur_space = as;
+}
+
+MmSpace *mm_space_current(void)
+{
+  return g_cur_space;
+}
+
+int mm_space_add_vma(MmSpace *as, uint64_t start, uint64_t end,
+                     uint64_t pte_flags, MmFillFn fill, MmProbeFn probe,
+                     MmDropFn drop, void *ctx)
+{
+  if (!as || !as->pml4_phys) return -1;
+  if ((start | end) & (PAGE_SIZE - 1) || start >= end) return -1;
+  if (start < APP_SPACE_BASE || end > APP_SPACE_END) return -2;
+
+  MmVma *prev = 0, *cur = as->vmas;
+  while (cur && cur->start < start) { prev = cur; cur = cur->next; }
+  if (prev && prev->end > start) return -3;
+  if (cur && cur->start < end) return -3;
+
+  MmVma *v = (MmVma*)kmalloc(sizeof(*v));
+  if (!v) return -4;
+  *v = (MmVma){ .start = start, .end = end, .flags = pte_flags,
+                .fill = fill, .probe = probe, .drop = drop, .ctx = ctx, .next = cur };
+  if (prev) prev->next = v;
+  else      as->vmas = v;
+  return 0;
+}
+
+static MmVma *vma_find(MmSpace *as, uint64_t va)
+{
+  for (MmVma *v = as->vmas; v && v->start <= va; v = v->next)
+    if (va < v->end) return v;
+  return 0;
+}
+
+// Turn the 2 MiB leaf at *pde into a table of 4 KiB entries for the same
+// frames, which from then on are owned (and movable) one by one.
+static int huge_split(MmSpace *as, uint64_t *pde, uint64_t block_va)
+{
+  uint64_t pt_phys = table_new();
+  if (!pt_phys) return -1;
+
+  uint64_t e = *pde;
+  uint64_t base = e & PTE_ADDR & ~(MM_PAGE_2M - 1);
+  uint64_t *pt = (uint64_t*)phys_to_ptr(pt_phys);
+  for (unsigned i = 0; i < 512; i++)
+    pt[i] = (base + (uint64_t)i * PAGE_SIZE) | (e & ~(PTE_ADDR | PTE_PS));
+
+  *pde = pt_phys | PTE_P | PTE_W | (e & PTE_U);
+  if (g_cur_space == as) invlpg(block_va);
+  else if (g_mm_stats.pcid) as->stale = 1;
+
+  if (e & PTE_OWNED)
+    for (unsigned i = 0; i < 512; i++) pmm_set_owner(base + (uint64_t)i * PAGE_SIZE, &pt[i]);
+  g_mm_stats.huge_splits++;
+  return 0;
+}
+
+// Split the 2 MiB page around va, if va falls inside one
+static int huge_split_at(MmSpace *as, uint64_t va)
+{
+  if (!(va & (MM_PAGE_2M - 1))) return 0;
+  uint64_t *pde = pd_slot(as->pml4_phys, va);
+  if (!pde || (*pde & (PTE_P | PTE_PS)) != (PTE_P | PTE_PS)) return 0;
+  return huge_split(as, pde, va & ~(MM_PAGE_2M - 1));
+}
+
+int mm_space_remove_vma(MmSpace *as, uint64_t start, uint64_t end)
+{
+  if (!as || !as->pml4_phys) return -1;
+  if ((start | end) & (PAGE_SIZE - 1) || start >= end) return -1;
+
+  MmVma *prev = 0, *v = as->vmas;
+  while (v && v->end <= start) { prev = v; v = v->next; }
+  if (!v || start < v->start || end > v->end) return -2;
+  if (start != v->start && end != v->end) return -2;   // would leave a hole
+
+  if (huge_split_at(as, start) != 0 || huge_split_at(as, end) != 0) return -3;
+
+  for (uint64_t va = start; va < end; ) {
+    uint64_t *pde = pd_slot(as->pml4_phys, va);
+    if (pde && (*pde & PTE_PS)) {
+      // whole block in range: the edges were split above
+      if (*pde & PTE_OWNED) pmm_free_huge_page_phys(*pde & PTE_ADDR & ~(MM_PAGE_2M - 1));
+      *pde = 0;
+      if (g_cur_space == as) invlpg(va);
+      va += MM_PAGE_2M;
+      continue;
+    }
+
+    uint64_t *pte = pt_leaf(as->pml4_phys, va);
+    if (pte && (*pte & PTE_P)) {
+      if (*pte & PTE_OWNED) pmm_free_page_phys(*pte & PTE_ADDR);
+      *pte = 0;
+      if (g_cur_space == as) invlpg(va);
+    }
+    va += PAGE_SIZE;
+  }
+  // entries tagged with this PCID may survive in the TLB until next load
+  if (g_cur_space != as && g_mm_stats.pcid) as->stale = 1;
+
+  if (start != v->start) { v->end = start; return 0; }
+  if (end != v->end)     { v->start = end; return 0; }
+
+  if (prev) prev->next = v->next;
+  else      as->vmas = v->next;
+  if (v->drop) v->drop(v->ctx);
+  kfree(v);
+  return 0;
+}
+
+uint64_t mm_space_find_gap(MmSpace *as, uint64_t from, uint64_t size, uint64_t align)
+{
+  if (!as || size == 0 || (align & (align - 1))) return 0;
+  if (align < PAGE_SIZE) align = PAGE_SIZE;
+  uint64_t at = from < APP_SPACE_BASE ? APP_SPACE_BASE : from;
+  at = (at + align - 1) & ~(align - 1);
+  size = page_align_up(size);
+
+  for (MmVma *v = as->vmas; v; v = v->next) {
+    if (v->end <= at) continue;
+    if (v->start >= at + size) break;
+    at = (v->end + align - 1) & ~(align - 1);
+  }
+  return (at + size <= APP_SPACE_END && at + size > at) ? at : 0;
+}
+
+// Store to a PTE_COW page: give the space its own copy, writable.
+static int cow_break(MmSpace *as, uint64_t page_va)
+{
+  uint64_t *pte = pt_leaf(as->pml4_phys, page_va);
+  if (!pte || !(*pte & PTE_COW)) return -1;
+
+  uint64_t old = *pte & PTE_ADDR;
+  uint64_t phys;
+  if (old == g_zero_phys) {
+    phys = pmm_alloc_zeroed_page_phys();
+  } else {
+    phys = pmm_alloc_page_phys();
+    if (phys) __builtin_memcpy(phys_to_ptr(phys), phys_to_cptr(old), PAGE_SIZE);
+  }
+  if (!phys) return -2;
+
+  *pte = (*pte & ~(PTE_ADDR | PTE_COW)) | phys | PTE_W | PTE_OWNED;
+  invlpg(page_va);   // as is the active space
+  pmm_set_owner(phys, pte);
+  return 0;
+}
+
+// Map a frame the space doesn't own; writable mappings become PTE_COW.
+static int map_shared(MmSpace *as, uint64_t page_va, uint64_t phys, uint64_t flags)
+{
+  uint64_t f = flags & ~(PTE_ADDR | PTE_W);
+  if (flags & PTE_W) f |= PTE_COW;
+  return mm_map(as->pml4_phys, page_va, phys, PAGE_SIZE, f);
+}
+
+// Back the whole 2 MiB block at block_va with one zeroed private frame, on
+// a store into a block that lies inside v, has no 4 KiB table yet (nothing
+// of it is mapped) and has no content anywhere, with the same flags on
+// every page. The fill callback is never called here: a block with content
+// keeps being read a page at a time. A block that is only read keeps using
+// the zero page.
+static int huge_fault(MmSpace *as, MmVma *v, uint64_t block_va, uint64_t err)
+{
+  if (!(err & PF_ERR_W) || (v->fill && !v->probe)) return -1;
+  if (block_va < v->start || block_va + MM_PAGE_2M > v->end) return -1;
+  uint64_t *pde = pd_slot(as->pml4_phys, block_va);
+  if (pde && (*pde & PTE_P)) return -1;
+
+  uint64_t flags = v->flags;
+  for (unsigned i = 0; v->fill && i < 512; i++) {
+    uint64_t f = v->flags;
+    if (v->probe(v->ctx, block_va + (uint64_t)i * PAGE_SIZE, &f) != MM_FILL_ZERO) return -1;
+    if (i == 0) flags = f;
+    else if (f != flags) return -1;
+  }
+
+  uint64_t phys = pmm_alloc_huge_page_phys();
+  if (!phys) return -1;
+  __builtin_memset(phys_to_ptr(phys), 0, MM_PAGE_2M);
+
+  if (mm_map(as->pml4_phys, block_va, phys, MM_PAGE_2M, flags | PTE_OWNED) != 0) {
+    pmm_free_huge_page_phys(phys);
+    return -1;
+  }
+  g_mm_stats.huge_maps++;
+  return 0;
+}
+
+int mm_handle_fault(uint64_t va, uint64_t err)
+{
+  MmSpace *as = g_cur_space;
+  if (!as || va < APP_SPACE_BASE || va >= APP_SPACE_END) return -1;
+
+  MmVma *v = vma_find(as, va);
+  if (!v) goto bad;
+
+  uint64_t page_va = va & ~(PAGE_SIZE - 1);
+  if (err & PF_ERR_P) {
+    // mapped: only a store to a copy-on-write page is fixable
+    if (!(err & PF_ERR_W) || cow_break(as, page_va) != 0) goto bad;
+    g_mm_stats.cow_faults++;
+    return 0;
+  }
+
+  if (huge_fault(as, v, va & ~(MM_PAGE_2M - 1), err) == 0) return 0;
+
+  uint64_t flags = v->flags;
+  int rc = v->fill ? v->fill(v->ctx, page_va, 0, &flags) : MM_FILL_ZERO;
+  if (rc < 0) goto bad;
+
+  if (rc == MM_FILL_SHARED) {
+    if (map_shared(as, page_va, flags & PTE_ADDR, flags) != 0) goto bad;
+    g_mm_stats.shared_maps++;
+    // a store would only fault again on the copy-on-write entry
+    if ((err & PF_ERR_W) && (flags & PTE_W)) {
+      if (cow_break(as, page_va) != 0) goto bad;
+      g_mm_stats.cow_faults++;
+    }
+    return 0;
+  }
+
+  // Nothing to fill and only read: share the zero page until the first store
+  if (rc == MM_FILL_ZERO && !(err & PF_ERR_W) && g_zero_phys) {
+    if (map_shared(as, page_va, g_zero_phys, flags) != 0) goto bad;
+    g_mm_stats.zero_maps++;
+    return 0;
+  }
+
+  uint64_t phys = pmm_alloc_zeroed_page_phys();
+  if (!phys) goto bad;
+
+  if ((rc != MM_FILL_ZERO && v->fill(v->ctx, page_va, phys_to_ptr(phys), &flags) != 0) ||
+      mm_map(as->pml4_phys, page_va, phys, PAGE_SIZE, flags | PTE_OWNED) != 0) {
+    pmm_free_page_phys(phys);
+    goto bad;
+  }
+  pmm_set_owner(phys, pt_leaf(as->pml4_phys, page_va));
+
+  g_mm_stats.faults++;
+  return 0;
+
+bad:
+  g_mm_stats.bad_faults++;
+  MM_ERR("mm: unresolved fault va=0x%llx err=0x%llx\n",
+         (unsigned long long)va, (unsigned long long)err);
+  return -2;
+}
+
+uint64_t mm_kernel_cr3(void)
+{
+  return g_kernel_cr3;
+}
+
+void mm_stats(MmStats *st)
+{
+  if (!st) return;
+  *st = g_mm_stats;
+}
@@ -71,4 +71,36 @@ void path_normalize_abs(char *p, size_t cap){
   if (copy_n >= cap) copy_n = cap - 1;
   for (size_t k = 0; k < copy_n; k++) p[k] = out[k];
   p[copy_n] = 0;
-}
\ No newline at end of file
+}
+
+// normalize:  "/efi/carlos" -> "EFI/CARLOS"
+// also collapses leading slashes and converts '\' -> '/'
+void path_norm83(const char *in, char *out, size_t cap){
+  size_t j = 0;
+  if (!cap) return;
+  out[0] = 0;
+
+  // skip leading slashes
+  while (in && (*in == '/' || *in == '\\')) in++;
+
+  for (size_t i = 0; in && in[i] && j + 1 < cap; i++){
+    char c = in[i];
+    if (c == '\\') c = '/';
+
+    // collapse duplicate '/'
+    if (c == '/'){
+      if (j == 0 || out[j-1] == '/') continue;
+      out[j++] = '/';
+      continue;
+    }
+
+    // uppercase for FAT 8.3 usage
+    if (c >= 'a' && c <= 'z') c = (char)(c - 'a' + 'A');
+    out[j++] = c;
+  }
+
+  // trim trailing '/'
+  if (j > 0 && out[j-1] == '/') j--;
+
+  out[j] = 0;
+}
@@ -0,0 +1,211 @@
+// Kernel/src/pcache.c
+#include <stdint.h>
+#include <stddef.h>
+
+#include <carlos/pcache.h>
+#include <carlos/fs.h>
+#include <carlos/pmm.h>
+#include <carlos/kmem.h>
+#include <carlos/klog.h>
+#include <carlos/shrinker.h>
+
+#define PCACHE_DBG(...)  KLOG(KLOG_MOD_FS, KLOG_DBG,  __VA_ARGS__)
+#define PCACHE_WARN(...) KLOG(KLOG_MOD_FS, KLOG_WARN, __VA_ARGS__)
+
+/*
+  One slot per file. The page table of a slot is sized once by its owner
+  and filled lazily. A changed file (same first cluster, different size or
+  mtime) gets a new slot; the old one is dropped as soon as it goes idle.
+  There is no write path through here, so cached pages never go dirty.
+*/
+
+// Idle files' pages are movable: the slot in pages[] is their only
+// reference. Mapped ones are pinned.
+static void pc_set_movable(PCacheFile *pf, int on)
+{
+  for (uint64_t i = 0; i < pf->npages; i++)
+    if (pf->pages[i]) pmm_set_owner(pf->pages[i], on ? &pf->pages[i] : 0);
+}
+
+static void pc_drop(PCache *c, PCacheFile *pf)
+{
+  if (pf->pages) {
+    for (uint64_t i = 0; i < pf->npages; i++)
+      if (pf->pages[i]) pmm_free_page_phys(pf->pages[i]);
+    kfree(pf->pages);
+  }
+  if (pf->file.fs) c->evictions++;
+  *pf = (PCacheFile){0};
+}
+
+// Shrinker: drop idle files, least recently used first.
+static uint64_t pcache_shrink(void *ctx, uint64_t nr_pages)
+{
+  PCache *c = (PCache*)ctx;
+  uint64_t n = 0;
+  while (n < nr_pages) {
+    PCacheFile *victim = 0;
+    for (unsigned i = 0; i < c->nslots; i++) {
+      PCacheFile *pf = &c->slots[i];
+      if (!pf->file.fs || pf->users || !pf->held) continue;
+      if (!victim || pf->last_use < victim->last_use) victim = pf;
+    }
+    if (!victim) break;
+    n += victim->held;
+    pc_drop(c, victim);
+  }
+  return n;
+}
+
+static int same_file(const FsFile *a, const FsFile *b)
+{
+  return a->fs == b->fs && a->clus == b->clus && a->size == b->size &&
+         a->mtime == b->mtime;
+}
+
+PCacheFile *pcache_get(PCache *c, const FsFile *f)
+{
+  if (!c || !f || !f->fs) return 0;
+
+  PCacheFile *pf = 0, *slot = 0;
+  for (unsigned i = 0; i < c->nslots && !pf; i++) {
+    PCacheFile *t = &c->slots[i];
+    if (!t->file.fs || t->file.fs != f->fs || t->file.clus != f->clus) continue;
+    if (same_file(&t->file, f)) pf = t;
+    else if (!t->users) pc_drop(c, t);   // the file changed since: its pages are stale
+  }
+
+  // new file: a free slot, else the least recently used idle one
+  for (unsigned i = 0; i < c->nslots && !pf; i++) {
+    PCacheFile *t = &c->slots[i];
+    if (t->users) continue;
+    if (!t->file.fs) { slot = t; break; }
+    if (!slot || t->last_use < slot->last_use) slot = t;
+  }
+
+  if (!pf) {
+    if (!slot) return 0;
+    pc_drop(c, slot);
+    slot->file = *f;
+    pf = slot;
+    if (!c->shrinker.scan) {
+      c->shrinker = (Shrinker){ .name = c->name, .scan = pcache_shrink, .ctx = c,
+                                .priority = SHRINK_PRIO_CACHE };
+      shrinker_register(&c->shrinker);
+    }
+  }
+
+  if (pf->users++ == 0) pc_set_movable(pf, 0);
+  pf->last_use = ++c->clock;
+  return pf;
+}
+
+void pcache_put(PCache *c, PCacheFile *pf)
+{
+  (void)c;
+  if (!pf || !pf->users) return;
+  if (--pf->users == 0) pc_set_movable(pf, 1);
+}
+
+int pcache_bind(PCache *c, PCacheFile *pf, uint64_t npages)
+{
+  if (!c || !pf || npages == 0) return -1;
+  if (pf->pages) return (pf->npages == npages) ? 0 : -2;
+
+  pf->pages = (uint64_t*)kmalloc_tagged((size_t)(npages * sizeof(uint64_t)), c->name);
+  if (!pf->pages) return -3;
+  for (uint64_t i = 0; i < npages; i++) pf->pages[i] = 0;
+  pf->npages = npages;
+  return 0;
+}
+
+uint64_t pcache_lookup(PCache *c, PCacheFile *pf, uint64_t idx)
+{
+  if (!c || !pf || idx >= pf->npages || !pf->pages[idx]) return 0;
+  c->hits++;
+  return pf->pages[idx];
+}
+
+int pcache_insert(PCache *c, PCacheFile *pf, uint64_t idx, uint64_t phys)
+{
+  if (!c || !pf || idx >= pf->npages || pf->pages[idx]) return -1;
+  pf->pages[idx] = phys;
+  pf->held++;
+  c->fills++;
+  return 0;
+}
+
+void pcache_stats_of(const PCache *c, PCacheStats *st)
+{
+  if (!st) return;
+  *st = (PCacheStats){0};
+  if (!c) return;
+  for (unsigned i = 0; i < c->nslots; i++) {
+    if (!c->slots[i].file.fs) continue;
+    st->files++;
+    st->pages += c->slots[i].held;
+  }
+  st->hits      = c->hits;
+  st->misses    = c->fills;
+  st->evictions = c->evictions;
+}
+
+// ---- File page cache ----
+
+#define PCACHE_SLOTS 16
+
+static PCacheFile g_pc_slots[PCACHE_SLOTS];
+static PCache     g_pc = PCACHE_INIT("pcache", g_pc_slots);
+
+PCacheFile *pcache_open(const FsFile *f)
+{
+  if (!f || f->size == 0) return 0;
+
+  PCacheFile *pf = pcache_get(&g_pc, f);
+  if (!pf) return 0;
+
+  uint64_t npages = ((uint64_t)f->size + PAGE_SIZE - 1) / PAGE_SIZE;
+  if (pcache_bind(&g_pc, pf, npages) != 0) {
+    pcache_put(&g_pc, pf);
+    return 0;
+  }
+  return pf;
+}
+
+void pcache_close(PCacheFile *pf)
+{
+  pcache_put(&g_pc, pf);
+}
+
+uint64_t pcache_page(PCacheFile *pf, uint64_t idx)
+{
+  if (!pf || idx >= pf->npages) return 0;
+  uint64_t phys = pcache_lookup(&g_pc, pf, idx);
+  if (phys) return phys;
+
+  phys = pmm_alloc_zeroed_page_phys();
+  if (!phys) return 0;
+
+  uint64_t off = idx * PAGE_SIZE;
+  uint64_t len = pf->file.size - off;
+  if (len > PAGE_SIZE) len = PAGE_SIZE;
+
+  uint32_t got = 0;
+  int rc = fs_read_at(&pf->file, (uint32_t)off, phys_to_ptr(phys), (uint32_t)len, &got);
+  if (rc != 0 || got != len) {
+    PCACHE_WARN("pcache: read clus=%u page %llu rc=%d\n",
+                (unsigned)pf->file.clus, (unsigned long long)idx, rc);
+    pmm_free_page_phys(phys);
+    return 0;
+  }
+
+  pcache_insert(&g_pc, pf, idx, phys);
+  PCACHE_DBG("pcache: clus=%u page %llu -> 0x%llx\n", (unsigned)pf->file.clus,
+             (unsigned long long)idx, (unsigned long long)phys);
+  return phys;
+}
+
+void pcache_stats(PCacheStats *st)
+{
+  pcache_stats_of(&g_pc, st);
+}
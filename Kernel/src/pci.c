@@ -200,6 +200,65 @@ uint8_t pci_read8(uint8_t bus, uint8_t dev, uint8_t fun, uint16_t off){
   return (uint8_t)((v >> sh) & 0xFF);
 }
 
+// ECAM takes naturally aligned 16-bit stores, which matters for the
+// command register: a 32-bit read-modify-write would also write back the
+// status register's write-1-to-clear bits.
+static uint64_t pci_cfg_phys(uint8_t bus, uint8_t dev, uint8_t fun, uint16_t off){
+  return g_ecam_base
+    + ((uint64_t)bus << 20)
+    + ((uint64_t)dev << 15)
+    + ((uint64_t)fun << 12)
+    + (uint64_t)(off & 0xFFF);
+}
+
+void pci_write32(uint8_t bus, uint8_t dev, uint8_t fun, uint16_t off, uint32_t v){
+  if (!g_ecam_base) return;
+  *(volatile uint32_t*)phys_to_ptr(pci_cfg_phys(bus, dev, fun, off & 0xFFC)) = v;
+}
+
+void pci_write16(uint8_t bus, uint8_t dev, uint8_t fun, uint16_t off, uint16_t v){
+  if (!g_ecam_base) return;
+  *(volatile uint16_t*)phys_to_ptr(pci_cfg_phys(bus, dev, fun, off & 0xFFE)) = v;
+}
+
+uint8_t pci_find_cap(uint8_t bus, uint8_t dev, uint8_t fun, uint8_t id){
+  uint16_t status = pci_read16(bus, dev, fun, 0x06);
+  if (!(status & (1u<<4))) return 0;   // no capability list
+
+  uint8_t off = pci_read8(bus, dev, fun, 0x34) & 0xFC;
+  for (int guard = 0; off && guard < 48; guard++){
+    if (pci_read8(bus, dev, fun, off) == id) return off;
+    off = pci_read8(bus, dev, fun, (uint16_t)(off + 1)) & 0xFC;
+  }
+  return 0;
+}
+
+int pci_msi_enable(uint8_t bus, uint8_t dev, uint8_t fun, uint8_t vector, uint8_t apic_id){
+  uint8_t cap = pci_find_cap(bus, dev, fun, PCI_CAP_MSI);
+  if (!cap) return -1;
+
+  uint16_t ctl = pci_read16(bus, dev, fun, (uint16_t)(cap + 2));
+  int is64 = (ctl & (1u<<7)) != 0;
+
+  // fixed delivery, edge, physical destination = apic_id
+  pci_write32(bus, dev, fun, (uint16_t)(cap + 4), 0xFEE00000u | ((uint32_t)apic_id << 12));
+  if (is64) {
+    pci_write32(bus, dev, fun, (uint16_t)(cap + 8), 0);
+    pci_write16(bus, dev, fun, (uint16_t)(cap + 12), vector);
+  } else {
+    pci_write16(bus, dev, fun, (uint16_t)(cap + 8), vector);
+  }
+
+  ctl &= (uint16_t)~(7u<<4);   // MME = 0: one vector
+  ctl |= 1u;                   // MSI enable
+  pci_write16(bus, dev, fun, (uint16_t)(cap + 2), ctl);
+
+  // the function must not raise INTx as well
+  uint16_t cmd = pci_read16(bus, dev, fun, 0x04);
+  pci_write16(bus, dev, fun, 0x04, (uint16_t)(cmd | PCI_CMD_INTX_DISABLE));
+  return 0;
+}
+
 int pci_get_bus_range(uint8_t *start, uint8_t *end){
   if (!g_ecam_base) return -1;
   if (start) *start = g_bus_start;
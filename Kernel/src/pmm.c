@@ -3,6 +3,10 @@
 #include <carlos/phys.h>
 #include <carlos/pmm.h>
 #include <carlos/klog.h>
+#include <carlos/memacct.h>
+#include <carlos/shrinker.h>
+#include <carlos/time.h>
+#include <carlos/mem.h>
 
 // pmm.c logging (runtime controlled by g_klog_level + g_klog_mask)
 #define PMM_TRACE(...) KLOG(KLOG_MOD_PMM, KLOG_TRACE, __VA_ARGS__)
@@ -27,80 +31,519 @@ typedef struct {
   uint64_t Attribute;
 } EfiMemoryDescriptor;
 
-#define MAX_FREE_PAGES (131072)
-static uint64_t g_free_pages[MAX_FREE_PAGES];
-static uint64_t g_free_top = 0;
+/*
+  Buddy allocator.
+
+  Free memory is kept as naturally aligned blocks of 2^order pages, one
+  doubly-linked free list per order. The list links live inside the free
+  pages themselves (as physical addresses), so the only side metadata is
+  one state byte per page:
+
+    bit 7    : page is the head of a free block
+    bits 0..4: order of that free block
+
+  Pages that are allocated, or are the tail of a free block, have state 0.
+
+  Allocated pages may also carry an owner back-pointer: the one word in
+  the system that holds the page's address (a PTE or a cache slot). Such
+  pages are movable, which is what compaction works with.
+
+  The state map covers [g_base_phys, g_base_phys + g_span_pages pages).
+  It is sized from the EFI memory map at init and carved out of
+  conventional memory, so capacity scales with the machine.
+*/
+
+#define PG_FREE_HEAD  0x80u
+#define PG_ORDER_MASK 0x1Fu
+#define PG_ADDR_MASK  0x000FFFFFFFFFF000ull   // address bits of an owner word
+
+#define PMM_MAX_RESV  4
+
+typedef struct {
+  uint64_t next;   // phys of next free block (0 = end)
+  uint64_t prev;   // phys of prev free block (0 = head)
+} PmmFreeNode;
+
+typedef struct {
+  uint64_t lo, hi; // [lo, hi), page-aligned
+} PmmResv;
+
+static uint8_t *g_page_state = 0;
+static uint64_t **g_page_owner = 0;  // movable pages: word holding the address
+static void    **g_page_priv = 0;   // pinned pages: the allocator's own pointer
+#if KMEM_ACCT
+static uint16_t *g_page_site = 0;    // accounting site per allocated page
+#endif
+static uint64_t g_base_phys = 0;
+static uint64_t g_span_pages = 0;
+
+static uint64_t g_free_head[PMM_NR_ORDERS];
+static uint64_t g_free_blocks[PMM_NR_ORDERS];
+static uint64_t g_free_pages = 0;
+
+static PmmResv  g_resv[PMM_MAX_RESV];
+static uint32_t g_resv_n = 0;
 
 static inline uint64_t align_down(uint64_t x) { return x & ~(PAGE_SIZE - 1); }
 static inline uint64_t align_up(uint64_t x)   { return (x + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1); }
 
-static inline int in_range(uint64_t x, uint64_t lo, uint64_t hi) {
-  return (x >= lo) && (x < hi); // [lo, hi)
+static inline int overlaps(uint64_t a_lo, uint64_t a_hi, uint64_t b_lo, uint64_t b_hi){
+  return a_lo < b_hi && b_lo < a_hi;
 }
 
-static inline int is_reserved_page(uint64_t page_phys,
-                                  uint64_t kernel_lo, uint64_t kernel_hi,
-                                  uint64_t memmap_lo, uint64_t memmap_hi,
-                                  uint64_t bi_lo, uint64_t bi_hi)
-{
-  if (in_range(page_phys, kernel_lo, kernel_hi)) return 1;
-  if (in_range(page_phys, memmap_lo, memmap_hi)) return 1;
-  if (in_range(page_phys, bi_lo, bi_hi)) return 1;
+static void resv_add(uint64_t lo, uint64_t hi){
+  if (g_resv_n >= PMM_MAX_RESV || lo >= hi) return;
+
+  // keep sorted by start so ingest_range can walk them in one pass
+  uint32_t i = g_resv_n++;
+  while (i > 0 && g_resv[i - 1].lo > lo){
+    g_resv[i] = g_resv[i - 1];
+    i--;
+  }
+  g_resv[i] = (PmmResv){ .lo = lo, .hi = hi };
+}
+
+static int resv_overlaps(uint64_t lo, uint64_t hi){
+  for (uint32_t i = 0; i < g_resv_n; i++){
+    if (overlaps(lo, hi, g_resv[i].lo, g_resv[i].hi)) return 1;
+  }
+  return 0;
+}
+
+/* ---------- page index helpers ---------- */
+
+static inline int phys_covered(uint64_t phys){
+  return phys >= g_base_phys && ((phys - g_base_phys) / PAGE_SIZE) < g_span_pages;
+}
+
+static inline uint64_t phys_to_idx(uint64_t phys){
+  return (phys - g_base_phys) / PAGE_SIZE;
+}
+
+static inline uint64_t order_bytes(unsigned order){
+  return PAGE_SIZE << order;
+}
+
+static inline PmmFreeNode* node_of(uint64_t phys){
+  return (PmmFreeNode*)phys_to_ptr(phys);
+}
+
+/* ---------- free lists ---------- */
+
+static void list_push(unsigned order, uint64_t phys){
+  PmmFreeNode *n = node_of(phys);
+  n->prev = 0;
+  n->next = g_free_head[order];
+  if (n->next) node_of(n->next)->prev = phys;
+  g_free_head[order] = phys;
+
+  g_page_state[phys_to_idx(phys)] = (uint8_t)(PG_FREE_HEAD | order);
+  g_free_blocks[order]++;
+  g_free_pages += (1ull << order);
+}
+
+static void list_remove(unsigned order, uint64_t phys){
+  PmmFreeNode *n = node_of(phys);
+  if (n->prev) node_of(n->prev)->next = n->next;
+  else         g_free_head[order] = n->next;
+  if (n->next) node_of(n->next)->prev = n->prev;
+
+  g_page_state[phys_to_idx(phys)] = 0;
+  g_free_blocks[order]--;
+  g_free_pages -= (1ull << order);
+}
+
+static inline int is_free_head(uint64_t phys, unsigned order){
+  if (!phys_covered(phys)) return 0;
+  return g_page_state[phys_to_idx(phys)] == (uint8_t)(PG_FREE_HEAD | order);
+}
+
+// Find the free block containing `phys`. Returns 1 and its head/order if any.
+static int find_free_block(uint64_t phys, uint64_t *head_out, unsigned *order_out){
+  for (unsigned o = 0; o < PMM_NR_ORDERS; o++){
+    uint64_t head = g_base_phys + ((phys - g_base_phys) & ~(order_bytes(o) - 1));
+    if (!phys_covered(head)) break;
+    uint8_t st = g_page_state[phys_to_idx(head)];
+    if ((st & PG_FREE_HEAD) && (st & PG_ORDER_MASK) >= o) {
+      *head_out  = head;
+      *order_out = st & PG_ORDER_MASK;
+      return 1;
+    }
+  }
   return 0;
 }
 
-/* ---------- sort (heapsort, no libc) ---------- */
-static void sift_down(uint64_t *a, uint64_t start, uint64_t end){
-  uint64_t root = start;
-  while (1){
-    uint64_t child = root * 2 + 1;
-    if (child > end) break;
-    uint64_t swap = root;
-    if (a[swap] < a[child]) swap = child;
-    if (child + 1 <= end && a[swap] < a[child + 1]) swap = child + 1;
-    if (swap == root) return;
-    uint64_t tmp = a[root]; a[root] = a[swap]; a[swap] = tmp;
-    root = swap;
+// Return 1 if `phys` lies inside any free block.
+static int page_is_free(uint64_t phys){
+  uint64_t head;
+  unsigned order;
+  return find_free_block(phys, &head, &order);
+}
+
+/* ---------- buddy core ---------- */
+
+// Free one naturally aligned block and merge it with its buddies.
+static void buddy_free_block(uint64_t phys, unsigned order){
+  while (order + 1 < PMM_NR_ORDERS){
+    uint64_t buddy = g_base_phys + ((phys - g_base_phys) ^ order_bytes(order));
+    if (!is_free_head(buddy, order)) break;
+
+    list_remove(order, buddy);
+    if (buddy < phys) phys = buddy;
+    order++;
+  }
+  list_push(order, phys);
+}
+
+static uint64_t buddy_alloc_block(unsigned order){
+  unsigned o = order;
+  while (o < PMM_NR_ORDERS && g_free_head[o] == 0) o++;
+  if (o >= PMM_NR_ORDERS) return 0;
+
+  uint64_t phys = g_free_head[o];
+  list_remove(o, phys);
+
+  // split down, returning the upper halves to their free lists
+  while (o > order){
+    o--;
+    list_push(o, phys + order_bytes(o));
   }
+  return phys;
 }
 
-static void heap_sort_u64(uint64_t *a, uint64_t n){
-  if (n < 2) return;
+// Like buddy_alloc_block, but the returned block must end at or below `limit`
+// (inclusive). Walks the free lists, so it is slower than the plain path.
+static uint64_t buddy_alloc_block_below(unsigned order, uint64_t limit){
+  for (unsigned o = order; o < PMM_NR_ORDERS; o++){
+    for (uint64_t phys = g_free_head[o]; phys; phys = node_of(phys)->next){
+      // splitting keeps the lowest part, so only its end matters
+      if (phys + order_bytes(order) - 1 > limit) continue;
 
-  // heapify (max-heap)
-  for (uint64_t start = (n - 2) / 2 + 1; start > 0; start--){
-    sift_down(a, start - 1, n - 1);
+      list_remove(o, phys);
+      while (o > order){
+        o--;
+        list_push(o, phys + order_bytes(o));
+      }
+      return phys;
+    }
   }
+  return 0;
+}
 
-  // sort (ascending)
-  for (uint64_t end = n - 1; end > 0; end--){
-    uint64_t tmp = a[end]; a[end] = a[0]; a[0] = tmp;
-    sift_down(a, 0, end - 1);
+// Free an arbitrary page run as the largest aligned blocks that fit.
+static void free_range(uint64_t phys, uint64_t pages){
+  while (pages){
+    unsigned o = 0;
+    uint64_t idx = phys_to_idx(phys);
+    while (o + 1 < PMM_NR_ORDERS &&
+           (idx & ((1ull << (o + 1)) - 1)) == 0 &&
+           (1ull << (o + 1)) <= pages) {
+      o++;
+    }
+    buddy_free_block(phys, o);
+    phys  += order_bytes(o);
+    pages -= (1ull << o);
   }
 }
 
-/* insert page_phys into sorted array */
-static void insert_sorted(uint64_t page_phys){
-  if (g_free_top >= MAX_FREE_PAGES) return;
+// Take the exact run [phys, phys + pages) out of the free lists.
+// Every page must be free; parts of the covering blocks outside the run go back.
+static int claim_range(uint64_t phys, uint64_t pages){
+  uint64_t end = phys + pages * PAGE_SIZE;
 
-  uint64_t lo = 0, hi = g_free_top;
-  while (lo < hi){
-    uint64_t mid = lo + ((hi - lo) / 2);
-    if (g_free_pages[mid] < page_phys) lo = mid + 1;
-    else hi = mid;
+  uint64_t head;
+  unsigned o;
+  for (uint64_t cur = phys; cur < end; cur = head + order_bytes(o)){
+    if (!phys_covered(cur) || !find_free_block(cur, &head, &o)) return -1;
   }
 
-  // shift right
-  for (uint64_t i = g_free_top; i > lo; i--){
-    g_free_pages[i] = g_free_pages[i - 1];
+  uint64_t cur = phys;
+  while (cur < end){
+    find_free_block(cur, &head, &o);
+    list_remove(o, head);
+
+    uint64_t blk_end = head + order_bytes(o);
+    if (head < cur)     free_range(head, (cur - head) / PAGE_SIZE);
+    if (blk_end > end)  free_range(end, (blk_end - end) / PAGE_SIZE);
+    cur = (blk_end < end) ? blk_end : end;
   }
-  g_free_pages[lo] = page_phys;
-  g_free_top++;
+  return 0;
+}
+
+static unsigned order_for_pages(uint64_t pages){
+  unsigned o = 0;
+  while ((1ull << o) < pages) o++;
+  return o;
+}
+
+/* ---------- zeroed page pool ---------- */
+
+/*
+  Pages in the pool are already zero and are not counted as free in the
+  buddy allocator. The pool is refilled from idle context
+  (pmm_zero_pool_refill), so pmm_alloc_zeroed_page_phys() normally costs
+  no more than a plain page allocation.
+  Under memory pressure the pool is handed back to the buddy allocator.
+*/
+
+#define PMM_ZERO_POOL_MAX 64
+
+static uint64_t g_zero_pool[PMM_ZERO_POOL_MAX];
+static uint32_t g_zero_cnt = 0;
+static uint64_t g_zero_hits = 0;
+static uint64_t g_zero_misses = 0;
+
+// Pages zeroed ahead of use don't need to sit in the cache meanwhile
+static void zero_pages(uint64_t phys, uint64_t pages)
+{
+  memset_nt(phys_to_ptr(phys), 0, (size_t)(pages * PAGE_SIZE));
+}
+
+static uint64_t zero_pool_pop(void)
+{
+  if (g_zero_cnt == 0) return 0;
+  return g_zero_pool[--g_zero_cnt];
+}
+
+static uint64_t zero_pool_shrink(void *ctx, uint64_t nr_pages)
+{
+  (void)ctx;
+  uint64_t n = 0;
+  while (g_zero_cnt && n < nr_pages) {
+    free_range(g_zero_pool[--g_zero_cnt], 1);
+    n++;
+  }
+  return n;
+}
+
+static Shrinker g_zero_shrinker = {
+  .name = "zero-pool", .scan = zero_pool_shrink, .priority = SHRINK_PRIO_POOL,
+};
+
+/* ---------- memory pressure ---------- */
+
+/*
+  Below the low watermark the shrinkers are asked to bring free memory
+  back up to the high watermark. A failed allocation asks them for the
+  missing pages and retries once.
+*/
+
+#define PMM_WMARK_MIN 64ull
+#define PMM_WMARK_MAX 8192ull
+
+static uint64_t g_wmark_low = 0;
+static uint64_t g_wmark_high = 0;
+static uint64_t g_wmark_runs = 0;
+static uint64_t g_fail_runs = 0;
+
+static void watermark_check(void)
+{
+  if (g_free_pages >= g_wmark_low) return;
+  g_wmark_runs++;
+  shrinker_run(g_wmark_high - g_free_pages);
+}
+
+static int reclaim_for(uint64_t pages)
+{
+  g_fail_runs++;
+  return shrinker_run(pages) != 0;
+}
+
+/* ---------- huge pages ---------- */
+
+/*
+  Order-9 blocks (2 MiB, 2 MiB aligned since the span base is aligned to
+  the largest order). A few are set aside at boot so large-page users do
+  not depend on how fragmented the buddy lists are by the time they ask;
+  when the reserve is empty we fall back to the buddy allocator. The
+  reserve is the last thing the shrinkers give back.
+*/
+
+#define PMM_HUGE_RESERVE_MAX 8
+
+static uint64_t g_huge_resv[PMM_HUGE_RESERVE_MAX];
+static uint32_t g_huge_resv_n = 0;
+static uint32_t g_huge_resv_cap = 0;
+static uint64_t g_huge_hits = 0;
+static uint64_t g_huge_fallbacks = 0;
+static uint64_t g_huge_fails = 0;
+
+static void huge_reserve_fill(void)
+{
+  // at most 1/16 of memory
+  uint64_t cap = g_free_pages / (16ull << PMM_HUGE_ORDER);
+  if (cap > PMM_HUGE_RESERVE_MAX) cap = PMM_HUGE_RESERVE_MAX;
+  g_huge_resv_cap = (uint32_t)cap;
+
+  while (g_huge_resv_n < g_huge_resv_cap) {
+    uint64_t phys = buddy_alloc_block(PMM_HUGE_ORDER);
+    if (!phys) break;
+    g_huge_resv[g_huge_resv_n++] = phys;
+  }
+}
+
+static uint64_t huge_reserve_shrink(void *ctx, uint64_t nr_pages)
+{
+  (void)ctx;
+  uint64_t n = 0;
+  while (g_huge_resv_n && n < nr_pages) {
+    buddy_free_block(g_huge_resv[--g_huge_resv_n], PMM_HUGE_ORDER);
+    n += 1ull << PMM_HUGE_ORDER;
+  }
+  return n;
+}
+
+static Shrinker g_huge_shrinker = {
+  .name = "huge-reserve", .scan = huge_reserve_shrink, .priority = SHRINK_PRIO_RESERVE,
+};
+
+/* ---------- compaction ---------- */
+
+/*
+  When no free block of the wanted order is left, look for the aligned
+  window of that size that holds nothing but free and movable pages (the
+  fewest movable ones wins), take its free blocks off the lists, and move
+  each movable page to a page outside: copy it, store the new address in
+  its owner word, and carry the owner and accounting site along. The
+  window is then one allocated block. The TLB hook runs afterwards, since
+  owner words may be live PTEs.
+*/
+
+static void   (*g_tlb_flush_hook)(void) = 0;
+static uint64_t g_compact_runs = 0;
+static uint64_t g_compact_ok = 0;
+static uint64_t g_compact_migrated = 0;
+static uint64_t g_compact_ns = 0;
+
+// Movable pages in the window at `base`, or -1 if something pinned is in it
+static int64_t window_cost(uint64_t base, unsigned order)
+{
+  uint64_t idx = phys_to_idx(base), end = idx + (1ull << order);
+  int64_t movable = 0;
+  while (idx < end) {
+    uint8_t st = g_page_state[idx];
+    if (st & PG_FREE_HEAD) {
+      idx += 1ull << (st & PG_ORDER_MASK);
+      continue;
+    }
+    if (!g_page_owner[idx]) return -1;
+    movable++;
+    idx++;
+  }
+  return movable;
+}
+
+static uint64_t compact_block(unsigned order)
+{
+  uint64_t t0 = time_now_ns();
+  uint64_t win = 1ull << order;
+  uint64_t best = 0;
+  int64_t best_cost = -1;
+
+  g_compact_runs++;
+  for (uint64_t idx = 0; idx + win <= g_span_pages; idx += win) {
+    int64_t c = window_cost(g_base_phys + idx * PAGE_SIZE, order);
+    if (c < 0 || (best_cost >= 0 && c >= best_cost)) continue;
+    best = g_base_phys + idx * PAGE_SIZE;
+    best_cost = c;
+    if (c == 0) break;
+  }
+  // the movers need somewhere to go outside the window
+  if (best_cost < 0 || (uint64_t)best_cost > g_free_pages - (win - (uint64_t)best_cost))
+    goto out;
+
+  // take the window's free blocks, so replacement pages come from outside
+  uint64_t idx = phys_to_idx(best), end = idx + win;
+  for (uint64_t i = idx; i < end; ) {
+    uint8_t st = g_page_state[i];
+    if (!(st & PG_FREE_HEAD)) { i++; continue; }
+    list_remove(st & PG_ORDER_MASK, g_base_phys + i * PAGE_SIZE);
+    i += 1ull << (st & PG_ORDER_MASK);
+  }
+
+  uint64_t moved = 0;
+  for (uint64_t i = idx; i < end; i++) {
+    if (!g_page_owner[i]) continue;
+    uint64_t to = buddy_alloc_block(0);
+    if (!to) {
+      // cannot happen given the check above; give back what is still ours
+      PMM_ERR("pmm: compaction ran out of pages at 0x%llx\n",
+              (unsigned long long)(g_base_phys + i * PAGE_SIZE));
+      for (uint64_t j = idx; j < end; j++)
+        if (!g_page_owner[j]) free_range(g_base_phys + j * PAGE_SIZE, 1);
+      best = 0;
+      break;
+    }
+
+    uint64_t from = g_base_phys + i * PAGE_SIZE;
+    __builtin_memcpy(phys_to_ptr(to), phys_to_cptr(from), PAGE_SIZE);
+    uint64_t *word = g_page_owner[i];
+    *word = (*word & ~PG_ADDR_MASK) | to;
+    g_page_owner[phys_to_idx(to)] = word;
+    g_page_owner[i] = 0;
+#if KMEM_ACCT
+    g_page_site[phys_to_idx(to)] = g_page_site[i];
+    g_page_site[i] = 0;
+#endif
+    moved++;
+  }
+
+  g_compact_migrated += moved;
+  if (moved && g_tlb_flush_hook) g_tlb_flush_hook();
+  if (best) g_compact_ok++;
+  PMM_DBG("pmm: compact order=%u base=0x%llx moved=%llu\n", order,
+          (unsigned long long)best, (unsigned long long)moved);
+  g_compact_ns += time_now_ns() - t0;
+  return best;
+
+out:
+  g_compact_ns += time_now_ns() - t0;
+  return 0;
+}
+
+/* ---------- init ---------- */
+
+// Free [lo, hi) minus the reserved ranges.
+static void ingest_range(uint64_t lo, uint64_t hi){
+  uint64_t cur = lo;
+
+  for (uint32_t i = 0; i < g_resv_n && cur < hi; i++){
+    const PmmResv *r = &g_resv[i];
+    if (r->hi <= cur || r->lo >= hi) continue;
+    if (r->lo > cur) free_range(cur, (r->lo - cur) / PAGE_SIZE);
+    cur = r->hi;
+  }
+
+  if (cur < hi) free_range(cur, (hi - cur) / PAGE_SIZE);
+}
+
+// Usable part of a conventional descriptor: page-aligned, above the low hard-reserve.
+static int desc_usable(const EfiMemoryDescriptor *d, uint64_t *lo, uint64_t *hi){
+  if (d->Type != EfiConventionalMemory || d->NumberOfPages == 0) return 0;
+
+  uint64_t a = align_up(d->PhysicalStart);
+  uint64_t b = align_down(d->PhysicalStart + d->NumberOfPages * PAGE_SIZE);
+
+  // HARD RESERVE low memory (UEFI often leaves important stuff there even if "Conventional")
+  if (a < PMM_MIN_ALLOC_PHYS) a = PMM_MIN_ALLOC_PHYS;
+  if (a >= b) return 0;
+
+  *lo = a;
+  *hi = b;
+  return 1;
 }
 
 void pmm_init(const BootInfo *bi)
 {
-  g_free_top = 0;
+  for (unsigned o = 0; o < PMM_NR_ORDERS; o++){
+    g_free_head[o] = 0;
+    g_free_blocks[o] = 0;
+  }
+  g_free_pages = 0;
+  g_span_pages = 0;
+  g_page_state = 0;
+  g_resv_n = 0;
+
   if (!bi || bi->magic != CARLOS_BOOTINFO_MAGIC) return;
 
   const uint64_t mm_base = bi->memmap;
@@ -109,97 +552,276 @@ void pmm_init(const BootInfo *bi)
 
   if (!mm_base || !mm_size || !desc_sz) return;
 
-  uint64_t kernel_lo = align_down((uint64_t)(uintptr_t)&__kernel_start);
-  uint64_t kernel_hi = align_up  ((uint64_t)(uintptr_t)&__kernel_end);
-
-  uint64_t memmap_lo = align_down(mm_base);
-  uint64_t memmap_hi = align_up(mm_base + mm_size);
-
   uint64_t bi_phys = bi->bootinfo_phys ? bi->bootinfo_phys : (uint64_t)(uintptr_t)bi;
-  uint64_t bi_lo = align_down(bi_phys);
-  uint64_t bi_hi = bi_lo + PAGE_SIZE;
+
+  resv_add(align_down((uint64_t)(uintptr_t)&__kernel_start),
+           align_up  ((uint64_t)(uintptr_t)&__kernel_end));
+  resv_add(align_down(mm_base), align_up(mm_base + mm_size));
+  resv_add(align_down(bi_phys), align_down(bi_phys) + PAGE_SIZE);
 
   const uint64_t count = mm_size / desc_sz;
   const uint8_t *p = (const uint8_t*)phys_to_cptr(mm_base);
 
+  // Pass 1: span of usable memory
+  uint64_t span_lo = ~0ull, span_hi = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    const EfiMemoryDescriptor *d =
+      (const EfiMemoryDescriptor *)(const void *)(p + i * desc_sz);
+    uint64_t lo, hi;
+    if (!desc_usable(d, &lo, &hi)) continue;
+    if (lo < span_lo) span_lo = lo;
+    if (hi > span_hi) span_hi = hi;
+  }
+  if (span_hi == 0) {
+    PMM_ERR("pmm: no conventional memory above 0x%llx\n",
+            (unsigned long long)PMM_MIN_ALLOC_PHYS);
+    return;
+  }
+
+  // Align the base to the largest block so buddy blocks are physically aligned
+  g_base_phys  = span_lo & ~(order_bytes(PMM_NR_ORDERS - 1) - 1);
+  g_span_pages = (span_hi - g_base_phys) / PAGE_SIZE;
+
+  // Pass 2: place the state map at the highest spot that fits
+  uint64_t state_bytes = (g_span_pages + 7) & ~7ull;
+  uint64_t owner_bytes = g_span_pages * sizeof(uint64_t*);
+  uint64_t priv_bytes  = g_span_pages * sizeof(void*);
+  uint64_t meta_bytes = state_bytes + owner_bytes + priv_bytes;
+#if KMEM_ACCT
+  meta_bytes += g_span_pages * sizeof(uint16_t);
+#endif
+  meta_bytes = align_up(meta_bytes);
+  uint64_t meta_lo = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    const EfiMemoryDescriptor *d =
+      (const EfiMemoryDescriptor *)(const void *)(p + i * desc_sz);
+    uint64_t lo, hi;
+    if (!desc_usable(d, &lo, &hi)) continue;
+    if (hi - lo < meta_bytes) continue;
+
+    uint64_t cand = hi - meta_bytes;
+    if (cand <= meta_lo) continue;
+    if (resv_overlaps(cand, hi)) continue;
+    meta_lo = cand;
+  }
+  if (!meta_lo) {
+    PMM_ERR("pmm: no room for state map (%llu bytes)\n", (unsigned long long)meta_bytes);
+    g_span_pages = 0;
+    return;
+  }
+
+  resv_add(meta_lo, meta_lo + meta_bytes);
+  g_page_state = (uint8_t*)phys_to_ptr(meta_lo);
+  __builtin_memset(g_page_state, 0, (size_t)meta_bytes);
+  g_page_owner = (uint64_t**)(void*)(g_page_state + state_bytes);
+  g_page_priv  = (void**)(void*)(g_page_state + state_bytes + owner_bytes);
+#if KMEM_ACCT
+  g_page_site = (uint16_t*)(void*)(g_page_state + state_bytes + owner_bytes + priv_bytes);
+#endif
+
+  // Pass 3: hand every usable range to the buddy allocator
   for (uint64_t i = 0; i < count; i++) {
     const EfiMemoryDescriptor *d =
       (const EfiMemoryDescriptor *)(const void *)(p + i * desc_sz);
+    uint64_t lo, hi;
+    if (!desc_usable(d, &lo, &hi)) continue;
+    ingest_range(lo, hi);
+  }
 
-    if (d->Type != EfiConventionalMemory) continue;
+  // watermarks scale with memory size (1/64 of it, clamped)
+  g_wmark_low = g_free_pages / 64;
+  if (g_wmark_low < PMM_WMARK_MIN) g_wmark_low = PMM_WMARK_MIN;
+  if (g_wmark_low > PMM_WMARK_MAX) g_wmark_low = PMM_WMARK_MAX;
+  g_wmark_high = g_wmark_low * 2;
+  shrinker_register(&g_zero_shrinker);
 
-    uint64_t start = d->PhysicalStart;
-    uint64_t pages = d->NumberOfPages;
+  huge_reserve_fill();
+  shrinker_register(&g_huge_shrinker);
 
-    for (uint64_t pg = 0; pg < pages; pg++) {
-      uint64_t page_phys = align_down(start + pg * PAGE_SIZE);
+  PMM_INFO("pmm: span 0x%llx..0x%llx (%llu pages), state map %llu KiB @0x%llx\n",
+           (unsigned long long)g_base_phys, (unsigned long long)span_hi,
+           (unsigned long long)g_span_pages,
+           (unsigned long long)(meta_bytes / 1024), (unsigned long long)meta_lo);
+}
 
-      // HARD RESERVE low memory (UEFI often leaves important stuff there even if "Conventional")
-      if (page_phys < PMM_MIN_ALLOC_PHYS)
-        continue;
+/* ---------- accounting ---------- */
 
-      if (is_reserved_page(page_phys, kernel_lo, kernel_hi, memmap_lo, memmap_hi, bi_lo, bi_hi))
-        continue;
+// Charge a fresh allocation to the caller; every page remembers its site so
+// partial frees are charged back correctly.
+static uint64_t acct_alloc(uint64_t base, uint64_t pages, uintptr_t caller)
+{
+#if KMEM_ACCT
+  if (!base) return 0;
+  uint16_t site = memacct_site(MEMACCT_PMM, caller, 0);
+  uint64_t idx = phys_to_idx(base);
+  for (uint64_t i = 0; i < pages; i++) g_page_site[idx + i] = site;
+  memacct_alloc(site, pages * PAGE_SIZE);
+#else
+  (void)pages; (void)caller;
+#endif
+  return base;
+}
 
-      if (g_free_top < MAX_FREE_PAGES) {
-        g_free_pages[g_free_top++] = page_phys;
-      }
+static void acct_free(uint64_t base, uint64_t pages)
+{
+#if KMEM_ACCT
+  uint64_t idx = phys_to_idx(base);
+  uint64_t i = 0;
+  while (i < pages){
+    // one free event per run of pages owned by the same site
+    uint16_t site = g_page_site[idx + i];
+    uint64_t run = 0;
+    while (i < pages && g_page_site[idx + i] == site){
+      g_page_site[idx + i] = 0;
+      i++;
+      run++;
     }
+    memacct_free(site ? site : MEMACCT_PMM, run * PAGE_SIZE);
   }
+#else
+  (void)base; (void)pages;
+#endif
+}
 
-  // Keep free list sorted so contiguous allocation is reliable
-  heap_sort_u64(g_free_pages, g_free_top);
+/* ---------- allocation paths (unaccounted) ---------- */
+
+static uint64_t alloc_page(void)
+{
+  uint64_t phys = buddy_alloc_block(0);
+  if (!phys) phys = zero_pool_pop();   // pool pages are fine too
+  if (!phys && reclaim_for(1)) phys = buddy_alloc_block(0);
+  return phys;
 }
 
+static uint64_t alloc_contig(uint64_t pages)
+{
+  if (pages == 0) return 0;
+  if (pages == 1) return alloc_page();
+
+  unsigned order = order_for_pages(pages);
+  if (order >= PMM_NR_ORDERS) {
+    PMM_WARN("pmm: contig FAIL pages=%llu free=%llu\n",
+            (unsigned long long)pages, (unsigned long long)g_free_pages);
+    return 0;
+  }
+
+  PMM_DBG("pmm: contig request pages=%llu order=%u free=%llu\n",
+          (unsigned long long)pages, order, (unsigned long long)g_free_pages);
+
+  uint64_t base = buddy_alloc_block(order);
+  if (!base && reclaim_for(1ull << order)) base = buddy_alloc_block(order);
+  if (!base) base = compact_block(order);
+  if (!base) {
+    PMM_WARN("pmm: contig FAIL pages=%llu free=%llu\n",
+            (unsigned long long)pages, (unsigned long long)g_free_pages);
+    return 0;
+  }
+
+  // hand back the unused tail of the power-of-two block
+  uint64_t block_pages = 1ull << order;
+  if (block_pages > pages) free_range(base + pages * PAGE_SIZE, block_pages - pages);
+
+  PMM_DBG("pmm: contig ok base=0x%llx free=%llu\n",
+          (unsigned long long)base, (unsigned long long)g_free_pages);
+  return base;
+}
+
+static uint64_t alloc_zeroed_page(void)
+{
+  uint64_t phys = zero_pool_pop();
+  if (phys) {
+    g_zero_hits++;
+    return phys;
+  }
+
+  g_zero_misses++;
+  phys = alloc_page();   // same fallbacks (reclaim) as unzeroed pages
+  // about to be used: zero it through the cache
+  if (phys) __builtin_memset(phys_to_ptr(phys), 0, PAGE_SIZE);
+  return phys;
+}
+
+/* ---------- public API ---------- */
+
 uint64_t pmm_alloc_page_phys(void)
 {
-  if (g_free_top == 0) return 0;
-  // sorted ascending => take highest for O(1)
-  return g_free_pages[--g_free_top];
+  uint64_t phys = acct_alloc(alloc_page(), 1, MEMACCT_CALLER());
+  watermark_check();
+  return phys;
 }
 
 void pmm_free_page_phys(uint64_t phys)
 {
   if (!phys) return;
-  phys &= ~(PAGE_SIZE - 1);
-  insert_sorted(phys);
+  pmm_free_contig_pages_phys(phys & ~(PAGE_SIZE - 1), 1);
 }
 
 uint64_t pmm_free_count(void)
 {
-  return g_free_top;
+  return g_free_pages;
+}
+
+uint64_t pmm_free_count_order(unsigned order)
+{
+  if (order >= PMM_NR_ORDERS) return 0;
+  return g_free_blocks[order];
 }
 
 uint64_t pmm_alloc_contig_pages_phys(uint64_t pages)
+{
+  uint64_t base = acct_alloc(alloc_contig(pages), pages, MEMACCT_CALLER());
+  watermark_check();
+  return base;
+}
+
+uint64_t pmm_alloc_contig_pages_below_phys(uint64_t pages, uint64_t align, uint64_t max_phys)
 {
   if (pages == 0) return 0;
-  if (pages == 1) return pmm_alloc_page_phys();
-  
-  if (g_free_top < pages) return 0;
-
-  PMM_DBG("pmm: contig request pages=%llu free=%llu\n",
-          (unsigned long long)pages, (unsigned long long)g_free_top);
-
-  for (uint64_t i = 0; i + pages <= g_free_top; i++){
-    uint64_t base = g_free_pages[i];
-    int ok = 1;
-    for (uint64_t j = 1; j < pages; j++){
-      if (g_free_pages[i + j] != base + j * PAGE_SIZE) { ok = 0; break; }
-    }
-    if (!ok) continue;
+  if (align & (align - 1)) return 0;
 
-    for (uint64_t k = i; k + pages < g_free_top; k++){
-      g_free_pages[k] = g_free_pages[k + pages];
-    }
-    g_free_top -= pages;
+  // buddy blocks are naturally aligned: grow the order to cover `align`
+  unsigned order = order_for_pages(pages);
+  if (align > PAGE_SIZE) {
+    unsigned aorder = order_for_pages(align / PAGE_SIZE);
+    if (aorder > order) order = aorder;
+  }
+  if (order >= PMM_NR_ORDERS) return 0;
 
-    PMM_DBG("pmm: contig ok base=0x%llx free=%llu\n",
-            (unsigned long long)base, (unsigned long long)g_free_top);
-    return base;
+  uint64_t base = buddy_alloc_block_below(order, max_phys);
+  if (!base && reclaim_for(1ull << order)) base = buddy_alloc_block_below(order, max_phys);
+  if (!base) {
+    PMM_WARN("pmm: contig below 0x%llx FAIL pages=%llu free=%llu\n",
+             (unsigned long long)max_phys, (unsigned long long)pages,
+             (unsigned long long)g_free_pages);
+    return 0;
   }
 
-  PMM_WARN("pmm: contig FAIL pages=%llu free=%llu\n",
-          (unsigned long long)pages, (unsigned long long)g_free_top);
+  uint64_t block_pages = 1ull << order;
+  if (block_pages > pages) free_range(base + pages * PAGE_SIZE, block_pages - pages);
+
+  PMM_DBG("pmm: contig below 0x%llx ok base=0x%llx pages=%llu\n",
+          (unsigned long long)max_phys, (unsigned long long)base, (unsigned long long)pages);
+  acct_alloc(base, pages, MEMACCT_CALLER());
+  watermark_check();
+  return base;
+}
+
+int pmm_claim_pages_phys(uint64_t phys, uint64_t pages)
+{
+  if (!phys || pages == 0 || (phys & (PAGE_SIZE - 1))) return -1;
+  if (claim_range(phys, pages) != 0) return -2;
+
+#if KMEM_ACCT
+  // the run extends the allocation right before it: charge the same site
+  uint64_t idx = phys_to_idx(phys);
+  uint16_t site = (idx > 0 && g_page_site[idx - 1]) ? g_page_site[idx - 1] : MEMACCT_PMM;
+  for (uint64_t i = 0; i < pages; i++) g_page_site[idx + i] = site;
+  memacct_resize(site, 0, pages * PAGE_SIZE);
+#endif
+
+  PMM_DBG("pmm: claim base=0x%llx pages=%llu free=%llu\n",
+          (unsigned long long)phys, (unsigned long long)pages,
+          (unsigned long long)g_free_pages);
   return 0;
 }
 
@@ -213,37 +835,202 @@ void pmm_free_contig_pages_phys(uint64_t base_phys, uint64_t pages)
     return;
   }
 
-  // Insert each page back into g_free_pages[] keeping it sorted.
+  uint64_t last = base_phys + (pages - 1) * PAGE_SIZE;
+  if (!phys_covered(base_phys) || !phys_covered(last)) {
+    PMM_WARN("pmm: free_contig outside span base=0x%llx pages=%llu\n",
+             (unsigned long long)base_phys, (unsigned long long)pages);
+    return;
+  }
+
+  // avoid double-free corrupting the free lists: any page already free
+  // (e.g. an overlapping earlier free) rejects the whole range
   for (uint64_t i = 0; i < pages; i++) {
     uint64_t phys = base_phys + i * PAGE_SIZE;
+    if (page_is_free(phys)) {
+      PMM_WARN("pmm: free_contig duplicate phys=0x%llx base=0x%llx\n",
+               (unsigned long long)phys, (unsigned long long)base_phys);
+      return;
+    }
+  }
 
-    // find insertion point (linear is fine for now)
-    uint64_t pos = 0;
-    while (pos < g_free_top && g_free_pages[pos] < phys) pos++;
+  acct_free(base_phys, pages);
+  for (uint64_t i = 0; i < pages; i++) {
+    g_page_owner[phys_to_idx(base_phys) + i] = 0;
+    g_page_priv[phys_to_idx(base_phys) + i]  = 0;
+  }
+  free_range(base_phys, pages);
 
-    // optional: avoid double-free duplicates
-    if (pos < g_free_top && g_free_pages[pos] == phys) {
-      PMM_WARN("pmm: free_contig duplicate phys=0x%llx\n", (unsigned long long)phys);
-      continue;
-    }
+  PMM_DBG("pmm: free_contig base=0x%llx pages=%llu free=%llu\n",
+          (unsigned long long)base_phys,
+          (unsigned long long)pages,
+          (unsigned long long)g_free_pages);
+}
+
+uint64_t pmm_alloc_zeroed_page_phys(void)
+{
+  uint64_t phys = acct_alloc(alloc_zeroed_page(), 1, MEMACCT_CALLER());
+  watermark_check();
+  return phys;
+}
+
+uint64_t pmm_alloc_zeroed_pages_phys(uint64_t pages)
+{
+  if (pages == 1) {
+    uint64_t phys = acct_alloc(alloc_zeroed_page(), 1, MEMACCT_CALLER());
+    watermark_check();
+    return phys;
+  }
+
+  // the pool only holds single pages; contiguous runs are zeroed here,
+  // through the cache like alloc_zeroed_page since the caller uses them now
+  uint64_t base = alloc_contig(pages);
+  if (!base) return 0;
+  g_zero_misses++;
+  __builtin_memset(phys_to_ptr(base), 0, (size_t)(pages * PAGE_SIZE));
+  acct_alloc(base, pages, MEMACCT_CALLER());
+  watermark_check();
+  return base;
+}
+
+uint32_t pmm_zero_pool_refill(uint32_t budget)
+{
+  uint32_t n = 0;
+  while (n < budget && g_zero_cnt < PMM_ZERO_POOL_MAX) {
+    // never dig below the high watermark just to pre-zero pages
+    if (g_free_pages <= g_wmark_high) break;
+
+    uint64_t phys = buddy_alloc_block(0);
+    if (!phys) break;
+    zero_pages(phys, 1);
+    g_zero_pool[g_zero_cnt++] = phys;
+    n++;
+  }
+  return n;
+}
+
+void pmm_zero_pool_stats(PmmZeroPoolStats *st)
+{
+  if (!st) return;
+  st->avail  = g_zero_cnt;
+  st->cap    = PMM_ZERO_POOL_MAX;
+  st->hits   = g_zero_hits;
+  st->misses = g_zero_misses;
+}
+
+void pmm_pressure_stats(PmmPressureStats *st)
+{
+  if (!st) return;
+  st->wmark_low  = g_wmark_low;
+  st->wmark_high = g_wmark_high;
+  st->wmark_runs = g_wmark_runs;
+  st->fail_runs  = g_fail_runs;
+}
+
+uint64_t pmm_alloc_huge_page_phys(void)
+{
+  uint64_t phys = 0;
+  if (g_huge_resv_n) {
+    phys = g_huge_resv[--g_huge_resv_n];
+    g_huge_hits++;
+  } else {
+    phys = buddy_alloc_block(PMM_HUGE_ORDER);
+    if (!phys && reclaim_for(1ull << PMM_HUGE_ORDER)) phys = buddy_alloc_block(PMM_HUGE_ORDER);
+    if (phys) g_huge_fallbacks++;
+    else      g_huge_fails++;
+  }
+  if (!phys) {
+    PMM_WARN("pmm: huge page FAIL free=%llu\n", (unsigned long long)g_free_pages);
+    return 0;
+  }
+
+  acct_alloc(phys, 1ull << PMM_HUGE_ORDER, MEMACCT_CALLER());
+  watermark_check();
+  return phys;
+}
 
-    // capacity check (whatever your max is)
-    if (g_free_top >= MAX_FREE_PAGES) {
-      PMM_WARN("pmm: free_contig overflow\n");
+void pmm_free_huge_page_phys(uint64_t phys)
+{
+  if (!phys || (phys & (PMM_HUGE_PAGE_SIZE - 1))) {
+    PMM_WARN("pmm: free_huge bad phys=0x%llx\n", (unsigned long long)phys);
+    return;
+  }
+
+  for (uint32_t i = 0; i < g_huge_resv_n; i++){
+    if (g_huge_resv[i] == phys) {
+      PMM_WARN("pmm: free_huge duplicate phys=0x%llx\n", (unsigned long long)phys);
       return;
     }
+  }
 
-    // shift right to make room
-    for (uint64_t k = g_free_top; k > pos; k--) {
-      g_free_pages[k] = g_free_pages[k - 1];
+  // refill the reserve first; validation is the same as for contig frees
+  if (g_huge_resv_n < g_huge_resv_cap &&
+      phys_covered(phys) && !page_is_free(phys)) {
+    // no back-pointers into the old mapping may survive in the reserve
+    uint64_t idx = phys_to_idx(phys);
+    acct_free(phys, 1ull << PMM_HUGE_ORDER);
+    for (uint64_t i = 0; i < (1ull << PMM_HUGE_ORDER); i++) {
+      g_page_owner[idx + i] = 0;
+      g_page_priv[idx + i]  = 0;
+#if KMEM_ACCT
+      g_page_site[idx + i]  = 0;
+#endif
     }
-
-    g_free_pages[pos] = phys;
-    g_free_top++;
+    g_huge_resv[g_huge_resv_n++] = phys;
+    return;
   }
+  pmm_free_contig_pages_phys(phys, 1ull << PMM_HUGE_ORDER);
+}
 
-  PMM_DBG("pmm: free_contig base=0x%llx pages=%llu free=%llu\n",
-          (unsigned long long)base_phys,
-          (unsigned long long)pages,
-          (unsigned long long)g_free_top);
-}
\ No newline at end of file
+void pmm_huge_stats(PmmHugeStats *st)
+{
+  if (!st) return;
+  st->reserved  = g_huge_resv_n;
+  st->cap       = g_huge_resv_cap;
+  st->hits      = g_huge_hits;
+  st->fallbacks = g_huge_fallbacks;
+  st->fails     = g_huge_fails;
+}
+
+void pmm_set_owner(uint64_t phys, uint64_t *word)
+{
+  if (!g_page_owner || !phys_covered(phys)) return;
+  g_page_owner[phys_to_idx(phys)] = word;
+}
+
+void pmm_set_page_priv(uint64_t phys, void *priv)
+{
+  if (!g_page_priv || !phys_covered(phys)) return;
+  g_page_priv[phys_to_idx(phys)] = priv;
+}
+
+void *pmm_page_priv(uint64_t phys)
+{
+  if (!g_page_priv || !phys_covered(phys)) return 0;
+  return g_page_priv[phys_to_idx(phys)];
+}
+
+void pmm_set_tlb_flush_hook(void (*fn)(void))
+{
+  g_tlb_flush_hook = fn;
+}
+
+int pmm_compact(unsigned order)
+{
+  if (order >= PMM_NR_ORDERS || !g_page_state) return -1;
+  for (unsigned o = order; o < PMM_NR_ORDERS; o++)
+    if (g_free_head[o]) return 0;
+
+  uint64_t base = compact_block(order);
+  if (!base) return -2;
+  buddy_free_block(base, order);
+  return 0;
+}
+
+void pmm_compact_stats(PmmCompactStats *st)
+{
+  if (!st) return;
+  st->runs     = g_compact_runs;
+  st->ok       = g_compact_ok;
+  st->migrated = g_compact_migrated;
+  st->ns       = g_compact_ns;
+}
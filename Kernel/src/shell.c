@@ -2,16 +2,25 @@
 #include <carlos/shell.h>
 #include <carlos/str.h>
 #include <carlos/pmm.h>
+#include <carlos/mem.h>
+#include <carlos/mm.h>
+#include <carlos/kmem.h>
+#include <carlos/dma.h>
+#include <carlos/memacct.h>
+#include <carlos/shrinker.h>
 #include <carlos/kbd.h>
 #include <carlos/klog.h>
 #include <carlos/uart.h>
 #include <carlos/fbcon.h>
+#include <carlos/iomap.h>
 #include <carlos/time.h>
+#include <carlos/bench.h>
 #include <carlos/pci.h>
 #include <carlos/ahci.h>
 #include <carlos/fs.h>
 #include <carlos/path.h>
 #include <carlos/exec.h>
+#include <carlos/pcache.h>
 
 #include <carlos/ls.h>
 #include <carlos/mkdir.h>
@@ -196,9 +205,13 @@ static void prompt(void){
 static void cmd_help(void){
   kputs("Commands:\n");
   kputs("  help   - this help\n");
-  kputs("  mem    - show free pages\n");
+  kputs("  mem    - show free pages (per buddy order) and slab caches\n");
+  kputs("  kmemstat [N] - top N allocation sites (kmalloc + pmm)\n");
   kputs("  alloc  - allocate one page\n");
+  kputs("  compact [order] - build a free 2^order page block (default 9)\n");
   kputs("  clear  - clear screen\n");
+  kputs("  fbbench - time framebuffer clear/scroll, UC vs WC mapping\n");
+  kputs("  bench mem - time memcpy/memset/string/path primitives, 8B..8M\n");
   kputs("  halt   - stop CPU\n");
   kputs("  reboot - reboot machine\n");
   kputs("  pf      - trigger a page fault (test IDT)\n");
@@ -206,8 +219,9 @@ static void cmd_help(void){
   kputs("  sleep N - sleep N milliseconds\n");
   kputs("  lspci   - list PCI devices\n");
   kputs("  pcidump BB:DD.F - dump PCI config of device\n");
-  kputs("  ahci    - probe for AHCI controller\n");
+  kputs("  ahci [port] - probe for AHCI controller, or show a port\n");
   kputs("  ahci_read <port> <lba> [count] - read sectors via AHCI and hexdump\n");
+  kputs("  ahci_bench <port> - random 4K reads at queue depth 1, 2, 4, ...\n");
   kputs("  log [lvl] [mask] - set logger (lvl: err|warn|info|dbg|trace)\n");
 }
 
@@ -253,6 +267,94 @@ static void cmd_log(int argc, char **argv){
 
 static void cmd_mem(void){
   kprintf("free pages = %llu\n", pmm_free_count());
+  kprintf("mem routines = %s\n", mem_impl_name());
+
+  kputs("order  blocks\n");
+  for (unsigned o = 0; o < PMM_NR_ORDERS; o++){
+    uint64_t n = pmm_free_count_order(o);
+    if (n == 0) continue;
+    kprintf("  %u   %llu\n", o, (unsigned long long)n);
+  }
+
+  PmmZeroPoolStats zs;
+  pmm_zero_pool_stats(&zs);
+  kprintf("zero pool = %u/%u  hits=%llu misses=%llu\n", zs.avail, zs.cap,
+          (unsigned long long)zs.hits, (unsigned long long)zs.misses);
+
+  DmaStats ds;
+  dma_get_stats(&ds);
+  kprintf("dma pool  = %u bufs (%llu pages)  hits=%llu misses=%llu\n", ds.pooled,
+          (unsigned long long)ds.pooled_pages,
+          (unsigned long long)ds.hits, (unsigned long long)ds.misses);
+
+  PmmPressureStats ps;
+  pmm_pressure_stats(&ps);
+  kprintf("watermarks low=%llu high=%llu  wmark runs=%llu fail runs=%llu\n",
+          (unsigned long long)ps.wmark_low, (unsigned long long)ps.wmark_high,
+          (unsigned long long)ps.wmark_runs, (unsigned long long)ps.fail_runs);
+
+  PmmCompactStats cs;
+  pmm_compact_stats(&cs);
+  kprintf("compaction = %llu runs, %llu ok, %llu pages moved, %llu us\n",
+          (unsigned long long)cs.runs, (unsigned long long)cs.ok,
+          (unsigned long long)cs.migrated, (unsigned long long)(cs.ns / 1000));
+
+  PmmHugeStats hs;
+  pmm_huge_stats(&hs);
+  kprintf("huge 2M   = %u/%u reserved  hits=%llu fallbacks=%llu fails=%llu\n",
+          hs.reserved, hs.cap, (unsigned long long)hs.hits,
+          (unsigned long long)hs.fallbacks, (unsigned long long)hs.fails);
+
+  MmStats ms;
+  mm_stats(&ms);
+  kprintf("direct map = %llu MiB in %s pages (%u table pages)\n",
+          (unsigned long long)(ms.mapped_bytes >> 20),
+          ms.page_size == MM_PAGE_1G ? "1G" : "2M", ms.table_pages);
+  IomapStats is;
+  iomap_stats(&is);
+  kprintf("iomap      = %u windows, %llu KiB  PAT=%s\n", is.maps,
+          (unsigned long long)(is.bytes >> 10), ms.pat ? "yes" : "no");
+  kprintf("app spaces = %llu created  PCID=%s INVPCID=%s\n",
+          (unsigned long long)ms.spaces, ms.pcid ? "yes" : "no",
+          ms.invpcid ? "yes" : "no");
+  kprintf("app faults = %llu filled, %llu cached, %llu zero page, %llu cow, %llu bad\n",
+          (unsigned long long)ms.faults, (unsigned long long)ms.shared_maps,
+          (unsigned long long)ms.zero_maps, (unsigned long long)ms.cow_faults,
+          (unsigned long long)ms.bad_faults);
+  kprintf("app 2M pages = %llu mapped, %llu split\n",
+          (unsigned long long)ms.huge_maps, (unsigned long long)ms.huge_splits);
+  ExecTextStats ts;
+  exec_text_stats(&ts);
+  PCacheStats pc;
+  pcache_stats(&pc);
+  kprintf("page cache = %u files, %llu pages  hits=%llu misses=%llu evictions=%llu\n",
+          pc.files, (unsigned long long)pc.pages, (unsigned long long)pc.hits,
+          (unsigned long long)pc.misses, (unsigned long long)pc.evictions);
+  kprintf("exec text  = %u images, %llu pages  hits=%llu fills=%llu evictions=%llu\n",
+          ts.entries, (unsigned long long)ts.pages, (unsigned long long)ts.hits,
+          (unsigned long long)ts.fills, (unsigned long long)ts.evictions);
+  shrinker_dump();
+
+  kmem_dump_caches();
+}
+
+static void cmd_kmemstat(const char *arg){
+  uint64_t top = parse_u64(arg);
+  if (top == 0) top = 10;
+  memacct_dump((unsigned)top);
+}
+
+// Build a free block of 2^order pages (default 2 MiB) by moving pages.
+static void cmd_compact(const char *arg){
+  unsigned order = (arg && arg[0]) ? (unsigned)parse_u64(arg) : PMM_HUGE_ORDER;
+  PmmCompactStats a, b;
+  pmm_compact_stats(&a);
+  int rc = pmm_compact(order);
+  pmm_compact_stats(&b);
+  kprintf("compact order=%u rc=%d: moved %llu pages in %llu us (free blocks=%llu)\n",
+          order, rc, (unsigned long long)(b.migrated - a.migrated),
+          (unsigned long long)((b.ns - a.ns) / 1000),
+          (unsigned long long)pmm_free_count_order(order < PMM_NR_ORDERS ? order : 0));
 }
 
 static void cmd_alloc(void){
@@ -268,6 +370,69 @@ static void cmd_clear(void){
   uart_puts("\x1b[2J\x1b[H");
 }
 
+// Time fbcon_clear/scroll with the framebuffer mapped UC and then WC.
+static void cmd_fbbench(void){
+  static const struct { uint32_t flags; const char *name; } modes[] = {
+    { IOMAP_UC, "UC" },
+    { IOMAP_WC, "WC" },
+  };
+  enum { CLEARS = 4, SCROLLS = 32 };
+  uint64_t clear_ns[2], scroll_ns[2];
+
+  for (unsigned m = 0; m < 2; m++){
+    if (fbcon_remap(modes[m].flags) != 0){
+      kputs("fbbench: no framebuffer mapping\n");
+      return;
+    }
+    uint64_t t0 = time_now_ns();
+    for (int i = 0; i < CLEARS; i++) fbcon_clear();
+    uint64_t t1 = time_now_ns();
+    for (int i = 0; i < SCROLLS; i++) fbcon_scroll();
+    uint64_t t2 = time_now_ns();
+    clear_ns[m]  = (t1 - t0) / CLEARS;
+    scroll_ns[m] = (t2 - t1) / SCROLLS;
+  }
+
+  fbcon_remap(IOMAP_WC);
+  fbcon_clear();
+  for (unsigned m = 0; m < 2; m++)
+    kprintf("fbbench %s: clear %llu us  scroll %llu us\n", modes[m].name,
+            (unsigned long long)(clear_ns[m] / 1000),
+            (unsigned long long)(scroll_ns[m] / 1000));
+}
+
+static void cmd_bench(const char *what){
+  if (!what || !kstreq(what, "mem")){
+    kputs("usage: bench mem\n");
+    return;
+  }
+  if (!time_now_ns()){
+    kputs("bench: no timer\n");
+    return;
+  }
+
+  void *raw = kmalloc_tagged(BENCH_MEM_BUF_SIZE + 64, "bench");
+  if (!raw){
+    kprintf("bench: can't allocate %llu KiB\n",
+            (unsigned long long)((BENCH_MEM_BUF_SIZE + 64) >> 10));
+    return;
+  }
+
+  BenchMemOps ops = {
+    .name = mem_impl_name(),
+    .cpy = memcpy, .set = memset, .move = memmove, .cmp = memcmp,
+    .slen = kstrlen, .seq = kstreq,
+    .norm_abs = path_normalize_abs, .norm83 = path_norm83,
+  };
+  BenchEnv env = {
+    .now_ns = time_now_ns,
+    .out    = kputs,
+    .buf    = (uint8_t*)(((uintptr_t)raw + 63) & ~(uintptr_t)63),
+  };
+  bench_mem_run(&env, &ops);
+  kfree(raw);
+}
+
 static void cmd_halt(void){
   kputs("halting.\n");
   for(;;) __asm__ volatile ("hlt");
@@ -328,10 +493,29 @@ static void cmd_pcidump(const char *arg){
   pci_dump_bdf(b, d, f);
 }
 
+static void ahci_print_info(uint32_t port, const AhciPortInfo *in){
+  kprintf("ahci: port %u: %llu sectors, %s, depth %u, irq %s\n", port,
+          (unsigned long long)in->sectors, in->ncq ? "NCQ" : "no NCQ", in->depth, in->irq);
+  kprintf("ahci: port %u: %llu commands, %llu errors, max in flight %u\n", port,
+          (unsigned long long)in->commands, (unsigned long long)in->errors, in->max_inflight);
+  kprintf("ahci: port %u: %llu interrupts, %llu halts, latency avg %llu us max %llu us\n", port,
+          (unsigned long long)in->irqs, (unsigned long long)in->halts,
+          (unsigned long long)(in->lat_avg_ns / 1000), (unsigned long long)(in->lat_max_ns / 1000));
+}
+
 static void cmd_ahci(const char *arg){
-  // v1: ignore arg and just auto-probe
-  (void)arg;
-  ahci_probe();
+  // usage: ahci [port]
+  const char *p = skip_ws(arg);
+  if (!p || !*p) { ahci_probe(); return; }
+
+  uint8_t port = 0;
+  const char *e = 0;
+  if (parse_dec_u8(p, &port, &e) != 0) { kputs("usage: ahci [port]\n"); return; }
+
+  AhciPortInfo info;
+  int rc = ahci_port_info(port, &info);
+  if (rc != 0) { kprintf("ahci: port %u not usable (rc=%d)\n", port, (int64_t)rc); return; }
+  ahci_print_info(port, &info);
 }
 
 static void cmd_ahci_read(const char *arg){
@@ -372,6 +556,67 @@ static void cmd_ahci_read(const char *arg){
   pmm_free_page(buf);
 }
 
+static void bench_read_done(AhciReq *rq){
+  uint32_t *cnt = (uint32_t*)rq->ctx;
+  cnt[0]++;
+  if (rq->status != 0) cnt[1]++;
+}
+
+static void cmd_ahci_bench(const char *arg){
+  // usage: ahci_bench <port>
+  enum { READS = 2048, MAX_DEPTH = 32 };
+  uint8_t port = 0;
+  const char *p = skip_ws(arg);
+  const char *e = 0;
+  if (!p || !*p || parse_dec_u8(p, &port, &e) != 0) { kputs("usage: ahci_bench <port>\n"); return; }
+
+  AhciPortInfo info;
+  int rc = ahci_port_info(port, &info);
+  if (rc != 0) { kprintf("ahci_bench: port %u not usable (rc=%d)\n", port, (int64_t)rc); return; }
+  if (info.sectors < 1024) { kputs("ahci_bench: drive capacity unknown\n"); return; }
+
+  DmaBuf bufs;
+  if (dma_alloc(MAX_DEPTH * 4096ull, 4096, DMA_ADDR_32BIT, &bufs) != 0) { kputs("no mem\n"); return; }
+
+  static AhciReq rq[MAX_DEPTH];
+  uint64_t rnd = time_now_ns() | 1;
+
+  for (uint32_t depth = 1; depth <= info.depth && depth <= MAX_DEPTH; depth *= 2){
+    uint32_t cnt[2] = { 0, 0 };   // completed, failed
+    uint32_t issued = 0;
+    for (uint32_t i = 0; i < depth; i++)
+      rq[i] = (AhciReq){ .count = 8, .buf = (uint8_t*)bufs.virt + i * 4096, .done = bench_read_done, .ctx = cnt };
+
+    uint64_t t0 = time_now_ns();
+    uint32_t idle = 0;
+    while (cnt[0] < READS && idle < 5000000){
+      for (uint32_t i = 0; i < depth && issued < READS; i++){
+        if (rq[i].status == AHCI_REQ_PENDING) continue;
+        rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+        rq[i].lba = (rnd % (info.sectors - 8)) & ~7ull;
+        if (ahci_submit(port, &rq[i]) == 0) issued++;
+      }
+      idle = ahci_poll(port) ? 0 : idle + 1;
+    }
+    uint64_t ns = time_now_ns() - t0;
+    if (!ns) ns = 1;
+
+    kprintf("ahci_bench: depth %u: %llu IOPS, %llu MB/s, %u errors\n", depth,
+            (unsigned long long)((uint64_t)cnt[0] * 1000000000ull / ns),
+            (unsigned long long)((uint64_t)cnt[0] * 4096ull * 1000ull / ns),
+            cnt[1]);
+    if (cnt[0] < READS){
+      kputs("ahci_bench: timed out\n");
+      for (uint32_t i = 0; i < depth; i++) ahci_wait(port, &rq[i]);
+      break;
+    }
+  }
+
+  if (ahci_port_info(port, &info) == 0) ahci_print_info(port, &info);
+
+  dma_free(&bufs);
+}
+
 static void run_cmd(char *line){
   if (!line) return;
 
@@ -393,8 +638,12 @@ static void run_cmd(char *line){
   if (kstreq(cmd, "log")) { cmd_log(argc, argv); return; }
 
   if (kstreq(cmd, "mem"))    { cmd_mem();    return; }
+  if (kstreq(cmd, "kmemstat")) { cmd_kmemstat(arg); return; }
   if (kstreq(cmd, "alloc"))  { cmd_alloc();  return; }
+  if (kstreq(cmd, "compact")) { cmd_compact(arg); return; }
   if (kstreq(cmd, "clear"))  { cmd_clear();  return; }
+  if (kstreq(cmd, "fbbench")) { cmd_fbbench(); return; }
+  if (kstreq(cmd, "bench"))  { cmd_bench(arg); return; }
   if (kstreq(cmd, "halt"))   { cmd_halt();   return; }
   if (kstreq(cmd, "reboot")) { cmd_reboot(); return; }
 
@@ -406,6 +655,7 @@ static void run_cmd(char *line){
   if (kstreq(cmd, "pcidump")) { cmd_pcidump(arg); return; }
   if (kstreq(cmd, "ahci"))    { cmd_ahci(arg); return; }
   if (kstreq(cmd, "ahci_read")) { cmd_ahci_read(arg); return; }
+  if (kstreq(cmd, "ahci_bench")) { cmd_ahci_bench(arg); return; }
 
   if (kstreq(cmd, "ls")) {
     if (!g_fs) { kprintf("ls: fs not mounted\n"); return; }
@@ -454,7 +704,11 @@ void shell_run(const BootInfo *bi, Fs *fs) {
 
   while (1){
     char c;
-    if (!kbd_try_getc(&c) && !uart_try_getc(&c)) continue;
+    if (!kbd_try_getc(&c) && !uart_try_getc(&c)) {
+      // idle: top up the zeroed page pool one page at a time
+      pmm_zero_pool_refill(1);
+      continue;
+    }
 
     // Enter
     if (c == '\r' || c == '\n'){
@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include <carlos/shrinker.h>
+#include <carlos/klog.h>
+
+// shrinker.c logging (runtime controlled by g_klog_level + g_klog_mask)
+#define SHRINK_DBG(...) KLOG(KLOG_MOD_PMM, KLOG_DBG, __VA_ARGS__)
+
+static Shrinker *g_shrinkers = 0;     // sorted by priority
+static int       g_in_shrink = 0;
+static uint64_t  g_runs = 0;
+
+void shrinker_register(Shrinker *s)
+{
+  if (!s || !s->scan) return;
+  for (Shrinker *it = g_shrinkers; it; it = it->next){
+    if (it == s) return;
+  }
+
+  Shrinker **pp = &g_shrinkers;
+  while (*pp && (*pp)->priority <= s->priority) pp = &(*pp)->next;
+  s->next = *pp;
+  *pp = s;
+}
+
+uint64_t shrinker_run(uint64_t nr_pages)
+{
+  if (nr_pages == 0 || g_in_shrink) return 0;
+  g_in_shrink = 1;
+  g_runs++;
+
+  uint64_t got = 0;
+  for (Shrinker *s = g_shrinkers; s && got < nr_pages; s = s->next){
+    uint64_t n = s->scan(s->ctx, nr_pages - got);
+    s->calls++;
+    s->reclaimed += n;
+    got += n;
+    if (n) SHRINK_DBG("shrink: %s freed %llu pages\n", s->name, (unsigned long long)n);
+  }
+
+  g_in_shrink = 0;
+  return got;
+}
+
+void shrinker_dump(void)
+{
+  kprintf("shrinkers (runs=%llu):\n", (unsigned long long)g_runs);
+  for (Shrinker *s = g_shrinkers; s; s = s->next){
+    kprintf("  %s prio=%d calls=%llu reclaimed=%llu pages\n", s->name, s->priority,
+            (unsigned long long)s->calls, (unsigned long long)s->reclaimed);
+  }
+}
@@ -0,0 +1,90 @@
+// Kernel/tools/bench_host.c — `make bench-host`
+// Runs src/bench_mem.c on Linux: once against glibc, once against the
+// kernel's mem.c/str.c/path.c, so both sets of numbers come from the same
+// machine and the same harness.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <carlos/bench.h>
+#include <carlos/str.h>
+#include <carlos/path.h>
+
+// src/mem.c, built with its entry points renamed (see the Makefile)
+void *carlos_memcpy(void *dst, const void *src, size_t n);
+void *carlos_memset(void *dst, int c, size_t n);
+void *carlos_memmove(void *dst, const void *src, size_t n);
+int   carlos_memcmp(const void *a, const void *b, size_t n);
+void  mem_init(void);
+const char *mem_impl_name(void);
+
+// what mem.c expects from the rest of the kernel
+volatile uint32_t g_intr_nesting = 0;
+volatile uint8_t  g_klog_level = 0;
+volatile uint32_t g_klog_mask = 0;
+
+void kprintf(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+}
+
+static uint64_t host_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void host_out(const char *s)
+{
+  fputs(s, stdout);
+  fflush(stdout);
+}
+
+static int glibc_streq(const char *a, const char *b)
+{
+  return strcmp(a, b) == 0;
+}
+
+int main(int argc, char **argv)
+{
+  BenchEnv env = {
+    .now_ns = host_now_ns,
+    .out    = host_out,
+    .buf    = aligned_alloc(64, BENCH_MEM_BUF_SIZE),
+    .min_ns = (argc > 1) ? strtoull(argv[1], 0, 0) * 1000000ull : 0,
+  };
+  if (!env.buf) {
+    fprintf(stderr, "bench-host: out of memory\n");
+    return 1;
+  }
+
+  mem_init();
+
+  BenchMemOps glibc = {
+    .name = "glibc",
+    .cpy = memcpy, .set = memset, .move = memmove, .cmp = memcmp,
+    .slen = strlen, .seq = glibc_streq,
+  };
+  char name[64];
+  snprintf(name, sizeof(name), "carlos %s", mem_impl_name());
+  BenchMemOps carlos = {
+    .name = name,
+    .cpy = carlos_memcpy, .set = carlos_memset, .move = carlos_memmove,
+    .cmp = carlos_memcmp, .slen = kstrlen, .seq = kstreq,
+    .norm_abs = path_normalize_abs, .norm83 = path_norm83,
+  };
+
+  bench_mem_run(&env, &glibc);
+  host_out("\n");
+  bench_mem_run(&env, &carlos);
+  free(env.buf);
+  return 0;
+}